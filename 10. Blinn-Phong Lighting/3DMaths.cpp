@@ -1,203 +1,670 @@
 #include "3DMaths.h"
 
-float degreesToRadians(float degs)
+#if defined(__AVX__)
+#include <immintrin.h>
+#elif defined(__SSE__)
+#include <xmmintrin.h>
+#elif defined(__ARM_NEON)
+#include <arm_neon.h>
+#endif
+
+// NOTE: Matrices are column major, so each column is one 4-wide vector.
+// a * b is then a linear combination of a's columns for each column of b,
+// and m * v is a linear combination of m's columns.
+float4x4 operator* (float4x4 a, float4x4 b)
 {
-    return degs * (M_PI / 180.0f);
+    float4x4 result;
+#if defined(__AVX__)
+    // Two columns of the result at once. Each half of bCols holds one of
+    // b's columns, and shuffling within halves broadcasts element i of each.
+    __m256 aCols[4];
+    for(int i = 0; i < 4; ++i)
+        aCols[i] = _mm256_broadcast_ps((const __m128*)a.m[i]);
+    for(int col = 0; col < 4; col += 2) {
+        __m256 bCols = _mm256_loadu_ps(b.m[col]);
+        __m256 sum = _mm256_mul_ps(aCols[0], _mm256_shuffle_ps(bCols, bCols, _MM_SHUFFLE(0,0,0,0)));
+        sum = _mm256_add_ps(sum, _mm256_mul_ps(aCols[1], _mm256_shuffle_ps(bCols, bCols, _MM_SHUFFLE(1,1,1,1))));
+        sum = _mm256_add_ps(sum, _mm256_mul_ps(aCols[2], _mm256_shuffle_ps(bCols, bCols, _MM_SHUFFLE(2,2,2,2))));
+        sum = _mm256_add_ps(sum, _mm256_mul_ps(aCols[3], _mm256_shuffle_ps(bCols, bCols, _MM_SHUFFLE(3,3,3,3))));
+        _mm256_storeu_ps(result.m[col], sum);
+    }
+#elif defined(__SSE__)
+    __m128 aCols[4];
+    for(int i = 0; i < 4; ++i)
+        aCols[i] = _mm_loadu_ps(a.m[i]);
+    for(int col = 0; col < 4; ++col) {
+        __m128 sum = _mm_mul_ps(aCols[0], _mm_set1_ps(b.m[col][0]));
+        sum = _mm_add_ps(sum, _mm_mul_ps(aCols[1], _mm_set1_ps(b.m[col][1])));
+        sum = _mm_add_ps(sum, _mm_mul_ps(aCols[2], _mm_set1_ps(b.m[col][2])));
+        sum = _mm_add_ps(sum, _mm_mul_ps(aCols[3], _mm_set1_ps(b.m[col][3])));
+        _mm_storeu_ps(result.m[col], sum);
+    }
+#elif defined(__ARM_NEON)
+    float32x4_t aCols[4];
+    for(int i = 0; i < 4; ++i)
+        aCols[i] = vld1q_f32(a.m[i]);
+    for(int col = 0; col < 4; ++col) {
+        float32x4_t bCol = vld1q_f32(b.m[col]);
+        float32x4_t sum = vmulq_lane_f32(aCols[0], vget_low_f32(bCol), 0);
+        sum = vmlaq_lane_f32(sum, aCols[1], vget_low_f32(bCol), 1);
+        sum = vmlaq_lane_f32(sum, aCols[2], vget_high_f32(bCol), 0);
+        sum = vmlaq_lane_f32(sum, aCols[3], vget_high_f32(bCol), 1);
+        vst1q_f32(result.m[col], sum);
+    }
+#else
+    for(int col = 0; col < 4; ++col) {
+        for(int row = 0; row < 4; ++row) {
+            float sum = 0.0f;
+            for(int i = 0; i < 4; ++i) {
+                sum += b.m[col][i] * a.m[i][row];
+            }
+            result.m[col][row] = sum;
+        }
+    }
+#endif
+    return result;
 }
 
-float length(float3 v)
+float4 operator* (float4x4 m, float4 v)
 {
-    float result = sqrtf(v.x*v.x + v.y*v.y + v.z*v.z);
+    float4 result;
+#if defined(__SSE__)
+    __m128 sum = _mm_mul_ps(_mm_loadu_ps(m.m[0]), _mm_set1_ps(v.x));
+    sum = _mm_add_ps(sum, _mm_mul_ps(_mm_loadu_ps(m.m[1]), _mm_set1_ps(v.y)));
+    sum = _mm_add_ps(sum, _mm_mul_ps(_mm_loadu_ps(m.m[2]), _mm_set1_ps(v.z)));
+    sum = _mm_add_ps(sum, _mm_mul_ps(_mm_loadu_ps(m.m[3]), _mm_set1_ps(v.w)));
+    _mm_storeu_ps(&result.x, sum);
+#elif defined(__ARM_NEON)
+    float32x4_t sum = vmulq_n_f32(vld1q_f32(m.m[0]), v.x);
+    sum = vmlaq_n_f32(sum, vld1q_f32(m.m[1]), v.y);
+    sum = vmlaq_n_f32(sum, vld1q_f32(m.m[2]), v.z);
+    sum = vmlaq_n_f32(sum, vld1q_f32(m.m[3]), v.w);
+    vst1q_f32(&result.x, sum);
+#else
+    result.x =
+        m.m[0][0] * v.x +
+        m.m[1][0] * v.y +
+        m.m[2][0] * v.z +
+        m.m[3][0] * v.w;
+    result.y = 
+        m.m[0][1] * v.x +
+        m.m[1][1] * v.y +
+        m.m[2][1] * v.z +
+        m.m[3][1] * v.w;
+    result.z = 
+        m.m[0][2] * v.x +
+        m.m[1][2] * v.y +
+        m.m[2][2] * v.z +
+        m.m[3][2] * v.w;
+    result.w = 
+        m.m[0][3] * v.x +
+        m.m[1][3] * v.y +
+        m.m[2][3] * v.z +
+        m.m[3][3] * v.w;
+#endif
     return result;
 }
 
-float length(float4 v)
+float4x4 transpose(float4x4 m)
 {
-    float result = v.x*v.x + v.y*v.y + v.z*v.z + v.w*v.w;
+#if defined(__SSE__)
+    __m128 col0 = _mm_loadu_ps(m.m[0]);
+    __m128 col1 = _mm_loadu_ps(m.m[1]);
+    __m128 col2 = _mm_loadu_ps(m.m[2]);
+    __m128 col3 = _mm_loadu_ps(m.m[3]);
+    _MM_TRANSPOSE4_PS(col0, col1, col2, col3);
+    float4x4 result;
+    _mm_storeu_ps(result.m[0], col0);
+    _mm_storeu_ps(result.m[1], col1);
+    _mm_storeu_ps(result.m[2], col2);
+    _mm_storeu_ps(result.m[3], col3);
     return result;
+#elif defined(__ARM_NEON)
+    // De-interleaving load puts every 4th element together, i.e. the rows
+    float32x4x4_t rows = vld4q_f32(&m.m[0][0]);
+    float4x4 result;
+    vst1q_f32(result.m[0], rows.val[0]);
+    vst1q_f32(result.m[1], rows.val[1]);
+    vst1q_f32(result.m[2], rows.val[2]);
+    vst1q_f32(result.m[3], rows.val[3]);
+    return result;
+#else
+    return float4x4 {
+        m.m[0][0], m.m[1][0], m.m[2][0], m.m[3][0], 
+        m.m[0][1], m.m[1][1], m.m[2][1], m.m[3][1], 
+        m.m[0][2], m.m[1][2], m.m[2][2], m.m[3][2], 
+        m.m[0][3], m.m[1][3], m.m[2][3], m.m[3][3]
+    };
+#endif
 }
 
-float3 normalise(float3 v)
+
+// 4 floats that are worked on together, one per object. 
+// Used by the batched functions, which are written once against these.
+#if defined(__SSE__)
+typedef __m128 FloatLanes;
+static inline FloatLanes lanesSet1(float f) { return _mm_set1_ps(f); }
+static inline FloatLanes lanesLoad(const float* p) { return _mm_loadu_ps(p); }
+static inline void lanesStore(float* p, FloatLanes a) { _mm_storeu_ps(p, a); }
+static inline FloatLanes lanesAdd(FloatLanes a, FloatLanes b) { return _mm_add_ps(a, b); }
+static inline FloatLanes lanesSub(FloatLanes a, FloatLanes b) { return _mm_sub_ps(a, b); }
+static inline FloatLanes lanesMul(FloatLanes a, FloatLanes b) { return _mm_mul_ps(a, b); }
+static inline FloatLanes lanesDiv(FloatLanes a, FloatLanes b) { return _mm_div_ps(a, b); }
+static inline void transposeLanes(FloatLanes* v) { _MM_TRANSPOSE4_PS(v[0], v[1], v[2], v[3]); }
+// Returns (v.y, v.z, v.x, undefined)
+static inline FloatLanes lanesYZX(FloatLanes v) { return _mm_shuffle_ps(v, v, _MM_SHUFFLE(3,0,2,1)); }
+static inline FloatLanes lanesSqrt(FloatLanes a) { return _mm_sqrt_ps(a); }
+static inline FloatLanes lanesAbs(FloatLanes a) { return _mm_andnot_ps(_mm_set1_ps(-0.f), a); }
+// Negates the lanes of 'a' where 'sign' is negative
+static inline FloatLanes lanesFlipSign(FloatLanes a, FloatLanes sign) { return _mm_xor_ps(a, _mm_and_ps(sign, _mm_set1_ps(-0.f))); }
+#elif defined(__ARM_NEON)
+typedef float32x4_t FloatLanes;
+static inline FloatLanes lanesSet1(float f) { return vdupq_n_f32(f); }
+static inline FloatLanes lanesLoad(const float* p) { return vld1q_f32(p); }
+static inline void lanesStore(float* p, FloatLanes a) { vst1q_f32(p, a); }
+static inline FloatLanes lanesAdd(FloatLanes a, FloatLanes b) { return vaddq_f32(a, b); }
+static inline FloatLanes lanesSub(FloatLanes a, FloatLanes b) { return vsubq_f32(a, b); }
+static inline FloatLanes lanesMul(FloatLanes a, FloatLanes b) { return vmulq_f32(a, b); }
+static inline FloatLanes lanesDiv(FloatLanes a, FloatLanes b) { 
+#if defined(__aarch64__)
+    return vdivq_f32(a, b); 
+#else
+    // Two Newton-Raphson steps on the reciprocal estimate
+    float32x4_t r = vrecpeq_f32(b);
+    r = vmulq_f32(r, vrecpsq_f32(b, r));
+    r = vmulq_f32(r, vrecpsq_f32(b, r));
+    return vmulq_f32(a, r);
+#endif
+}
+static inline void transposeLanes(FloatLanes* v) 
 {
-    float invLength = 1.f / length(v);
-    float3 result = v * invLength;
-    return result;
+    float32x4x2_t v01 = vtrnq_f32(v[0], v[1]);
+    float32x4x2_t v23 = vtrnq_f32(v[2], v[3]);
+    v[0] = vcombine_f32(vget_low_f32(v01.val[0]), vget_low_f32(v23.val[0]));
+    v[1] = vcombine_f32(vget_low_f32(v01.val[1]), vget_low_f32(v23.val[1]));
+    v[2] = vcombine_f32(vget_high_f32(v01.val[0]), vget_high_f32(v23.val[0]));
+    v[3] = vcombine_f32(vget_high_f32(v01.val[1]), vget_high_f32(v23.val[1]));
+}
+// Returns (v.y, v.z, v.x, undefined)
+static inline FloatLanes lanesYZX(FloatLanes v) 
+{
+    float32x2_t xy = vget_low_f32(v);
+    return vcombine_f32(vext_f32(xy, vget_high_f32(v), 1), vdup_lane_f32(xy, 0));
+}
+static inline FloatLanes lanesSqrt(FloatLanes a) 
+{
+#if defined(__aarch64__)
+    return vsqrtq_f32(a);
+#else
+    // Two Newton-Raphson steps on the reciprocal square root estimate
+    // NOTE: Gives NaN rather than 0 for 0
+    float32x4_t r = vrsqrteq_f32(a);
+    r = vmulq_f32(r, vrsqrtsq_f32(vmulq_f32(a, r), r));
+    r = vmulq_f32(r, vrsqrtsq_f32(vmulq_f32(a, r), r));
+    return vmulq_f32(a, r);
+#endif
 }
+static inline FloatLanes lanesAbs(FloatLanes a) { return vabsq_f32(a); }
+// Negates the lanes of 'a' where 'sign' is negative
+static inline FloatLanes lanesFlipSign(FloatLanes a, FloatLanes sign) 
+{
+    uint32x4_t signBits = vandq_u32(vreinterpretq_u32_f32(sign), vdupq_n_u32(0x80000000));
+    return vreinterpretq_f32_u32(veorq_u32(vreinterpretq_u32_f32(a), signBits));
+}
+#else
+struct FloatLanes
+{
+    float v[4];
+};
+static inline FloatLanes lanesSet1(float f) { return (FloatLanes){{f, f, f, f}}; }
+static inline FloatLanes lanesLoad(const float* p) { return (FloatLanes){{p[0], p[1], p[2], p[3]}}; }
+static inline void lanesStore(float* p, FloatLanes a) { for(int i=0; i<4; ++i) p[i] = a.v[i]; }
+static inline FloatLanes lanesAdd(FloatLanes a, FloatLanes b) { for(int i=0; i<4; ++i) a.v[i] += b.v[i]; return a; }
+static inline FloatLanes lanesSub(FloatLanes a, FloatLanes b) { for(int i=0; i<4; ++i) a.v[i] -= b.v[i]; return a; }
+static inline FloatLanes lanesMul(FloatLanes a, FloatLanes b) { for(int i=0; i<4; ++i) a.v[i] *= b.v[i]; return a; }
+static inline FloatLanes lanesDiv(FloatLanes a, FloatLanes b) { for(int i=0; i<4; ++i) a.v[i] /= b.v[i]; return a; }
+static inline void transposeLanes(FloatLanes* v) 
+{
+    for(int i=0; i<4; ++i) {
+        for(int j=i+1; j<4; ++j) {
+            float temp = v[i].v[j];
+            v[i].v[j] = v[j].v[i];
+            v[j].v[i] = temp;
+        }
+    }
+}
+// Returns (v.y, v.z, v.x, undefined)
+static inline FloatLanes lanesYZX(FloatLanes v) { return (FloatLanes){{v.v[1], v.v[2], v.v[0], v.v[3]}}; }
+static inline FloatLanes lanesSqrt(FloatLanes a) { for(int i=0; i<4; ++i) a.v[i] = sqrtf(a.v[i]); return a; }
+static inline FloatLanes lanesAbs(FloatLanes a) { for(int i=0; i<4; ++i) a.v[i] = fabsf(a.v[i]); return a; }
+// Negates the lanes of 'a' where 'sign' is negative
+static inline FloatLanes lanesFlipSign(FloatLanes a, FloatLanes sign) { for(int i=0; i<4; ++i) a.v[i] = signbit(sign.v[i]) ? -a.v[i] : a.v[i]; return a; }
+#endif
+
+#define TRANSFORM_BATCH_WIDTH 4
 
-float4 normalise(float4 v)
+// Loads objects [first, first + numObjects) of 'array', filling
+// any lanes past the end of the batch with 'padding'
+static inline FloatLanes loadObjectLanes(const float* array, uint32_t first, uint32_t numObjects, float padding)
 {
-    float invLength = 1.f / length(v);
-    float4 result = v * invLength;
-    return result;
+    if(numObjects == TRANSFORM_BATCH_WIDTH)
+        return lanesLoad(array + first);
+    float values[TRANSFORM_BATCH_WIDTH];
+    for(uint32_t i=0; i<TRANSFORM_BATCH_WIDTH; ++i)
+        values[i] = (i < numObjects) ? array[first + i] : padding;
+    return lanesLoad(values);
 }
 
-float3 cross(float3 a, float3 b)
+// result = a * b, where a is the same for every object
+static void multiplyLanes(FloatLanes result[4][4], const float4x4& a, const FloatLanes b[4][4])
 {
-    float3 result;
-    result.x = ((a.y * b.z) - (a.z * b.y));
-    result.y = ((a.z * b.x) - (a.x * b.z));
-    result.z = ((a.x * b.y) - (a.y * b.x));
-    return result;
+    for(int col = 0; col < 4; ++col) {
+        for(int row = 0; row < 4; ++row) {
+            FloatLanes sum = lanesMul(lanesSet1(a.m[0][row]), b[col][0]);
+            for(int i = 1; i < 4; ++i)
+                sum = lanesAdd(sum, lanesMul(lanesSet1(a.m[i][row]), b[col][i]));
+            result[col][row] = sum;
+        }
+    }
 }
 
-float3 operator* (float3 v, float f)
+// result = a * b, where b is the same for every object
+static void multiplyLanes(FloatLanes result[4][4], const FloatLanes a[4][4], const float4x4& b)
 {
-    float3 result = {v.x*f, v.y*f, v.z*f};
-    return result;
+    for(int col = 0; col < 4; ++col) {
+        for(int row = 0; row < 4; ++row) {
+            FloatLanes sum = lanesMul(a[0][row], lanesSet1(b.m[col][0]));
+            for(int i = 1; i < 4; ++i)
+                sum = lanesAdd(sum, lanesMul(a[i][row], lanesSet1(b.m[col][i])));
+            result[col][row] = sum;
+        }
+    }
 }
 
-float4 operator* (float4 v, float f)
+// Rotation matrix for each lane's quaternion
+static void rotationLanes(FloatLanes rotation[3][3], FloatLanes qx, FloatLanes qy, FloatLanes qz, FloatLanes qw)
 {
-    float4 result = {v.x*f, v.y*f, v.z*f, v.w*f};
-    return result;
+    FloatLanes two = lanesSet1(2.f);
+    FloatLanes one = lanesSet1(1.f);
+    FloatLanes xx = lanesMul(qx, qx), yy = lanesMul(qy, qy), zz = lanesMul(qz, qz);
+    FloatLanes xy = lanesMul(qx, qy), xz = lanesMul(qx, qz), yz = lanesMul(qy, qz);
+    FloatLanes wx = lanesMul(qw, qx), wy = lanesMul(qw, qy), wz = lanesMul(qw, qz);
+    rotation[0][0] = lanesSub(one, lanesMul(two, lanesAdd(yy, zz)));
+    rotation[0][1] = lanesMul(two, lanesAdd(xy, wz));
+    rotation[0][2] = lanesMul(two, lanesSub(xz, wy));
+    rotation[1][0] = lanesMul(two, lanesSub(xy, wz));
+    rotation[1][1] = lanesSub(one, lanesMul(two, lanesAdd(xx, zz)));
+    rotation[1][2] = lanesMul(two, lanesAdd(yz, wx));
+    rotation[2][0] = lanesMul(two, lanesAdd(xz, wy));
+    rotation[2][1] = lanesMul(two, lanesSub(yz, wx));
+    rotation[2][2] = lanesSub(one, lanesMul(two, lanesAdd(xx, yy)));
 }
 
-float3 operator+= (float3 &lhs, float3 rhs) {
-    lhs.x += rhs.x;
-    lhs.y += rhs.y;
-    lhs.z += rhs.z;
-    return lhs;
+// Writes column 'col' of each object's matrix, 'numRows' floats starting
+// 'base' bytes in and every 'stride' bytes after that
+static void storeColumnLanes(const FloatLanes* rows, int numRows, uint32_t numObjects, 
+                             uint8_t* base, size_t stride, int col, size_t colNumBytes)
+{
+    FloatLanes columns[4] = {rows[0], rows[1], rows[2], 
+                             (numRows == 4) ? rows[3] : lanesSet1(0.f)};
+    transposeLanes(columns);
+    for(uint32_t i=0; i<numObjects; ++i)
+        lanesStore((float*)(base + i*stride + col*colNumBytes), columns[i]);
+}
+
+void computeTransforms(const TransformBatch& batch, float4x4 viewMat, float4x4 projMat, 
+                       float4x4 meshMat, TransformOutputs outputs)
+{
+    // The normal matrix is inverse-transpose(view * rotation * scale), which is
+    // inverse-transpose(view) * rotation * inverse(scale) since rotations are
+    // orthonormal, so only the view part needs inverting
+    float3x3 viewNormalMat = normalMatrix(viewMat);
+
+    for(uint32_t first = 0; first < batch.count; first += TRANSFORM_BATCH_WIDTH)
+    {
+        uint32_t numObjects = batch.count - first;
+        if(numObjects > TRANSFORM_BATCH_WIDTH)
+            numObjects = TRANSFORM_BATCH_WIDTH;
+
+        FloatLanes qx = loadObjectLanes(batch.rotX, first, numObjects, 0.f);
+        FloatLanes qy = loadObjectLanes(batch.rotY, first, numObjects, 0.f);
+        FloatLanes qz = loadObjectLanes(batch.rotZ, first, numObjects, 0.f);
+        FloatLanes qw = loadObjectLanes(batch.rotW, first, numObjects, 1.f);
+        FloatLanes scale[3] = {
+            loadObjectLanes(batch.scaleX, first, numObjects, 1.f),
+            loadObjectLanes(batch.scaleY, first, numObjects, 1.f),
+            loadObjectLanes(batch.scaleZ, first, numObjects, 1.f)
+        };
+
+        FloatLanes rotation[3][3];
+        rotationLanes(rotation, qx, qy, qz, qw);
+
+        FloatLanes one = lanesSet1(1.f);
+        FloatLanes zero = lanesSet1(0.f);
+        FloatLanes model[4][4];
+        for(int col = 0; col < 3; ++col) {
+            for(int row = 0; row < 3; ++row)
+                model[col][row] = lanesMul(rotation[col][row], scale[col]);
+            model[col][3] = zero;
+        }
+        model[3][0] = loadObjectLanes(batch.posX, first, numObjects, 0.f);
+        model[3][1] = loadObjectLanes(batch.posY, first, numObjects, 0.f);
+        model[3][2] = loadObjectLanes(batch.posZ, first, numObjects, 0.f);
+        model[3][3] = one;
+
+        FloatLanes modelView[4][4];
+        multiplyLanes(modelView, viewMat, model);
+
+        if(outputs.modelViews || outputs.modelViewProjs)
+        {
+            FloatLanes meshModelView[4][4];
+            multiplyLanes(meshModelView, modelView, meshMat);
+            if(outputs.modelViews) {
+                for(int col = 0; col < 4; ++col)
+                    storeColumnLanes(meshModelView[col], 4, numObjects, (uint8_t*)outputs.modelViews + first*outputs.stride, 
+                                     outputs.stride, col, sizeof(outputs.modelViews->m[0]));
+            }
+            if(outputs.modelViewProjs) {
+                FloatLanes modelViewProj[4][4];
+                multiplyLanes(modelViewProj, projMat, meshModelView);
+                for(int col = 0; col < 4; ++col)
+                    storeColumnLanes(modelViewProj[col], 4, numObjects, (uint8_t*)outputs.modelViewProjs + first*outputs.stride, 
+                                     outputs.stride, col, sizeof(outputs.modelViewProjs->m[0]));
+            }
+        }
+
+        if(outputs.normalMats)
+        {
+            FloatLanes normalMat[3][3];
+            for(int col = 0; col < 3; ++col) {
+                FloatLanes invScale = lanesDiv(one, scale[col]);
+                for(int row = 0; row < 3; ++row) {
+                    FloatLanes sum = lanesMul(lanesSet1(viewNormalMat.m[0][row]), rotation[col][0]);
+                    sum = lanesAdd(sum, lanesMul(lanesSet1(viewNormalMat.m[1][row]), rotation[col][1]));
+                    sum = lanesAdd(sum, lanesMul(lanesSet1(viewNormalMat.m[2][row]), rotation[col][2]));
+                    normalMat[col][row] = lanesMul(sum, invScale);
+                }
+            }
+            for(int col = 0; col < 3; ++col)
+                storeColumnLanes(normalMat[col], 3, numObjects, (uint8_t*)outputs.normalMats + first*outputs.stride, 
+                                 outputs.stride, col, sizeof(outputs.normalMats->m[0]));
+        }
+    }
 }
 
-float3 operator-= (float3 &lhs, float3 rhs) {
-    lhs.x -= rhs.x;
-    lhs.y -= rhs.y;
-    lhs.z -= rhs.z;
-    return lhs;
+static inline FloatLanes lanesCross(FloatLanes a, FloatLanes b)
+{
+    FloatLanes zxy = lanesSub(lanesMul(a, lanesYZX(b)), lanesMul(lanesYZX(a), b));
+    return lanesYZX(zxy);
 }
 
-float3 operator- (float3 v)
+static inline float lanesDot3(FloatLanes a, FloatLanes b)
 {
-    float3 result = {-v.x, -v.y, -v.z};
-    return result;
+    float products[4];
+    lanesStore(products, lanesMul(a, b));
+    return products[0] + products[1] + products[2];
 }
 
-float4x4 scaleMat(float s)
+// NOTE: The inverses below treat each column as a 3D vector plus the
+// bottom row entry, and build the result from cross products of the 
+// columns, following Lengyel's Foundations of Game Engine Development.
+float4x4 inverse(float4x4 m)
 {
-    return (float4x4) {
-        s, 0, 0, 0,
-        0, s, 0, 0,
-        0, 0, s, 0,
-        0, 0, 0, 1
+    FloatLanes a = lanesLoad(m.m[0]);
+    FloatLanes b = lanesLoad(m.m[1]);
+    FloatLanes c = lanesLoad(m.m[2]);
+    FloatLanes d = lanesLoad(m.m[3]);
+    float x = m.m[0][3], y = m.m[1][3], z = m.m[2][3], w = m.m[3][3];
+
+    FloatLanes s = lanesCross(a, b);
+    FloatLanes t = lanesCross(c, d);
+    FloatLanes u = lanesSub(lanesMul(a, lanesSet1(y)), lanesMul(b, lanesSet1(x)));
+    FloatLanes v = lanesSub(lanesMul(c, lanesSet1(w)), lanesMul(d, lanesSet1(z)));
+
+    FloatLanes invDet = lanesSet1(1.f / (lanesDot3(s, v) + lanesDot3(t, u)));
+    s = lanesMul(s, invDet);
+    t = lanesMul(t, invDet);
+    u = lanesMul(u, invDet);
+    v = lanesMul(v, invDet);
+
+    FloatLanes rows[4] = {
+        lanesAdd(lanesCross(b, v), lanesMul(t, lanesSet1(y))),
+        lanesSub(lanesCross(v, a), lanesMul(t, lanesSet1(x))),
+        lanesAdd(lanesCross(d, u), lanesMul(s, lanesSet1(w))),
+        lanesSub(lanesCross(u, c), lanesMul(s, lanesSet1(z)))
     };
+    float4x4 result;
+    for(int i = 0; i < 4; ++i)
+        lanesStore(result.m[i], rows[i]);
+    result.m[0][3] = -lanesDot3(b, t);
+    result.m[1][3] = lanesDot3(a, t);
+    result.m[2][3] = -lanesDot3(d, s);
+    result.m[3][3] = lanesDot3(c, s);
+    // Each row is stored as a column, so flip them round
+    return transpose(result);
 }
 
-float4x4 rotateXMat(float rad) {
-    float4x4 result = {};
-    float sinTheta = sinf(rad);
-    float cosTheta = cosf(rad);
-    result.m[0][0] = 1.f;
-    result.m[1][1] = cosTheta;
-    result.m[1][2] = sinTheta;
-    result.m[2][1] = -sinTheta;
-    result.m[2][2] = cosTheta;
+float4x4 inverseAffine(float4x4 m)
+{
+    FloatLanes a = lanesLoad(m.m[0]);
+    FloatLanes b = lanesLoad(m.m[1]);
+    FloatLanes c = lanesLoad(m.m[2]);
+
+    // Rows of the 3x3 inverse are the cofactor columns over the determinant
+    FloatLanes bc = lanesCross(b, c);
+    FloatLanes invDet = lanesSet1(1.f / lanesDot3(a, bc));
+    FloatLanes cols[4] = {
+        lanesMul(bc, invDet),
+        lanesMul(lanesCross(c, a), invDet),
+        lanesMul(lanesCross(a, b), invDet),
+        lanesSet1(0.f)
+    };
+    transposeLanes(cols);
+
+    // Translation is undone after the rest, so it's -inverse(3x3) * t.
+    // The 3x3 columns' 4th lanes came from the zero row, so they're 0.
+    FloatLanes translation = lanesMul(cols[0], lanesSet1(-m.m[3][0]));
+    translation = lanesSub(translation, lanesMul(cols[1], lanesSet1(m.m[3][1])));
+    translation = lanesSub(translation, lanesMul(cols[2], lanesSet1(m.m[3][2])));
+
+    float4x4 result;
+    for(int i = 0; i < 3; ++i)
+        lanesStore(result.m[i], cols[i]);
+    lanesStore(result.m[3], translation);
     result.m[3][3] = 1.f;
     return result;
 }
 
-float4x4 rotateYMat(float rad) {
-    float4x4 result = {};
-    float sinTheta = sinf(rad);
-    float cosTheta = cosf(rad);
-    result.m[0][0] = cosTheta;
-    result.m[0][2] = -sinTheta;
-    result.m[1][1] = 1.f;
-    result.m[2][0] = sinTheta;
-    result.m[2][2] = cosTheta;
+float4x4 inverseRigid(float4x4 m)
+{
+    // Zero the bottom row so the transpose leaves it out
+    FloatLanes cols[4] = {
+        lanesLoad(m.m[0]),
+        lanesLoad(m.m[1]),
+        lanesLoad(m.m[2]),
+        lanesSet1(0.f)
+    };
+    transposeLanes(cols);
+
+    FloatLanes translation = lanesMul(cols[0], lanesSet1(-m.m[3][0]));
+    translation = lanesSub(translation, lanesMul(cols[1], lanesSet1(m.m[3][1])));
+    translation = lanesSub(translation, lanesMul(cols[2], lanesSet1(m.m[3][2])));
+
+    float4x4 result;
+    for(int i = 0; i < 3; ++i)
+        lanesStore(result.m[i], cols[i]);
+    lanesStore(result.m[3], translation);
+    result.m[0][3] = result.m[1][3] = result.m[2][3] = 0.f;
     result.m[3][3] = 1.f;
     return result;
 }
 
-float4x4 translationMat(float3 trans)
+float3x3 normalMatrix(float4x4 m)
 {
-    float4x4 result = {};
-    result.m[0][0] = 1.f;
-    result.m[1][1] = 1.f;
-    result.m[2][2] = 1.f;
-    result.m[3][0] = trans.x;
-    result.m[3][1] = trans.y;
-    result.m[3][2] = trans.z;
-    result.m[3][3] = 1.f;
+    // The inverse-transpose is the cofactor matrix over the determinant,
+    // and the cofactor columns are cross products of the columns
+    FloatLanes a = lanesLoad(m.m[0]);
+    FloatLanes b = lanesLoad(m.m[1]);
+    FloatLanes c = lanesLoad(m.m[2]);
+    FloatLanes bc = lanesCross(b, c);
+    FloatLanes invDet = lanesSet1(1.f / lanesDot3(a, bc));
+
+    float3x3 result;
+    lanesStore(result.m[0], lanesMul(bc, invDet));
+    lanesStore(result.m[1], lanesMul(lanesCross(c, a), invDet));
+    lanesStore(result.m[2], lanesMul(lanesCross(a, b), invDet));
+    result.m[0][3] = result.m[1][3] = result.m[2][3] = 0.f;
     return result;
 }
 
-float4x4 makePerspectiveMat(float aspectRatio, float fovY, float zNear, float zFar)
+quat slerp(quat a, quat b, float t)
 {
-    // float yScale = 1 / tanf(0.5f * fovY); 
-    // NOTE: 1/tan(X) = tan(90degs - X), so we can avoid a divide
-    // float yScale = tanf((0.5f * M_PI) - (0.5f * fovY));
-    float yScale = tanf(0.5f * (M_PI - fovY));
-    float xScale = yScale / aspectRatio;
-    float zRangeInverse = 1.f / (zNear - zFar);
-    float zScale = zFar * zRangeInverse;
-    float zTranslation = zFar * zNear * zRangeInverse;
+    float cosAngle = dot(a, b);
+    if(cosAngle < 0.f) {
+        b = b * -1.f;
+        cosAngle = -cosAngle;
+    }
+    // NOTE: sin(angle) heads to 0 as a and b get close,
+    // but nlerp is indistinguishable there anyway
+    if(cosAngle > 0.9995f)
+        return nlerp(a, b, t);
+    float angle = acosf(cosAngle);
+    float invSinAngle = 1.f / sinf(angle);
+    return a * (sinf((1.f - t) * angle) * invSinAngle) + b * (sinf(t * angle) * invSinAngle);
+}
 
-    float4x4 result = (float4x4){
-        xScale, 0, 0, 0,
-        0, yScale, 0, 0,
-        0, 0, zScale, -1,
-        0, 0, zTranslation, 0 
-    };
-    return result;
+// Loads quaternions [first, first + numQuats) with one lane per quaternion,
+// padding any lanes past the end with the identity
+static void loadQuatLanes(FloatLanes q[4], const quat* quats, uint32_t first, uint32_t numQuats)
+{
+    const float identity[4] = {0, 0, 0, 1};
+    for(uint32_t i=0; i<4; ++i)
+        q[i] = lanesLoad((i < numQuats) ? (const float*)(quats + first + i) : identity);
+    transposeLanes(q);
 }
 
-float4x4 operator* (float4x4 a, float4x4 b)
+void slerp(quat* out, const quat* a, const quat* b, float t, uint32_t count)
 {
-    float4x4 result = {};
-    for(int col = 0; col < 4; ++col) {
-        for(int row = 0; row < 4; ++row) {
-            float sum = 0.0f;
-            for(int i = 0; i < 4; ++i) {
-                sum += b.m[col][i] * a.m[i][row];
-            }
-            result.m[col][row] = sum;
-        }
+    // NOTE: This is Arseny Kapoulkine's approximation, which picks a 't' for
+    // nlerp based on how far apart the quaternions are so it turns at close to
+    // constant speed. The polynomials were fitted to slerp.
+    FloatLanes tHalf = lanesSet1(t - 0.5f);
+    FloatLanes tCubic = lanesSet1(t * (t - 0.5f) * (t - 1.f));
+    FloatLanes vT = lanesSet1(t);
+    FloatLanes one = lanesSet1(1.f);
+    for(uint32_t first = 0; first < count; first += 4)
+    {
+        uint32_t numQuats = count - first;
+        if(numQuats > 4)
+            numQuats = 4;
+        FloatLanes qa[4], qb[4];
+        loadQuatLanes(qa, a, first, numQuats);
+        loadQuatLanes(qb, b, first, numQuats);
+
+        FloatLanes cosAngle = lanesMul(qa[0], qb[0]);
+        for(int i = 1; i < 4; ++i)
+            cosAngle = lanesAdd(cosAngle, lanesMul(qa[i], qb[i]));
+        FloatLanes d = lanesAbs(cosAngle);
+
+        // A = 1.0904 + d*(-3.2452 + d*(3.55645 - d*1.43519))
+        FloatLanes A = lanesSub(lanesSet1(3.55645f), lanesMul(d, lanesSet1(1.43519f)));
+        A = lanesAdd(lanesSet1(-3.2452f), lanesMul(d, A));
+        A = lanesAdd(lanesSet1(1.0904f), lanesMul(d, A));
+        // B = 0.848013 + d*(-1.06021 + d*0.215638)
+        FloatLanes B = lanesAdd(lanesSet1(-1.06021f), lanesMul(d, lanesSet1(0.215638f)));
+        B = lanesAdd(lanesSet1(0.848013f), lanesMul(d, B));
+        FloatLanes k = lanesAdd(lanesMul(A, lanesMul(tHalf, tHalf)), B);
+        FloatLanes adjustedT = lanesAdd(vT, lanesMul(tCubic, k));
+
+        FloatLanes aWeight = lanesSub(one, adjustedT);
+        FloatLanes bWeight = lanesFlipSign(adjustedT, cosAngle);
+        FloatLanes q[4];
+        for(int i = 0; i < 4; ++i)
+            q[i] = lanesAdd(lanesMul(qa[i], aWeight), lanesMul(qb[i], bWeight));
+        FloatLanes lengthSq = lanesMul(q[0], q[0]);
+        for(int i = 1; i < 4; ++i)
+            lengthSq = lanesAdd(lengthSq, lanesMul(q[i], q[i]));
+        FloatLanes invLength = lanesDiv(one, lanesSqrt(lengthSq));
+        for(int i = 0; i < 4; ++i)
+            q[i] = lanesMul(q[i], invLength);
+
+        transposeLanes(q);
+        for(uint32_t i=0; i<numQuats; ++i)
+            lanesStore((float*)(out + first + i), q[i]);
     }
-    return result;
 }
 
-float4 operator* (float4x4 m, float4 v)
+void rotationMats(float4x4* out, const quat* quats, uint32_t count)
 {
-    float x =
-        m.m[0][0] * v.x +
-        m.m[1][0] * v.y +
-        m.m[2][0] * v.z +
-        m.m[3][0] * v.w;
-    float y = 
-        m.m[0][1] * v.x +
-        m.m[1][1] * v.y +
-        m.m[2][1] * v.z +
-        m.m[3][1] * v.w;
-    float z = 
-        m.m[0][2] * v.x +
-        m.m[1][2] * v.y +
-        m.m[2][2] * v.z +
-        m.m[3][2] * v.w;
-    float w = 
-        m.m[0][3] * v.x +
-        m.m[1][3] * v.y +
-        m.m[2][3] * v.z +
-        m.m[3][3] * v.w;
-    float4 result = {x, y, z, w};
-    return result;
+    FloatLanes zero = lanesSet1(0.f);
+    FloatLanes identityCol[4] = {zero, zero, zero, lanesSet1(1.f)};
+    for(uint32_t first = 0; first < count; first += 4)
+    {
+        uint32_t numQuats = count - first;
+        if(numQuats > 4)
+            numQuats = 4;
+        FloatLanes q[4];
+        loadQuatLanes(q, quats, first, numQuats);
+        FloatLanes rotation[3][3];
+        rotationLanes(rotation, q[0], q[1], q[2], q[3]);
+
+        for(int col = 0; col < 3; ++col) {
+            FloatLanes column[4] = {rotation[col][0], rotation[col][1], rotation[col][2], zero};
+            storeColumnLanes(column, 4, numQuats, (uint8_t*)(out + first), sizeof(float4x4), col, sizeof(out->m[0]));
+        }
+        storeColumnLanes(identityCol, 4, numQuats, (uint8_t*)(out + first), sizeof(float4x4), 3, sizeof(out->m[0]));
+    }
 }
 
-float4x4 transpose(float4x4 m)
+// Rounds to the nearest integer, for |a| < 2^22
+static inline FloatLanes lanesRound(FloatLanes a)
 {
-    return float4x4 {
-        m.m[0][0], m.m[1][0], m.m[2][0], m.m[3][0], 
-        m.m[0][1], m.m[1][1], m.m[2][1], m.m[3][1], 
-        m.m[0][2], m.m[1][2], m.m[2][2], m.m[3][2], 
-        m.m[0][3], m.m[1][3], m.m[2][3], m.m[3][3]
-    };
+    FloatLanes magic = lanesSet1(TRIG_ROUNDING_MAGIC);
+    return lanesSub(lanesAdd(a, magic), magic);
 }
 
-float3x3 float4x4ToFloat3x3(float4x4 m)
+void fastSinCos(float* outSins, float* outCosines, const float* angles, uint32_t count)
 {
-    float3x3 result = {
-        m.m[0][0], m.m[0][1], m.m[0][2], 0.0, 
-        m.m[1][0], m.m[1][1], m.m[1][2], 0.0,
-        m.m[2][0], m.m[2][1], m.m[2][2], 0.0
-    };
-    return result;
+    // NOTE: Same as the scalar fastSinCos(), but the quadrant's bits
+    // are found with float maths so the lanes don't need integers
+    FloatLanes one = lanesSet1(1.f);
+    FloatLanes two = lanesSet1(2.f);
+    FloatLanes half = lanesSet1(0.5f);
+    FloatLanes quarter = lanesSet1(0.25f);
+    uint32_t first = 0;
+    for(; first + 4 <= count; first += 4)
+    {
+        FloatLanes x = lanesLoad(angles + first);
+        FloatLanes quadrant = lanesRound(lanesMul(x, lanesSet1((float)(2.0 / M_PI))));
+        FloatLanes r = lanesSub(x, lanesMul(quadrant, lanesSet1(TRIG_PI_OVER_2_PART1)));
+        r = lanesSub(r, lanesMul(quadrant, lanesSet1(TRIG_PI_OVER_2_PART2)));
+        r = lanesSub(r, lanesMul(quadrant, lanesSet1(TRIG_PI_OVER_2_PART3)));
+        FloatLanes r2 = lanesMul(r, r);
+
+        FloatLanes sinR = lanesAdd(lanesSet1(TRIG_SIN_COEFF5), lanesMul(r2, lanesSet1(TRIG_SIN_COEFF7)));
+        sinR = lanesAdd(lanesSet1(TRIG_SIN_COEFF3), lanesMul(r2, sinR));
+        sinR = lanesAdd(r, lanesMul(lanesMul(r, r2), sinR));
+        FloatLanes cosR = lanesAdd(lanesSet1(TRIG_COS_COEFF6), lanesMul(r2, lanesSet1(TRIG_COS_COEFF8)));
+        cosR = lanesAdd(lanesSet1(TRIG_COS_COEFF4), lanesMul(r2, cosR));
+        cosR = lanesAdd(lanesSub(one, lanesMul(half, r2)), lanesMul(lanesMul(r2, r2), cosR));
+
+        // Bits 0 and 1 of the quadrant as 0 or 1. floor(n/2) is
+        // round(n/2 - 1/4) for whole numbers, which is never a tie.
+        FloatLanes halfQuadrant = lanesRound(lanesSub(lanesMul(quadrant, half), quarter));
+        FloatLanes bit0 = lanesSub(quadrant, lanesMul(halfQuadrant, two));
+        FloatLanes bit1 = lanesSub(halfQuadrant, lanesMul(lanesRound(lanesSub(lanesMul(halfQuadrant, half), quarter)), two));
+
+        // Multiplying by exactly 0 or 1 picks sinR or cosR without rounding
+        FloatLanes notBit0 = lanesSub(one, bit0);
+        FloatLanes sinX = lanesAdd(lanesMul(sinR, notBit0), lanesMul(cosR, bit0));
+        FloatLanes cosX = lanesAdd(lanesMul(cosR, notBit0), lanesMul(sinR, bit0));
+        FloatLanes sinSign = lanesSub(one, lanesMul(two, bit1));
+        // cos is negated when exactly one of the bits is set
+        FloatLanes bit0XorBit1 = lanesSub(lanesAdd(bit0, bit1), lanesMul(two, lanesMul(bit0, bit1)));
+        FloatLanes cosSign = lanesSub(one, lanesMul(two, bit0XorBit1));
+        lanesStore(outSins + first, lanesMul(sinX, sinSign));
+        lanesStore(outCosines + first, lanesMul(cosX, cosSign));
+    }
+    for(; first < count; ++first)
+        fastSinCos(angles[first], outSins + first, outCosines + first);
 }
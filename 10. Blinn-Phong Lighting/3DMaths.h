@@ -1,6 +1,14 @@
 #pragma once
 
 #include <math.h>
+#include <stdint.h>
+#include <stddef.h> //size_t
+
+// NOTE: Small functions are defined here, constexpr where possible, so they
+// can be inlined into any file and calls with constant arguments are worked
+// out at compile time, e.g. constexpr float4x4 m = scaleMat(0.2f);
+// Anything using SIMD is in 3DMaths.cpp. Needs C++14 for the constexpr
+// functions that use local variables.
 
 struct float2
 {
@@ -36,34 +44,471 @@ struct float3x3
     float m[3][4];
 };
 
-float degreesToRadians(float degs);
+constexpr float degreesToRadians(float degs)
+{
+    return degs * (M_PI / 180.0f);
+}
+
+// NOTE: The angle is reduced to r in [-pi/4, pi/4] with x = r + quadrant*pi/2,
+// so only sin(r) and cos(r) need approximating. pi/2 is split into 3 parts
+// (Cody-Waite) so quadrant*part is exact for the first two, which keeps r
+// accurate for large x. The polynomials are from Cephes.
+#define TRIG_PI_OVER_2_PART1 1.5703125f
+#define TRIG_PI_OVER_2_PART2 4.837512969970703125e-4f
+#define TRIG_PI_OVER_2_PART3 7.54978995489188216e-8f
+#define TRIG_SIN_COEFF3 -1.6666654611e-1f
+#define TRIG_SIN_COEFF5 8.3321608736e-3f
+#define TRIG_SIN_COEFF7 -1.9515295891e-4f
+#define TRIG_COS_COEFF4 4.166664568298827e-2f
+#define TRIG_COS_COEFF6 -1.388731625493765e-3f
+#define TRIG_COS_COEFF8 2.443315711809948e-5f
+
+// Rounds to the nearest integer, for |a| < 2^22. Adding 1.5*2^23 leaves
+// no bits for the fraction, so the add does the rounding. Cheaper than 
+// rintf(), which isn't always inlined, and works at compile time.
+#define TRIG_ROUNDING_MAGIC 12582912.f
+
+// Polynomial approximations of sinf() and cosf(), within 1e-7 of the true
+// values for |x| up to 8192, losing accuracy gradually beyond that
+constexpr void fastSinCos(float x, float* outSin, float* outCos)
+{
+    float quadrant = (x * (float)(2.0 / M_PI) + TRIG_ROUNDING_MAGIC) - TRIG_ROUNDING_MAGIC;
+    float r = x - quadrant*TRIG_PI_OVER_2_PART1;
+    r -= quadrant*TRIG_PI_OVER_2_PART2;
+    r -= quadrant*TRIG_PI_OVER_2_PART3;
+    float r2 = r*r;
+    float sinR = r + r*r2*(TRIG_SIN_COEFF3 + r2*(TRIG_SIN_COEFF5 + r2*TRIG_SIN_COEFF7));
+    float cosR = 1.f - 0.5f*r2 + r2*r2*(TRIG_COS_COEFF4 + r2*(TRIG_COS_COEFF6 + r2*TRIG_COS_COEFF8));
+
+    // Each quarter turn maps (sin, cos) to (cos, -sin).
+    // NOTE: Written without branches, since the quadrant is often random.
+    int turns = (int)quadrant & 3;
+    float sinAndCos[2] = {sinR, cosR};
+    *outSin = sinAndCos[turns & 1] * (1.f - (float)(turns & 2));
+    *outCos = sinAndCos[(turns & 1) ^ 1] * (1.f - (float)((turns + 1) & 2));
+}
+
+constexpr float fastSin(float x)
+{
+    float sinX = 0.f, cosX = 0.f;
+    fastSinCos(x, &sinX, &cosX);
+    return sinX;
+}
+
+constexpr float fastCos(float x)
+{
+    float sinX = 0.f, cosX = 0.f;
+    fastSinCos(x, &sinX, &cosX);
+    return cosX;
+}
+
+// Batched version, working on 4 angles at a time using SSE or NEON if 
+// the compiler targets them. Matches fastSinCos() up to rounding.
+void fastSinCos(float* outSins, float* outCosines, const float* angles, uint32_t count);
+
+constexpr float3 cross(float3 a, float3 b)
+{
+    float3 result = {
+        (a.y * b.z) - (a.z * b.y),
+        (a.z * b.x) - (a.x * b.z),
+        (a.x * b.y) - (a.y * b.x)
+    };
+    return result;
+}
+
+constexpr float3 operator* (float3 v, float f)
+{
+    float3 result = {v.x*f, v.y*f, v.z*f};
+    return result;
+}
+
+constexpr float4 operator* (float4 v, float f)
+{
+    float4 result = {v.x*f, v.y*f, v.z*f, v.w*f};
+    return result;
+}
+
+constexpr float3 operator+= (float3 &lhs, float3 rhs) {
+    lhs.x += rhs.x;
+    lhs.y += rhs.y;
+    lhs.z += rhs.z;
+    return lhs;
+}
+
+constexpr float3 operator-= (float3 &lhs, float3 rhs) {
+    lhs.x -= rhs.x;
+    lhs.y -= rhs.y;
+    lhs.z -= rhs.z;
+    return lhs;
+}
+
+constexpr float3 operator- (float3 v)
+{
+    float3 result = {-v.x, -v.y, -v.z};
+    return result;
+}
+
+inline float length(float3 v)
+{
+    float result = sqrtf(v.x*v.x + v.y*v.y + v.z*v.z);
+    return result;
+}
+
+inline float length(float4 v)
+{
+    float result = v.x*v.x + v.y*v.y + v.z*v.z + v.w*v.w;
+    return result;
+}
+
+inline float3 normalise(float3 v)
+{
+    float invLength = 1.f / length(v);
+    float3 result = v * invLength;
+    return result;
+}
+
+inline float4 normalise(float4 v)
+{
+    float invLength = 1.f / length(v);
+    float4 result = v * invLength;
+    return result;
+}
+
+constexpr float4x4 scaleMat(float s)
+{
+    float4x4 result = {
+        s, 0, 0, 0,
+        0, s, 0, 0,
+        0, 0, s, 0,
+        0, 0, 0, 1
+    };
+    return result;
+}
 
-float length(float3 v);
-float length(float4 v);
-float3 normalise(float3 v);
-float4 normalise(float4 v);
-float3 cross(float3 a, float3 b); 
-float3 operator* (float3 v, float f);
-float4 operator* (float4 v, float f);
-float3 operator+= (float3 &lhs, float3 rhs);
-float3 operator-= (float3 &lhs, float3 rhs);
-float3 operator- (float3 v);
+// Return matrix to scale non-uniformly by vector s
+constexpr float4x4 scaleMat(float3 s)
+{
+    float4x4 result = {
+        s.x, 0, 0, 0,
+        0, s.y, 0, 0,
+        0, 0, s.z, 0,
+        0, 0, 0, 1
+    };
+    return result;
+}
 
-float4x4 scaleMat(float s);
 // Return matrix to rotate about x-axis by r radians
-float4x4 rotateXMat(float r); 
+constexpr float4x4 rotateXMat(float rad) {
+    float4x4 result = {};
+    float sinTheta = 0.f, cosTheta = 0.f;
+    fastSinCos(rad, &sinTheta, &cosTheta);
+    result.m[0][0] = 1.f;
+    result.m[1][1] = cosTheta;
+    result.m[1][2] = sinTheta;
+    result.m[2][1] = -sinTheta;
+    result.m[2][2] = cosTheta;
+    result.m[3][3] = 1.f;
+    return result;
+}
+
 // Return matrix to rotate about y-axis by r radians
-float4x4 rotateYMat(float r);
+constexpr float4x4 rotateYMat(float rad) {
+    float4x4 result = {};
+    float sinTheta = 0.f, cosTheta = 0.f;
+    fastSinCos(rad, &sinTheta, &cosTheta);
+    result.m[0][0] = cosTheta;
+    result.m[0][2] = -sinTheta;
+    result.m[1][1] = 1.f;
+    result.m[2][0] = sinTheta;
+    result.m[2][2] = cosTheta;
+    result.m[3][3] = 1.f;
+    return result;
+}
+
 // Return matrix to translate by vector t
-float4x4 translationMat(float3 t);
+constexpr float4x4 translationMat(float3 trans)
+{
+    float4x4 result = {};
+    result.m[0][0] = 1.f;
+    result.m[1][1] = 1.f;
+    result.m[2][2] = 1.f;
+    result.m[3][0] = trans.x;
+    result.m[3][1] = trans.y;
+    result.m[3][2] = trans.z;
+    result.m[3][3] = 1.f;
+    return result;
+}
 
 // Transforms from view-space (x-right, y-up and negative-z-forward)
 // to clip-space (x-right, y-up and z-forward)
 // Assumes that in NDC, z goes from 0 to 1
-float4x4 makePerspectiveMat(float aspectRatio, float fovY, float zNear, float zFar);
+constexpr float4x4 makePerspectiveMat(float aspectRatio, float fovY, float zNear, float zFar)
+{
+    // float yScale = 1 / tanf(0.5f * fovY); 
+    // NOTE: 1/tan(X) = cos(X)/sin(X), and fastSinCos() gives both at once
+    float sinHalfFovY = 0.f, cosHalfFovY = 0.f;
+    fastSinCos(0.5f * fovY, &sinHalfFovY, &cosHalfFovY);
+    float yScale = cosHalfFovY / sinHalfFovY;
+    float xScale = yScale / aspectRatio;
+    float zRangeInverse = 1.f / (zNear - zFar);
+    float zScale = zFar * zRangeInverse;
+    float zTranslation = zFar * zNear * zRangeInverse;
+
+    float4x4 result = {
+        xScale, 0, 0, 0,
+        0, yScale, 0, 0,
+        0, 0, zScale, -1,
+        0, 0, zTranslation, 0 
+    };
+    return result;
+}
 
+// These use AVX, SSE or NEON when the compiler targets them (e.g. AVX
+// needs -mavx), otherwise they're plain C
 float4x4 operator* (float4x4 a, float4x4 b);
 float4 operator* (float4x4 m, float4 v);
 float4x4 transpose(float4x4 m);
 
-float3x3 float4x4ToFloat3x3(float4x4 m);
+constexpr float3x3 float4x4ToFloat3x3(float4x4 m)
+{
+    float3x3 result = {
+        m.m[0][0], m.m[0][1], m.m[0][2], 0.0, 
+        m.m[1][0], m.m[1][1], m.m[1][2], 0.0,
+        m.m[2][0], m.m[2][1], m.m[2][2], 0.0
+    };
+    return result;
+}
+
+// Inverse of any invertible matrix
+float4x4 inverse(float4x4 m);
+// Inverse of a matrix whose bottom row is (0, 0, 0, 1), e.g. any combination
+// of translations, rotations and scales. Cheaper than inverse().
+float4x4 inverseAffine(float4x4 m);
+// Inverse of a matrix made only of rotations and translations,
+// which is just the transposed rotation and the translation undone
+float4x4 inverseRigid(float4x4 m);
+// Matrix for transforming normals by 'm', the inverse-transpose of its
+// upper 3x3. Computed directly from cofactors rather than a 4x4 inverse,
+// and correct for non-uniform scale.
+float3x3 normalMatrix(float4x4 m);
+
+// Rotation as a unit quaternion: (x, y, z) is the axis
+// times sin(angle/2) and w is cos(angle/2)
+struct quat
+{
+    float x, y, z, w;
+};
+
+// Return quaternion to rotate about unit vector 'axis' by r radians
+constexpr quat quatFromAxisAngle(float3 axis, float r)
+{
+    float sinHalfAngle = 0.f, cosHalfAngle = 0.f;
+    fastSinCos(0.5f * r, &sinHalfAngle, &cosHalfAngle);
+    quat result = {axis.x * sinHalfAngle, axis.y * sinHalfAngle, axis.z * sinHalfAngle, cosHalfAngle};
+    return result;
+}
+
+// Rotates by b then a, the same order as multiplying matrices
+constexpr quat operator* (quat a, quat b)
+{
+    quat result = {
+        a.w*b.x + a.x*b.w + a.y*b.z - a.z*b.y,
+        a.w*b.y - a.x*b.z + a.y*b.w + a.z*b.x,
+        a.w*b.z + a.x*b.y - a.y*b.x + a.z*b.w,
+        a.w*b.w - a.x*b.x - a.y*b.y - a.z*b.z
+    };
+    return result;
+}
+
+// Component-wise, for blending
+constexpr quat operator* (quat q, float f)
+{
+    quat result = {q.x*f, q.y*f, q.z*f, q.w*f};
+    return result;
+}
+
+constexpr quat operator+ (quat a, quat b)
+{
+    quat result = {a.x+b.x, a.y+b.y, a.z+b.z, a.w+b.w};
+    return result;
+}
+
+// The inverse rotation, for unit quaternions
+constexpr quat conjugate(quat q)
+{
+    quat result = {-q.x, -q.y, -q.z, q.w};
+    return result;
+}
+
+constexpr float dot(quat a, quat b)
+{
+    return a.x*b.x + a.y*b.y + a.z*b.z + a.w*b.w;
+}
+
+inline quat normalise(quat q)
+{
+    return q * (1.f / sqrtf(dot(q, q)));
+}
+
+constexpr float3 rotate(quat q, float3 v)
+{
+    // v + 2w(u x v) + 2u x (u x v), where u is q's vector part
+    float3 u = {q.x, q.y, q.z};
+    float3 uv = cross(u, v) * 2.f;
+    float3 result = v;
+    result += uv * q.w;
+    result += cross(u, uv);
+    return result;
+}
+
+// Return matrix to rotate by q
+constexpr float4x4 rotationMat(quat q)
+{
+    float xx = q.x*q.x, yy = q.y*q.y, zz = q.z*q.z;
+    float xy = q.x*q.y, xz = q.x*q.z, yz = q.y*q.z;
+    float wx = q.w*q.x, wy = q.w*q.y, wz = q.w*q.z;
+    float4x4 result = {};
+    result.m[0][0] = 1.f - 2.f*(yy + zz);
+    result.m[0][1] = 2.f*(xy + wz);
+    result.m[0][2] = 2.f*(xz - wy);
+    result.m[1][0] = 2.f*(xy - wz);
+    result.m[1][1] = 1.f - 2.f*(xx + zz);
+    result.m[1][2] = 2.f*(yz + wx);
+    result.m[2][0] = 2.f*(xz + wy);
+    result.m[2][1] = 2.f*(yz - wx);
+    result.m[2][2] = 1.f - 2.f*(xx + yy);
+    result.m[3][3] = 1.f;
+    return result;
+}
+
+// Interpolate from a to b along the shorter way round. nlerp() is cheaper
+// but doesn't turn at a constant speed, slerp() does.
+inline quat nlerp(quat a, quat b, float t)
+{
+    // q and -q are the same rotation, pick whichever is closer to a
+    float bWeight = (dot(a, b) < 0.f) ? -t : t;
+    return normalise(a * (1.f - t) + b * bWeight);
+}
+quat slerp(quat a, quat b, float t);
+
+// Batched versions of the above, working on 4 quaternions at a time using
+// SSE or NEON if the compiler targets them.
+// Slerps each a[i] to b[i] by the same 't', e.g. to blend two animation poses.
+// NOTE: Uses nlerp with a correction to 't' rather than trig functions,
+// which stays within 0.001 radians of slerp()
+void slerp(quat* out, const quat* a, const quat* b, float t, uint32_t count);
+void rotationMats(float4x4* out, const quat* quats, uint32_t count);
+
+// Rigid transform (a rotation followed by a translation) as a unit dual
+// quaternion, which is half the size of a float4x4 and can be blended.
+// 'real' is the rotation and 'dual' is 0.5 * translation * real.
+struct dualquat
+{
+    quat real;
+    quat dual;
+};
+
+constexpr dualquat makeDualQuat(quat rotation, float3 translation)
+{
+    quat t = {translation.x, translation.y, translation.z, 0.f};
+    dualquat result = {rotation, (t * rotation) * 0.5f};
+    return result;
+}
+
+// Transforms by b then a, the same order as multiplying matrices
+constexpr dualquat operator* (dualquat a, dualquat b)
+{
+    dualquat result = {a.real * b.real, a.real * b.dual + a.dual * b.real};
+    return result;
+}
+
+// The inverse transform, for unit dual quaternions
+constexpr dualquat conjugate(dualquat dq)
+{
+    dualquat result = {conjugate(dq.real), conjugate(dq.dual)};
+    return result;
+}
+
+// Also removes any drift that would add skew
+inline dualquat normalise(dualquat dq)
+{
+    float invLength = 1.f / sqrtf(dot(dq.real, dq.real));
+    dualquat result = {dq.real * invLength, dq.dual * invLength};
+    // A unit dual quaternion's parts are orthogonal
+    result.dual = result.dual + result.real * -dot(result.real, result.dual);
+    return result;
+}
+
+constexpr float3 getTranslation(dualquat dq)
+{
+    quat t = (dq.dual * 2.f) * conjugate(dq.real);
+    float3 result = {t.x, t.y, t.z};
+    return result;
+}
+
+constexpr float3 transformPoint(dualquat dq, float3 p)
+{
+    float3 result = rotate(dq.real, p);
+    result += getTranslation(dq);
+    return result;
+}
+
+constexpr float4x4 rigidTransformMat(dualquat dq)
+{
+    float4x4 result = rotationMat(dq.real);
+    float3 t = getTranslation(dq);
+    result.m[3][0] = t.x;
+    result.m[3][1] = t.y;
+    result.m[3][2] = t.z;
+    return result;
+}
+
+// Blends a and b along the shorter way round (dual quaternion linear blending)
+inline dualquat nlerp(dualquat a, dualquat b, float t)
+{
+    float bWeight = (dot(a.real, b.real) < 0.f) ? -t : t;
+    dualquat result = {a.real * (1.f - t) + b.real * bWeight, a.dual * (1.f - t) + b.dual * bWeight};
+    return normalise(result);
+}
+
+// Transforms for a batch of objects, stored as structure of arrays so
+// computeTransforms() can work on several objects with each instruction.
+// Each object's model matrix is translation * rotation * scale.
+// Every array has 'count' elements, the caller owns them.
+struct TransformBatch
+{
+    uint32_t count;
+    float* posX;
+    float* posY;
+    float* posZ;
+    // Unit quaternions
+    float* rotX;
+    float* rotY;
+    float* rotZ;
+    float* rotW;
+    float* scaleX;
+    float* scaleY;
+    float* scaleZ;
+};
+
+// Where computeTransforms() writes each object's matrices. Any of them can
+// be null. Object i's matrices are 'stride' bytes after object i-1's, so they
+// can be written straight into an array of structs like VSUniforms.
+struct TransformOutputs
+{
+    float4x4* modelViews;
+    float4x4* modelViewProjs;
+    float3x3* normalMats;
+    size_t stride;
+};
+
+// For every object in 'batch', with model matrix M, writes:
+//   modelView = viewMat * M * meshMat
+//   modelViewProj = projMat * viewMat * M * meshMat
+//   normalMat = inverse-transpose of viewMat * M (upper 3x3 only)
+// 'meshMat' applies to positions only, e.g. to dequantise packed vertices,
+// so isn't part of the normal matrix. Scales must be non-zero.
+// Works on 4 objects at a time using SSE or NEON if the compiler targets
+// them, so the cost per object stays flat however many there are.
+void computeTransforms(const TransformBatch& batch, float4x4 viewMat, float4x4 projMat, 
+                       float4x4 meshMat, TransformOutputs outputs);
@@ -0,0 +1,124 @@
+#include "AssetLoading.h"
+
+// NOTE: STB_IMAGE_IMPLEMENTATION is defined in main.mm
+#include "stb_image.h"
+
+#include <assert.h>
+#include <stdlib.h> //malloc(), free()
+#include <string.h> //memset()
+
+struct AssetLoadJob
+{
+    AssetBatch* batch;
+    uint32_t requestIndex;
+};
+
+void freeLoadedImage(LoadedImage image)
+{
+    stbi_image_free(image.pixels);
+}
+
+static void loadAssetJob(void* userData)
+{
+    AssetLoadJob* job = (AssetLoadJob*)userData;
+    AssetBatch* batch = job->batch;
+    const AssetRequest* request = batch->requests + job->requestIndex;
+    LoadedAsset* result = batch->results + job->requestIndex;
+
+    // NOTE: Each job only writes its own result, which the main
+    // thread doesn't read until it's been marked as finished
+    result->requestIndex = job->requestIndex;
+    if(request->type == AssetType_Mesh)
+    {
+        if(request->cachePath)
+            result->mesh = loadObjCached(request->path, request->cachePath, request->objLoadFlags, batch->pool);
+        else
+            result->mesh = loadObj(request->path, request->objLoadFlags, batch->pool);
+        result->succeeded = (result->mesh.vertexBuffer != NULL);
+    }
+    else
+    {
+        assert(request->type == AssetType_Image);
+        LoadedImage* image = &result->image;
+        int forceNumChannels = 4;
+        image->pixels = stbi_load(request->path, &image->width, &image->height,
+                                  &image->numChannelsInFile, forceNumChannels);
+        result->succeeded = (image->pixels != NULL);
+        if(!result->succeeded)
+            memset(image, 0, sizeof(LoadedImage));
+    }
+
+    pthread_mutex_lock(&batch->mutex);
+    batch->finishedOrder[batch->numFinished++] = job->requestIndex;
+    pthread_cond_signal(&batch->assetFinished);
+    pthread_mutex_unlock(&batch->mutex);
+}
+
+void beginAssetBatch(AssetBatch* batch, ThreadPool* pool, const AssetRequest* requests, uint32_t numRequests)
+{
+    batch->pool = pool;
+    batch->requests = requests;
+    batch->numRequests = numRequests;
+    batch->results = (LoadedAsset*)calloc(numRequests, sizeof(LoadedAsset));
+    batch->jobs = (AssetLoadJob*)malloc(numRequests * sizeof(AssetLoadJob));
+    batch->finishedOrder = (uint32_t*)malloc(numRequests * sizeof(uint32_t));
+    batch->numFinished = 0;
+    batch->numReturned = 0;
+    pthread_mutex_init(&batch->mutex, NULL);
+    pthread_cond_init(&batch->assetFinished, NULL);
+
+    // NOTE: Assets are handed back through finishedOrder as they finish,
+    // the group is only waited on to make sure the pool is done with them
+    batch->group = {};
+    for(uint32_t i=0; i<numRequests; ++i)
+    {
+        batch->jobs[i].batch = batch;
+        batch->jobs[i].requestIndex = i;
+        threadPoolPushJob(pool, &batch->group, loadAssetJob, batch->jobs + i);
+    }
+}
+
+bool waitForNextAsset(AssetBatch* batch, LoadedAsset* outAsset)
+{
+    pthread_mutex_lock(&batch->mutex);
+    if(batch->numReturned == batch->numRequests) {
+        pthread_mutex_unlock(&batch->mutex);
+        return false;
+    }
+    while(batch->numReturned == batch->numFinished)
+    {
+        // Help out rather than sitting idle. If nothing's queued then every
+        // asset left is already loading on a worker, which will wake us.
+        pthread_mutex_unlock(&batch->mutex);
+        bool ranJob = threadPoolRunQueuedJob(batch->pool);
+        pthread_mutex_lock(&batch->mutex);
+        if(!ranJob && batch->numReturned == batch->numFinished)
+            pthread_cond_wait(&batch->assetFinished, &batch->mutex);
+    }
+    uint32_t requestIndex = batch->finishedOrder[batch->numReturned++];
+    pthread_mutex_unlock(&batch->mutex);
+
+    *outAsset = batch->results[requestIndex];
+    return true;
+}
+
+void endAssetBatch(AssetBatch* batch)
+{
+    LoadedAsset asset;
+    while(waitForNextAsset(batch, &asset))
+    {
+        if(batch->requests[asset.requestIndex].type == AssetType_Mesh)
+            freeLoadedObj(asset.mesh);
+        else
+            freeLoadedImage(asset.image);
+    }
+    // NOTE: The pool still touches the group after
+    // each job has marked its asset as finished
+    threadPoolWait(batch->pool, &batch->group);
+
+    pthread_cond_destroy(&batch->assetFinished);
+    pthread_mutex_destroy(&batch->mutex);
+    free(batch->finishedOrder);
+    free(batch->jobs);
+    free(batch->results);
+}
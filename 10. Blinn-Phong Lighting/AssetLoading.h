@@ -0,0 +1,102 @@
+#pragma once
+
+#include "ObjLoading.h"
+#include "ThreadPool.h"
+
+#include <pthread.h>
+
+// Loads a list of meshes and images in parallel on a ThreadPool, one job
+// per asset, and hands each one back as soon as it's done. Startup time then
+// scales with the number of cores rather than being the sum of every load,
+// and the caller can upload finished assets while the rest are still loading.
+//
+// Usage:
+// AssetRequest requests[] = {
+//     {AssetType_Mesh, "cube.obj", "cube.meshcache", ObjLoadFlag_OptimiseOverdraw},
+//     {AssetType_Image, "test.png"},
+// };
+// AssetBatch batch;
+// beginAssetBatch(&batch, &threadPool, requests, 2);
+// LoadedAsset asset;
+// while(waitForNextAsset(&batch, &asset)) {
+//     ... // Upload asset.mesh or asset.image, then free it
+// }
+// endAssetBatch(&batch);
+
+enum AssetType
+{
+    AssetType_Mesh,
+    AssetType_Image,
+};
+
+struct AssetRequest
+{
+    AssetType type;
+    const char* path;
+    // Meshes only. Loaded with loadObjCached() if cachePath isn't null,
+    // otherwise with loadObj(). Large meshes are also split across the pool.
+    const char* cachePath;
+    uint32_t objLoadFlags;
+};
+
+// Image loaded with stb_image, always converted to 4 channels
+struct LoadedImage
+{
+    // RGBA8, free with freeLoadedImage()
+    unsigned char* pixels;
+    int width;
+    int height;
+    // Number of channels in the file itself
+    int numChannelsInFile;
+};
+
+void freeLoadedImage(LoadedImage image);
+
+struct LoadedAsset
+{
+    // Index into the requests passed to beginAssetBatch()
+    uint32_t requestIndex;
+    // False if the file couldn't be loaded, in which
+    // case 'mesh' and 'image' are zeroed
+    bool succeeded;
+    // Only one is filled in, depending on the request's type.
+    // The caller owns them, see freeLoadedObj() and freeLoadedImage().
+    LoadedObj mesh;
+    LoadedImage image;
+};
+
+struct AssetLoadJob;
+
+struct AssetBatch
+{
+    ThreadPool* pool;
+    ThreadPoolJobGroup group;
+    const AssetRequest* requests;
+    uint32_t numRequests;
+    LoadedAsset* results;
+    AssetLoadJob* jobs;
+
+    // Request indices in the order they finished loading.
+    // Only accessed while holding the mutex.
+    pthread_mutex_t mutex;
+    pthread_cond_t assetFinished;
+    uint32_t* finishedOrder;
+    uint32_t numFinished;
+    uint32_t numReturned;
+};
+
+// Queues a job on 'pool' to load each of 'requests', which must stay
+// valid until endAssetBatch(). Returns straight away.
+// NOTE: stb_image must be built with STBI_NO_FAILURE_STRINGS, since
+// otherwise failed loads write to a global string, see main.mm
+void beginAssetBatch(AssetBatch* batch, ThreadPool* pool, const AssetRequest* requests, uint32_t numRequests);
+
+// Blocks until another asset has finished loading and fills in 'outAsset'
+// with it, running queued jobs on the calling thread while it waits.
+// Assets come back in the order they finish, not the order requested.
+// Returns false once every asset in the batch has been returned.
+bool waitForNextAsset(AssetBatch* batch, LoadedAsset* outAsset);
+
+// Waits for any assets still loading and frees the batch's bookkeeping.
+// Assets that were never returned by waitForNextAsset() are freed too.
+void endAssetBatch(AssetBatch* batch);
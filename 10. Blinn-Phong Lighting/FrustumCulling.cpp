@@ -0,0 +1,193 @@
+#include "FrustumCulling.h"
+
+#if defined(__AVX__)
+#include <immintrin.h>
+#elif defined(__SSE__)
+#include <xmmintrin.h>
+#elif defined(__ARM_NEON)
+#include <arm_neon.h>
+#endif
+
+// CULL_BATCH_WIDTH volumes that are tested together
+#if defined(__AVX__)
+#define CULL_BATCH_WIDTH 8
+typedef __m256 CullLanes;
+static inline CullLanes cullSet1(float f) { return _mm256_set1_ps(f); }
+static inline CullLanes cullLoad(const float* p) { return _mm256_loadu_ps(p); }
+static inline CullLanes cullAdd(CullLanes a, CullLanes b) { return _mm256_add_ps(a, b); }
+static inline CullLanes cullMul(CullLanes a, CullLanes b) { return _mm256_mul_ps(a, b); }
+// Bit i is set if lane i of a >= lane i of b
+static inline uint32_t cullGreaterEqualMask(CullLanes a, CullLanes b) { return (uint32_t)_mm256_movemask_ps(_mm256_cmp_ps(a, b, _CMP_GE_OQ)); }
+#elif defined(__SSE__)
+#define CULL_BATCH_WIDTH 4
+typedef __m128 CullLanes;
+static inline CullLanes cullSet1(float f) { return _mm_set1_ps(f); }
+static inline CullLanes cullLoad(const float* p) { return _mm_loadu_ps(p); }
+static inline CullLanes cullAdd(CullLanes a, CullLanes b) { return _mm_add_ps(a, b); }
+static inline CullLanes cullMul(CullLanes a, CullLanes b) { return _mm_mul_ps(a, b); }
+// Bit i is set if lane i of a >= lane i of b
+static inline uint32_t cullGreaterEqualMask(CullLanes a, CullLanes b) { return (uint32_t)_mm_movemask_ps(_mm_cmpge_ps(a, b)); }
+#elif defined(__ARM_NEON)
+#define CULL_BATCH_WIDTH 4
+typedef float32x4_t CullLanes;
+static inline CullLanes cullSet1(float f) { return vdupq_n_f32(f); }
+static inline CullLanes cullLoad(const float* p) { return vld1q_f32(p); }
+static inline CullLanes cullAdd(CullLanes a, CullLanes b) { return vaddq_f32(a, b); }
+static inline CullLanes cullMul(CullLanes a, CullLanes b) { return vmulq_f32(a, b); }
+// Bit i is set if lane i of a >= lane i of b
+static inline uint32_t cullGreaterEqualMask(CullLanes a, CullLanes b)
+{
+    const uint32_t laneBits[4] = {1, 2, 4, 8};
+    uint32x4_t bits = vandq_u32(vcgeq_f32(a, b), vld1q_u32(laneBits));
+#if defined(__aarch64__)
+    return vaddvq_u32(bits);
+#else
+    uint32x2_t sum = vadd_u32(vget_low_u32(bits), vget_high_u32(bits));
+    return vget_lane_u32(vpadd_u32(sum, sum), 0);
+#endif
+}
+#else
+#define CULL_BATCH_WIDTH 1
+typedef float CullLanes;
+static inline CullLanes cullSet1(float f) { return f; }
+static inline CullLanes cullLoad(const float* p) { return *p; }
+static inline CullLanes cullAdd(CullLanes a, CullLanes b) { return a + b; }
+static inline CullLanes cullMul(CullLanes a, CullLanes b) { return a * b; }
+static inline uint32_t cullGreaterEqualMask(CullLanes a, CullLanes b) { return (a >= b) ? 1 : 0; }
+#endif
+
+#define CULL_ALL_LANES_MASK ((1u << CULL_BATCH_WIDTH) - 1)
+
+Frustum makeFrustum(const float4x4& viewProj)
+{
+    // NOTE: A point is inside the frustum if its clip-space position has
+    // -w <= x <= w, -w <= y <= w and 0 <= z <= w (Metal's depth range).
+    // Each of those is a plane made from rows of the matrix (Gribb/Hartmann).
+    float rows[4][4];
+    for(int row = 0; row < 4; ++row)
+        for(int col = 0; col < 4; ++col)
+            rows[row][col] = viewProj.m[col][row];
+
+    Frustum result;
+    for(int i = 0; i < 4; ++i)
+    {
+        result.planes[0][i] = rows[3][i] + rows[0][i]; // Left
+        result.planes[1][i] = rows[3][i] - rows[0][i]; // Right
+        result.planes[2][i] = rows[3][i] + rows[1][i]; // Bottom
+        result.planes[3][i] = rows[3][i] - rows[1][i]; // Top
+        result.planes[4][i] = rows[2][i];              // Near
+        result.planes[5][i] = rows[3][i] - rows[2][i]; // Far
+    }
+    // Normalise so plane distances can be compared against radii
+    for(int p = 0; p < 6; ++p)
+    {
+        float* plane = result.planes[p];
+        float invLength = 1.f / sqrtf(plane[0]*plane[0] + plane[1]*plane[1] + plane[2]*plane[2]);
+        for(int i = 0; i < 4; ++i)
+            plane[i] *= invLength;
+    }
+    return result;
+}
+
+// Appends first + i to outVisible for each bit i set in 'visibleMask'.
+// Every lane is written but only visible ones are kept, which avoids a
+// hard-to-predict branch per volume. Writes stay inside outVisible since
+// numVisible can't be past 'first'.
+static inline uint32_t appendVisible(uint32_t* outVisible, uint32_t numVisible, uint32_t first, uint32_t visibleMask)
+{
+    for(uint32_t i = 0; i < CULL_BATCH_WIDTH; ++i)
+    {
+        outVisible[numVisible] = first + i;
+        numVisible += (visibleMask >> i) & 1;
+    }
+    return numVisible;
+}
+
+static inline bool isSphereVisible(const Frustum& frustum, float x, float y, float z, float radius)
+{
+    for(int p = 0; p < 6; ++p)
+    {
+        const float* plane = frustum.planes[p];
+        if(plane[0]*x + plane[1]*y + plane[2]*z + plane[3] < -radius)
+            return false;
+    }
+    return true;
+}
+
+uint32_t cullSpheres(const Frustum& frustum, const BoundingSpheres& spheres, uint32_t* outVisible)
+{
+    uint32_t numVisible = 0;
+    uint32_t first = 0;
+    for(; first + CULL_BATCH_WIDTH <= spheres.count; first += CULL_BATCH_WIDTH)
+    {
+        CullLanes x = cullLoad(spheres.centerX + first);
+        CullLanes y = cullLoad(spheres.centerY + first);
+        CullLanes z = cullLoad(spheres.centerZ + first);
+        CullLanes negRadius = cullMul(cullLoad(spheres.radius + first), cullSet1(-1.f));
+
+        uint32_t visibleMask = CULL_ALL_LANES_MASK;
+        for(int p = 0; p < 6 && visibleMask; ++p)
+        {
+            const float* plane = frustum.planes[p];
+            CullLanes distance = cullAdd(cullMul(x, cullSet1(plane[0])), cullSet1(plane[3]));
+            distance = cullAdd(distance, cullMul(y, cullSet1(plane[1])));
+            distance = cullAdd(distance, cullMul(z, cullSet1(plane[2])));
+            visibleMask &= cullGreaterEqualMask(distance, negRadius);
+        }
+        numVisible = appendVisible(outVisible, numVisible, first, visibleMask);
+    }
+    // Leftovers that don't fill a batch
+    for(; first < spheres.count; ++first)
+    {
+        if(isSphereVisible(frustum, spheres.centerX[first], spheres.centerY[first],
+                           spheres.centerZ[first], spheres.radius[first]))
+            outVisible[numVisible++] = first;
+    }
+    return numVisible;
+}
+
+uint32_t cullBoxes(const Frustum& frustum, const BoundingBoxes& boxes, uint32_t* outVisible)
+{
+    // NOTE: A box is entirely outside a plane if its corner furthest along
+    // the plane's normal is. Every box uses the same corner for a given
+    // plane, so which bound to load can be picked once per plane.
+    const float* furthestX[6];
+    const float* furthestY[6];
+    const float* furthestZ[6];
+    for(int p = 0; p < 6; ++p)
+    {
+        furthestX[p] = (frustum.planes[p][0] >= 0.f) ? boxes.maxX : boxes.minX;
+        furthestY[p] = (frustum.planes[p][1] >= 0.f) ? boxes.maxY : boxes.minY;
+        furthestZ[p] = (frustum.planes[p][2] >= 0.f) ? boxes.maxZ : boxes.minZ;
+    }
+
+    uint32_t numVisible = 0;
+    uint32_t first = 0;
+    CullLanes zero = cullSet1(0.f);
+    for(; first + CULL_BATCH_WIDTH <= boxes.count; first += CULL_BATCH_WIDTH)
+    {
+        uint32_t visibleMask = CULL_ALL_LANES_MASK;
+        for(int p = 0; p < 6 && visibleMask; ++p)
+        {
+            const float* plane = frustum.planes[p];
+            CullLanes distance = cullAdd(cullMul(cullLoad(furthestX[p] + first), cullSet1(plane[0])), cullSet1(plane[3]));
+            distance = cullAdd(distance, cullMul(cullLoad(furthestY[p] + first), cullSet1(plane[1])));
+            distance = cullAdd(distance, cullMul(cullLoad(furthestZ[p] + first), cullSet1(plane[2])));
+            visibleMask &= cullGreaterEqualMask(distance, zero);
+        }
+        numVisible = appendVisible(outVisible, numVisible, first, visibleMask);
+    }
+    for(; first < boxes.count; ++first)
+    {
+        bool isVisible = true;
+        for(int p = 0; p < 6 && isVisible; ++p)
+        {
+            const float* plane = frustum.planes[p];
+            isVisible = plane[0]*furthestX[p][first] + plane[1]*furthestY[p][first]
+                      + plane[2]*furthestZ[p][first] + plane[3] >= 0.f;
+        }
+        if(isVisible)
+            outVisible[numVisible++] = first;
+    }
+    return numVisible;
+}
@@ -0,0 +1,58 @@
+#pragma once
+
+#include "3DMaths.h"
+
+// Tests bounding volumes against a view frustum so objects that can't be
+// seen aren't drawn. Volumes are passed as structure of arrays so several
+// can be tested with each instruction: 8 at a time with AVX, 4 with SSE or
+// NEON, one at a time otherwise.
+//
+// Usage:
+// Frustum frustum = makeFrustum(perspectiveMat * viewMat);
+// BoundingSpheres spheres = {numObjects, centerX, centerY, centerZ, radius};
+// uint32_t numVisible = cullSpheres(frustum, spheres, visibleIndices);
+// for(uint32_t i=0; i<numVisible; ++i)
+//     ... // Draw object visibleIndices[i]
+
+// Planes of a view frustum as (a, b, c, d), with the normal (a, b, c)
+// pointing inwards and normalised, so dot(normal, p) + d is the signed
+// distance from the plane to point p
+struct Frustum
+{
+    float planes[6][4];
+};
+
+// Extracts the frustum planes from a projection (as made by
+// makePerspectiveMat()) times a view matrix. Volumes tested against it
+// are in world space, or in model space if the matrix includes a model
+// matrix too.
+Frustum makeFrustum(const float4x4& viewProj);
+
+struct BoundingSpheres
+{
+    uint32_t count;
+    const float* centerX;
+    const float* centerY;
+    const float* centerZ;
+    const float* radius;
+};
+
+struct BoundingBoxes
+{
+    uint32_t count;
+    const float* minX;
+    const float* minY;
+    const float* minZ;
+    const float* maxX;
+    const float* maxY;
+    const float* maxZ;
+};
+
+// Writes the index of every volume that might be visible to 'outVisible',
+// which needs room for all of them, in increasing order. Returns how many
+// were written.
+// NOTE: Volumes are only culled if they're entirely outside one of the
+// planes, so a few near the frustum's corners are kept even though they
+// can't be seen
+uint32_t cullSpheres(const Frustum& frustum, const BoundingSpheres& spheres, uint32_t* outVisible);
+uint32_t cullBoxes(const Frustum& frustum, const BoundingBoxes& boxes, uint32_t* outVisible);
@@ -0,0 +1,97 @@
+#pragma once
+
+#include <stdint.h>
+#include <stddef.h> //size_t
+
+// A linear allocator over a block of memory supplied by the caller.
+// Nothing is freed individually, the whole arena is cleared at once.
+// Allocations that outlive a function are pushed onto the start of the
+// block, and temporary scratch space is pushed onto the end, so a function
+// can free all its scratch space when it's done without disturbing the
+// results it pushed in the meantime.
+//
+// Usage:
+// MemoryArena arena = makeMemoryArena(malloc(numBytes), numBytes);
+// size_t scratchMarker = beginArenaScratch(&arena);
+// float* temp = pushScratchArray(&arena, 1024, float);
+// Result* results = pushArray(&arena, numResults, Result);
+// endArenaScratch(&arena, scratchMarker); // Frees temp, keeps results
+// ...
+// clearMemoryArena(&arena); // Frees everything
+struct MemoryArena
+{
+    uint8_t* base;
+    size_t size;
+    size_t used;        // From the start of the block
+    size_t scratchUsed; // From the end of the block
+};
+
+// Alignment of every allocation, enough for any type including SIMD vectors.
+// The block passed to makeMemoryArena() must be aligned to this too, which
+// memory from malloc() is.
+#define MEMORY_ARENA_ALIGNMENT 16
+
+inline MemoryArena makeMemoryArena(void* memory, size_t numBytes)
+{
+    MemoryArena result = {};
+    result.base = (uint8_t*)memory;
+    result.size = numBytes;
+    return result;
+}
+
+inline void clearMemoryArena(MemoryArena* arena)
+{
+    arena->used = 0;
+    arena->scratchUsed = 0;
+}
+
+inline size_t getArenaNumFreeBytes(const MemoryArena& arena)
+{
+    return arena.size - arena.used - arena.scratchUsed;
+}
+
+// Returns NULL if there isn't enough room left
+inline void* pushSize(MemoryArena* arena, size_t numBytes)
+{
+    size_t offset = (arena->used + MEMORY_ARENA_ALIGNMENT - 1) & ~(size_t)(MEMORY_ARENA_ALIGNMENT - 1);
+    size_t end = arena->size - arena->scratchUsed;
+    if(offset > end || numBytes > end - offset)
+        return NULL;
+    arena->used = offset + numBytes;
+    return arena->base + offset;
+}
+
+// Returns NULL if there isn't enough room left
+inline void* pushScratchSize(MemoryArena* arena, size_t numBytes)
+{
+    size_t end = arena->size - arena->scratchUsed;
+    if(numBytes > end - arena->used)
+        return NULL;
+    size_t offset = (end - numBytes) & ~(size_t)(MEMORY_ARENA_ALIGNMENT - 1);
+    if(offset < arena->used)
+        return NULL;
+    arena->scratchUsed = arena->size - offset;
+    return arena->base + offset;
+}
+
+#define pushArray(arena, count, type) (type*)pushSize(arena, (count) * sizeof(type))
+#define pushScratchArray(arena, count, type) (type*)pushScratchSize(arena, (count) * sizeof(type))
+
+// Gives back the last 'numBytes' of the most recent pushSize(),
+// for when it turns out to need less room than was reserved
+inline void popSize(MemoryArena* arena, size_t numBytes)
+{
+    arena->used -= numBytes;
+}
+
+// Scratch space pushed after beginArenaScratch() is freed
+// by passing the value it returned to endArenaScratch()
+inline size_t beginArenaScratch(const MemoryArena* arena)
+{
+    return arena->scratchUsed;
+}
+
+inline void endArenaScratch(MemoryArena* arena, size_t scratchMarker)
+{
+    arena->scratchUsed = scratchMarker;
+}
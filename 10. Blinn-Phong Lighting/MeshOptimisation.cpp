@@ -0,0 +1,808 @@
+#include "MeshOptimisation.h"
+
+#include <assert.h>
+#include <math.h> //powf(), sqrtf(), fminf(), fmaxf(), lrintf(), acosf()
+#include <stdlib.h> //malloc(), free(), qsort()
+#include <string.h> //memcpy(), memset()
+
+// Based on Tom Forsyth's "Linear-Speed Vertex Cache Optimisation"
+// https://tomforsyth1000.github.io/papers/fast_vert_cache_opt.html
+
+// Size of the simulated LRU cache used to score vertices. This doesn't
+// need to match the hardware, it just needs to be big enough that
+// vertices stay "warm" for a while after they're used.
+#define VERTEX_CACHE_SIZE 32
+#define VERTEX_CACHE_DECAY_POWER 1.5f
+#define VERTEX_CACHE_LAST_TRI_SCORE 0.75f
+#define VERTEX_VALENCE_BOOST_SCALE 2.0f
+#define VERTEX_VALENCE_BOOST_POWER 0.5f
+
+// Scores are looked up rather than calling powf() for every vertex update
+#define VERTEX_VALENCE_TABLE_SIZE 64
+
+struct VertexScoreTables
+{
+    float cachePositionScores[VERTEX_CACHE_SIZE];
+    float valenceScores[VERTEX_VALENCE_TABLE_SIZE];
+};
+
+static void initVertexScoreTables(VertexScoreTables* tables)
+{
+    for(int i=0; i<VERTEX_CACHE_SIZE; ++i)
+    {
+        if(i < 3) {
+            // Vertices of the last triangle get a fixed score so we don't
+            // favour drawing the same triangle's neighbours in a strip
+            tables->cachePositionScores[i] = VERTEX_CACHE_LAST_TRI_SCORE;
+        }
+        else {
+            float scaler = 1.f / (VERTEX_CACHE_SIZE - 3);
+            tables->cachePositionScores[i] = powf(1.f - (i - 3) * scaler, VERTEX_CACHE_DECAY_POWER);
+        }
+    }
+    // Boost vertices with few triangles left, so we finish them
+    // off rather than leaving lone triangles to be drawn later
+    tables->valenceScores[0] = 0.f;
+    for(int i=1; i<VERTEX_VALENCE_TABLE_SIZE; ++i)
+        tables->valenceScores[i] = VERTEX_VALENCE_BOOST_SCALE * powf((float)i, -VERTEX_VALENCE_BOOST_POWER);
+}
+
+static float vertexScore(const VertexScoreTables* tables, int cachePosition, uint32_t numRemainingTriangles)
+{
+    if(numRemainingTriangles == 0)
+        return -1.f; // Nothing left to draw with this vertex
+
+    float score = (cachePosition >= 0) ? tables->cachePositionScores[cachePosition] : 0.f;
+    if(numRemainingTriangles < VERTEX_VALENCE_TABLE_SIZE)
+        score += tables->valenceScores[numRemainingTriangles];
+    else
+        score += VERTEX_VALENCE_BOOST_SCALE * powf((float)numRemainingTriangles, -VERTEX_VALENCE_BOOST_POWER);
+    return score;
+}
+
+void optimiseVertexCacheIndices(uint32_t* indices, size_t numIndices, size_t numVertices)
+{
+    size_t numTriangles = numIndices / 3;
+    if(numTriangles == 0)
+        return;
+
+    // Build vertex->triangle adjacency
+    uint32_t* numVertexTriangles = (uint32_t*)calloc(numVertices, sizeof(uint32_t));
+    uint32_t* vertexTriangleOffsets = (uint32_t*)malloc(numVertices * sizeof(uint32_t));
+    uint32_t* vertexTriangles = (uint32_t*)malloc(numIndices * sizeof(uint32_t));
+    for(size_t i=0; i<numIndices; ++i)
+        ++numVertexTriangles[indices[i]];
+
+    uint32_t offset = 0;
+    for(size_t v=0; v<numVertices; ++v){
+        vertexTriangleOffsets[v] = offset;
+        offset += numVertexTriangles[v];
+    }
+    // numVertexTriangles doubles as the number of remaining triangles
+    // per vertex, so rebuild it while filling the adjacency lists
+    memset(numVertexTriangles, 0, numVertices * sizeof(uint32_t));
+    for(size_t i=0; i<numIndices; ++i){
+        uint32_t v = indices[i];
+        vertexTriangles[vertexTriangleOffsets[v] + numVertexTriangles[v]++] = (uint32_t)(i / 3);
+    }
+
+    VertexScoreTables scoreTables;
+    initVertexScoreTables(&scoreTables);
+
+    int* vertexCachePositions = (int*)malloc(numVertices * sizeof(int));
+    float* vertexScores = (float*)malloc(numVertices * sizeof(float));
+    for(size_t v=0; v<numVertices; ++v){
+        vertexCachePositions[v] = -1;
+        vertexScores[v] = vertexScore(&scoreTables, -1, numVertexTriangles[v]);
+    }
+
+    float* triangleScores = (float*)malloc(numTriangles * sizeof(float));
+    bool* triangleEmitted = (bool*)calloc(numTriangles, sizeof(bool));
+    for(size_t t=0; t<numTriangles; ++t){
+        triangleScores[t] = vertexScores[indices[3*t]]
+                          + vertexScores[indices[3*t+1]]
+                          + vertexScores[indices[3*t+2]];
+    }
+
+    uint32_t* outIndices = (uint32_t*)malloc(numIndices * sizeof(uint32_t));
+
+    // Cache holds the 3 new vertices at the front while it's being updated
+    uint32_t cache[VERTEX_CACHE_SIZE + 3];
+    uint32_t cacheSize = 0;
+
+    size_t nextUnemittedTriangle = 0;
+    int64_t bestTriangle = -1;
+    for(size_t numEmitted=0; numEmitted<numTriangles; ++numEmitted)
+    {
+        if(bestTriangle < 0)
+        {
+            // Nothing in the cache is connected to an undrawn triangle, so
+            // every remaining triangle scores about the same. Take the next
+            // one in the original order, which keeps this pass linear.
+            while(triangleEmitted[nextUnemittedTriangle])
+                ++nextUnemittedTriangle;
+            bestTriangle = nextUnemittedTriangle;
+        }
+        assert(bestTriangle >= 0);
+
+        const uint32_t* tri = indices + 3*bestTriangle;
+        triangleEmitted[bestTriangle] = true;
+        memcpy(outIndices + 3*numEmitted, tri, 3 * sizeof(uint32_t));
+
+        // Move the triangle's vertices to the front of the cache
+        uint32_t newCache[VERTEX_CACHE_SIZE + 3];
+        uint32_t newCacheSize = 0;
+        for(int k=0; k<3; ++k)
+        {
+            uint32_t v = tri[k];
+            newCache[newCacheSize++] = v;
+
+            // Remove the triangle from the vertex's remaining triangles
+            uint32_t* vTris = vertexTriangles + vertexTriangleOffsets[v];
+            uint32_t numTris = numVertexTriangles[v];
+            for(uint32_t i=0; i<numTris; ++i){
+                if(vTris[i] == (uint32_t)bestTriangle){
+                    vTris[i] = vTris[numTris-1];
+                    break;
+                }
+            }
+            --numVertexTriangles[v];
+        }
+        for(uint32_t i=0; i<cacheSize; ++i)
+        {
+            uint32_t v = cache[i];
+            if(v != tri[0] && v != tri[1] && v != tri[2])
+                newCache[newCacheSize++] = v;
+        }
+
+        // Rescore every vertex that was or still is in the cache,
+        // then rescore all of their remaining triangles
+        for(uint32_t i=0; i<newCacheSize; ++i)
+        {
+            uint32_t v = newCache[i];
+            vertexCachePositions[v] = (i < VERTEX_CACHE_SIZE) ? (int)i : -1;
+        }
+        bestTriangle = -1;
+        float bestScore = -1.f;
+        for(uint32_t i=0; i<newCacheSize; ++i)
+        {
+            uint32_t v = newCache[i];
+            float newScore = vertexScore(&scoreTables, vertexCachePositions[v], numVertexTriangles[v]);
+            float scoreDelta = newScore - vertexScores[v];
+            vertexScores[v] = newScore;
+
+            const uint32_t* vTris = vertexTriangles + vertexTriangleOffsets[v];
+            for(uint32_t j=0; j<numVertexTriangles[v]; ++j)
+            {
+                uint32_t t = vTris[j];
+                triangleScores[t] += scoreDelta;
+                if(triangleScores[t] > bestScore){
+                    bestScore = triangleScores[t];
+                    bestTriangle = t;
+                }
+            }
+        }
+
+        cacheSize = (newCacheSize < VERTEX_CACHE_SIZE) ? newCacheSize : VERTEX_CACHE_SIZE;
+        memcpy(cache, newCache, cacheSize * sizeof(uint32_t));
+    }
+
+    memcpy(indices, outIndices, numIndices * sizeof(uint32_t));
+
+    free(outIndices);
+    free(triangleEmitted);
+    free(triangleScores);
+    free(vertexScores);
+    free(vertexCachePositions);
+    free(vertexTriangles);
+    free(vertexTriangleOffsets);
+    free(numVertexTriangles);
+}
+
+// Copies loadedObj's indices into a new 32-bit array
+static uint32_t* readIndices(const LoadedObj& loadedObj)
+{
+    uint32_t* indices = (uint32_t*)malloc(loadedObj.numIndices * sizeof(uint32_t));
+    assert(indices || loadedObj.numIndices == 0);
+    for(uint32_t i=0; i<loadedObj.numIndices; ++i)
+        indices[i] = getIndex(loadedObj, i);
+    return indices;
+}
+
+// Writes 32-bit 'indices' back into loadedObj's index buffer at its current width
+static void writeIndices(LoadedObj* loadedObj, const uint32_t* indices)
+{
+    if(loadedObj->bytesPerIndex == sizeof(uint16_t)) {
+        uint16_t* indexBuffer = (uint16_t*)loadedObj->indexBuffer;
+        for(uint32_t i=0; i<loadedObj->numIndices; ++i)
+            indexBuffer[i] = (uint16_t)indices[i];
+    }
+    else {
+        memcpy(loadedObj->indexBuffer, indices, loadedObj->numIndices * sizeof(uint32_t));
+    }
+}
+
+void optimiseVertexCache(LoadedObj* loadedObj)
+{
+    assert(!loadedObj->mappedFile);
+
+    // NOTE: Each submesh is optimised on its own so triangles never
+    // move to another material. The padding between them stays put.
+    uint32_t* indices = readIndices(*loadedObj);
+    for(uint32_t s=0; s<loadedObj->numSubmeshes; ++s)
+    {
+        const ObjSubmesh* submesh = loadedObj->submeshes + s;
+        optimiseVertexCacheIndices(indices + submesh->indexOffset[0], submesh->numIndices[0], loadedObj->numVertices);
+    }
+    writeIndices(loadedObj, indices);
+    free(indices);
+}
+
+void optimiseVertexFetch(LoadedObj* loadedObj)
+{
+    assert(!loadedObj->mappedFile);
+
+    // Assign new vertex indices in order of first use
+    uint32_t* remap = (uint32_t*)malloc(loadedObj->numVertices * sizeof(uint32_t));
+    memset(remap, 0xFF, loadedObj->numVertices * sizeof(uint32_t));
+    uint32_t* indices = readIndices(*loadedObj);
+    uint32_t numUsedVertices = 0;
+    for(uint32_t i=0; i<loadedObj->numIndices; ++i)
+    {
+        uint32_t v = indices[i];
+        if(remap[v] == 0xFFFFFFFF)
+            remap[v] = numUsedVertices++;
+        indices[i] = remap[v];
+    }
+    // Vertices no index refers to go at the end
+    for(uint32_t v=0; v<loadedObj->numVertices; ++v){
+        if(remap[v] == 0xFFFFFFFF)
+            remap[v] = numUsedVertices++;
+    }
+
+    VertexData* newVertices = (VertexData*)malloc(loadedObj->numVertices * sizeof(VertexData));
+    for(uint32_t v=0; v<loadedObj->numVertices; ++v)
+        newVertices[remap[v]] = loadedObj->vertexBuffer[v];
+    memcpy(loadedObj->vertexBuffer, newVertices, loadedObj->numVertices * sizeof(VertexData));
+    writeIndices(loadedObj, indices);
+
+    if(loadedObj->tangentBuffer)
+    {
+        VertexTangent* newTangents = (VertexTangent*)malloc(loadedObj->numVertices * sizeof(VertexTangent));
+        for(uint32_t v=0; v<loadedObj->numVertices; ++v)
+            newTangents[remap[v]] = loadedObj->tangentBuffer[v];
+        memcpy(loadedObj->tangentBuffer, newTangents, loadedObj->numVertices * sizeof(VertexTangent));
+        free(newTangents);
+    }
+
+    free(newVertices);
+    free(indices);
+    free(remap);
+}
+
+VertexCacheStats analyseVertexCache(const LoadedObj& loadedObj, uint32_t cacheSize)
+{
+    VertexCacheStats result = {};
+
+    // Simulate a FIFO cache by remembering when each vertex was last
+    // transformed; it's still cached if fewer than cacheSize vertices
+    // have been transformed since then
+    uint32_t* vertexTimestamps = (uint32_t*)calloc(loadedObj.numVertices, sizeof(uint32_t));
+    uint32_t timestamp = cacheSize + 1;
+    for(uint32_t i=0; i<loadedObj.numIndices; ++i)
+    {
+        uint32_t v = getIndex(loadedObj, i);
+        if(timestamp - vertexTimestamps[v] > cacheSize)
+        {
+            vertexTimestamps[v] = timestamp++;
+            ++result.numVertexShaderInvocations;
+        }
+    }
+    free(vertexTimestamps);
+
+    uint32_t numTriangles = loadedObj.numIndices / 3;
+    result.acmr = numTriangles ? (float)result.numVertexShaderInvocations / numTriangles : 0.f;
+    result.atvr = loadedObj.numVertices ? (float)result.numVertexShaderInvocations / loadedObj.numVertices : 0.f;
+    return result;
+}
+
+// Overdraw optimisation is based on "Fast Triangle Reordering for Vertex
+// Locality and Reduced Overdraw" by Sander, Nehab and Barczak (2007),
+// following the approach taken by meshoptimizer's optimizeOverdraw()
+
+#define OVERDRAW_CACHE_SIZE 16
+
+// Simulated FIFO cache, see analyseVertexCache()
+struct FifoCacheSimulation
+{
+    uint32_t* vertexTimestamps;
+    uint32_t timestamp;
+};
+
+static void resetFifoCache(FifoCacheSimulation* cache)
+{
+    // Every vertex now looks like it was used too long ago to still be cached
+    cache->timestamp += OVERDRAW_CACHE_SIZE + 1;
+}
+
+static uint32_t countTriangleCacheMisses(FifoCacheSimulation* cache, const uint32_t* tri)
+{
+    uint32_t numMisses = 0;
+    for(int k=0; k<3; ++k)
+    {
+        uint32_t v = tri[k];
+        if(cache->timestamp - cache->vertexTimestamps[v] > OVERDRAW_CACHE_SIZE)
+        {
+            cache->vertexTimestamps[v] = cache->timestamp++;
+            ++numMisses;
+        }
+    }
+    return numMisses;
+}
+
+struct TriangleCluster
+{
+    uint32_t firstTriangle;
+    uint32_t numTriangles;
+    float sortKey;
+};
+
+static int compareClustersDescending(const void* a, const void* b)
+{
+    float keyA = ((const TriangleCluster*)a)->sortKey;
+    float keyB = ((const TriangleCluster*)b)->sortKey;
+    return (keyA < keyB) - (keyA > keyB);
+}
+
+// Reorders the triangles in 'indices' in place, see optimiseOverdraw()
+static void optimiseOverdrawIndices(uint32_t* indices, uint32_t numIndices, 
+                                    const VertexData* vertices, uint32_t numVertices, float threshold)
+{
+    uint32_t numTriangles = numIndices / 3;
+    if(numTriangles == 0)
+        return;
+
+    FifoCacheSimulation cache = {};
+    cache.vertexTimestamps = (uint32_t*)calloc(numVertices, sizeof(uint32_t));
+    cache.timestamp = OVERDRAW_CACHE_SIZE + 1;
+
+    // Hard boundaries: split wherever the vertex cache order already
+    // starts from scratch, since reordering there costs nothing
+    uint32_t* hardBoundaries = (uint32_t*)malloc((numTriangles + 1) * sizeof(uint32_t));
+    uint32_t numHardClusters = 0;
+    for(uint32_t t=0; t<numTriangles; ++t)
+    {
+        if(countTriangleCacheMisses(&cache, indices + 3*t) == 3 || t == 0)
+            hardBoundaries[numHardClusters++] = t;
+    }
+    hardBoundaries[numHardClusters] = numTriangles;
+
+    // Soft boundaries: split hard clusters further wherever the cache
+    // has warmed up enough that the cluster's ACMR would only get
+    // worse by 'threshold' from restarting there
+    TriangleCluster* clusters = (TriangleCluster*)malloc(numTriangles * sizeof(TriangleCluster));
+    uint32_t numClusters = 0;
+    for(uint32_t h=0; h<numHardClusters; ++h)
+    {
+        uint32_t start = hardBoundaries[h];
+        uint32_t end = hardBoundaries[h+1];
+
+        resetFifoCache(&cache);
+        uint32_t numClusterMisses = 0;
+        for(uint32_t t=start; t<end; ++t)
+            numClusterMisses += countTriangleCacheMisses(&cache, indices + 3*t);
+        float clusterThreshold = threshold * (float)numClusterMisses / (float)(end - start);
+
+        resetFifoCache(&cache);
+        uint32_t numRunningMisses = 0;
+        uint32_t clusterStart = start;
+        for(uint32_t t=start; t<end; ++t)
+        {
+            numRunningMisses += countTriangleCacheMisses(&cache, indices + 3*t);
+            bool isLast = (t + 1 == end);
+            if(isLast || (float)numRunningMisses / (float)(t - clusterStart + 1) <= clusterThreshold)
+            {
+                clusters[numClusters].firstTriangle = clusterStart;
+                clusters[numClusters].numTriangles = t + 1 - clusterStart;
+                ++numClusters;
+
+                resetFifoCache(&cache);
+                numRunningMisses = 0;
+                clusterStart = t + 1;
+            }
+        }
+    }
+    free(hardBoundaries);
+    free(cache.vertexTimestamps);
+
+    // Find each cluster's area-weighted centroid and normal
+    float (*clusterCentroids)[3] = (float(*)[3])calloc(numClusters, sizeof(float[3]));
+    float (*clusterNormals)[3] = (float(*)[3])calloc(numClusters, sizeof(float[3]));
+    float meshCentroid[3] = {};
+    float meshArea = 0.f;
+    for(uint32_t c=0; c<numClusters; ++c)
+    {
+        float clusterArea = 0.f;
+        for(uint32_t t=clusters[c].firstTriangle; t<clusters[c].firstTriangle + clusters[c].numTriangles; ++t)
+        {
+            const float* p0 = vertices[indices[3*t]].pos;
+            const float* p1 = vertices[indices[3*t+1]].pos;
+            const float* p2 = vertices[indices[3*t+2]].pos;
+            float e1[3] = {p1[0] - p0[0], p1[1] - p0[1], p1[2] - p0[2]};
+            float e2[3] = {p2[0] - p0[0], p2[1] - p0[1], p2[2] - p0[2]};
+            float n[3] = {e1[1]*e2[2] - e1[2]*e2[1], e1[2]*e2[0] - e1[0]*e2[2], e1[0]*e2[1] - e1[1]*e2[0]};
+            float area = sqrtf(n[0]*n[0] + n[1]*n[1] + n[2]*n[2]);
+
+            for(int i=0; i<3; ++i)
+            {
+                clusterCentroids[c][i] += area * (p0[i] + p1[i] + p2[i]) * (1.f / 3.f);
+                clusterNormals[c][i] += n[i];
+            }
+            clusterArea += area;
+        }
+        for(int i=0; i<3; ++i)
+        {
+            meshCentroid[i] += clusterCentroids[c][i];
+            clusterCentroids[c][i] /= (clusterArea > 0.f) ? clusterArea : 1.f;
+        }
+        meshArea += clusterArea;
+    }
+    for(int i=0; i<3; ++i)
+        meshCentroid[i] /= (meshArea > 0.f) ? meshArea : 1.f;
+
+    // Clusters facing away from the middle of the mesh are likely to
+    // occlude the rest of it, so draw them first
+    for(uint32_t c=0; c<numClusters; ++c)
+    {
+        const float* n = clusterNormals[c];
+        float nLength = sqrtf(n[0]*n[0] + n[1]*n[1] + n[2]*n[2]);
+        float invNLength = (nLength > 0.f) ? 1.f / nLength : 0.f;
+        clusters[c].sortKey = ((clusterCentroids[c][0] - meshCentroid[0]) * n[0]
+                            + (clusterCentroids[c][1] - meshCentroid[1]) * n[1]
+                            + (clusterCentroids[c][2] - meshCentroid[2]) * n[2]) * invNLength;
+    }
+    qsort(clusters, numClusters, sizeof(TriangleCluster), compareClustersDescending);
+
+    uint32_t* newIndices = (uint32_t*)malloc(numIndices * sizeof(uint32_t));
+    uint32_t numNewIndices = 0;
+    for(uint32_t c=0; c<numClusters; ++c)
+    {
+        uint32_t numClusterIndices = 3 * clusters[c].numTriangles;
+        memcpy(newIndices + numNewIndices, indices + 3*clusters[c].firstTriangle, numClusterIndices * sizeof(uint32_t));
+        numNewIndices += numClusterIndices;
+    }
+    memcpy(indices, newIndices, numNewIndices * sizeof(uint32_t));
+
+    free(newIndices);
+    free(clusterNormals);
+    free(clusterCentroids);
+    free(clusters);
+}
+
+void optimiseOverdraw(LoadedObj* loadedObj, float threshold)
+{
+    assert(!loadedObj->mappedFile);
+
+    uint32_t* indices = readIndices(*loadedObj);
+    for(uint32_t s=0; s<loadedObj->numSubmeshes; ++s)
+    {
+        const ObjSubmesh* submesh = loadedObj->submeshes + s;
+        optimiseOverdrawIndices(indices + submesh->indexOffset[0], submesh->numIndices[0],
+                                loadedObj->vertexBuffer, loadedObj->numVertices, threshold);
+    }
+    writeIndices(loadedObj, indices);
+    free(indices);
+}
+
+// Rasterises a triangle with vertices in pixel coordinates plus depth,
+// with a less-than depth test. Back-facing (clockwise) triangles are culled.
+static void rasteriseTriangleDepth(float* depthBuffer, uint32_t resolution, 
+                                   const float* v0, const float* v1, const float* v2,
+                                   OverdrawStats* stats)
+{
+    float area = (v1[0] - v0[0]) * (v2[1] - v0[1]) - (v1[1] - v0[1]) * (v2[0] - v0[0]);
+    if(area <= 0.f)
+        return;
+    float invArea = 1.f / area;
+
+    float minX = fminf(v0[0], fminf(v1[0], v2[0]));
+    float maxX = fmaxf(v0[0], fmaxf(v1[0], v2[0]));
+    float minY = fminf(v0[1], fminf(v1[1], v2[1]));
+    float maxY = fmaxf(v0[1], fmaxf(v1[1], v2[1]));
+    int x0 = (int)fmaxf(0.f, floorf(minX));
+    int x1 = (int)fminf((float)resolution - 1, ceilf(maxX));
+    int y0 = (int)fmaxf(0.f, floorf(minY));
+    int y1 = (int)fminf((float)resolution - 1, ceilf(maxY));
+
+    for(int y=y0; y<=y1; ++y)
+    {
+        for(int x=x0; x<=x1; ++x)
+        {
+            // Sample at pixel centres
+            float px = x + 0.5f;
+            float py = y + 0.5f;
+            float w0 = (v2[0] - v1[0]) * (py - v1[1]) - (v2[1] - v1[1]) * (px - v1[0]);
+            float w1 = (v0[0] - v2[0]) * (py - v2[1]) - (v0[1] - v2[1]) * (px - v2[0]);
+            float w2 = (v1[0] - v0[0]) * (py - v0[1]) - (v1[1] - v0[1]) * (px - v0[0]);
+            if(w0 < 0.f || w1 < 0.f || w2 < 0.f)
+                continue;
+
+            float depth = (w0 * v0[2] + w1 * v1[2] + w2 * v2[2]) * invArea;
+            float* pixelDepth = depthBuffer + y * resolution + x;
+            if(depth < *pixelDepth)
+            {
+                *pixelDepth = depth;
+                ++stats->numPixelsShaded;
+            }
+        }
+    }
+}
+
+OverdrawStats analyseOverdraw(const LoadedObj& loadedObj, uint32_t resolution)
+{
+    // Look at the mesh from along each axis and each diagonal
+    const float D = 0.57735027f; // 1 / sqrt(3)
+    static const float viewDirs[][3] = {
+        {1, 0, 0}, {-1, 0, 0}, {0, 1, 0}, {0, -1, 0}, {0, 0, 1}, {0, 0, -1},
+        {D, D, D}, {D, D, -D}, {D, -D, D}, {D, -D, -D},
+        {-D, D, D}, {-D, D, -D}, {-D, -D, D}, {-D, -D, -D}
+    };
+    const int numViews = sizeof(viewDirs) / sizeof(viewDirs[0]);
+
+    OverdrawStats result = {};
+    if(loadedObj.numVertices == 0)
+        return result;
+
+    float* depthBuffer = (float*)malloc(resolution * resolution * sizeof(float));
+    float (*projected)[3] = (float(*)[3])malloc(loadedObj.numVertices * sizeof(float[3]));
+
+    for(int view=0; view<numViews; ++view)
+    {
+        // Orthographic camera looking along 'forward', with screen 
+        // axes chosen so counter-clockwise triangles face the camera
+        const float* forward = viewDirs[view];
+        float up[3] = {0, 1, 0};
+        if(fabsf(forward[1]) > 0.99f) {
+            up[1] = 0; 
+            up[2] = 1;
+        }
+        float right[3] = {forward[1]*up[2] - forward[2]*up[1], 
+                          forward[2]*up[0] - forward[0]*up[2], 
+                          forward[0]*up[1] - forward[1]*up[0]};
+        float rightLength = sqrtf(right[0]*right[0] + right[1]*right[1] + right[2]*right[2]);
+        for(int i=0; i<3; ++i) right[i] /= rightLength;
+        float screenUp[3] = {right[1]*forward[2] - right[2]*forward[1],
+                             right[2]*forward[0] - right[0]*forward[2],
+                             right[0]*forward[1] - right[1]*forward[0]};
+
+        float minX = INFINITY, minY = INFINITY, maxX = -INFINITY, maxY = -INFINITY;
+        for(uint32_t v=0; v<loadedObj.numVertices; ++v)
+        {
+            const float* p = loadedObj.vertexBuffer[v].pos;
+            projected[v][0] = p[0]*right[0] + p[1]*right[1] + p[2]*right[2];
+            projected[v][1] = p[0]*screenUp[0] + p[1]*screenUp[1] + p[2]*screenUp[2];
+            projected[v][2] = p[0]*forward[0] + p[1]*forward[1] + p[2]*forward[2];
+            minX = fminf(minX, projected[v][0]);
+            maxX = fmaxf(maxX, projected[v][0]);
+            minY = fminf(minY, projected[v][1]);
+            maxY = fmaxf(maxY, projected[v][1]);
+        }
+
+        // Fit the mesh to the viewport, keeping its aspect ratio
+        float extent = fmaxf(maxX - minX, maxY - minY);
+        float scale = (extent > 0.f) ? resolution / extent : 0.f;
+        for(uint32_t v=0; v<loadedObj.numVertices; ++v)
+        {
+            projected[v][0] = (projected[v][0] - minX) * scale;
+            projected[v][1] = (projected[v][1] - minY) * scale;
+        }
+
+        for(uint32_t i=0; i<resolution * resolution; ++i)
+            depthBuffer[i] = INFINITY;
+
+        for(uint32_t i=0; i+2<loadedObj.numIndices; i+=3)
+        {
+            rasteriseTriangleDepth(depthBuffer, resolution,
+                                   projected[getIndex(loadedObj, i)],
+                                   projected[getIndex(loadedObj, i+1)],
+                                   projected[getIndex(loadedObj, i+2)],
+                                   &result);
+        }
+
+        for(uint32_t i=0; i<resolution * resolution; ++i)
+            result.numPixelsCovered += (depthBuffer[i] != INFINITY);
+    }
+
+    free(projected);
+    free(depthBuffer);
+
+    result.overdraw = result.numPixelsCovered ? (float)result.numPixelsShaded / result.numPixelsCovered : 0.f;
+    return result;
+}
+
+static uint16_t packHalf(float f)
+{
+    uint32_t bits;
+    memcpy(&bits, &f, sizeof(bits));
+    uint16_t sign = (bits >> 16) & 0x8000;
+    uint32_t absBits = bits & 0x7FFFFFFF;
+
+    if(absBits >= 0x7F800000) // Infinity or NaN
+        return sign | ((absBits > 0x7F800000) ? 0x7E00 : 0x7C00);
+    if(absBits >= 0x477FF000) // Rounds to a value too big for a half
+        return sign | 0x7C00;
+    if(absBits < 0x38800000) 
+    {
+        // Too small for a normal half, round to a multiple of the
+        // smallest subnormal (2^-24). Rounding up to 0x400 correctly
+        // gives the smallest normal half.
+        float absF;
+        memcpy(&absF, &absBits, sizeof(absF));
+        return sign | (uint16_t)lrintf(absF * 16777216.f);
+    }
+
+    // Rebias the exponent from 127 to 15 and round the mantissa
+    // from 23 to 10 bits, with ties going to even
+    uint32_t h = (absBits - 0x38000000) >> 13;
+    uint32_t remainder = absBits & 0x1FFF;
+    if(remainder > 0x1000 || (remainder == 0x1000 && (h & 1)))
+        ++h;
+    return sign | (uint16_t)h;
+}
+
+float unpackHalf(uint16_t h)
+{
+    uint32_t sign = (uint32_t)(h & 0x8000) << 16;
+    uint32_t exponent = (h >> 10) & 0x1F;
+    uint32_t mantissa = h & 0x3FF;
+
+    float result;
+    if(exponent == 0) {
+        result = mantissa * (1.f / 16777216.f);
+        return (sign ? -result : result);
+    }
+
+    uint32_t bits;
+    if(exponent == 31)
+        bits = sign | 0x7F800000 | (mantissa << 13);
+    else
+        bits = sign | ((exponent + 112) << 23) | (mantissa << 13);
+    memcpy(&result, &bits, sizeof(result));
+    return result;
+}
+
+static int16_t packSnorm16(float f)
+{
+    f = fmaxf(-1.f, fminf(1.f, f));
+    return (int16_t)lrintf(f * 32767.f);
+}
+
+static float unpackSnorm16(int16_t i)
+{
+    // Matches Metal's conversion rules for normalised integers
+    return fmaxf(i * (1.f / 32767.f), -1.f);
+}
+
+// Octahedral normal encoding, see "A Survey of Efficient Representations
+// for Independent Unit Vectors" by Cigolle et al. (2014)
+static void packOctahedralNormal(const float normal[3], int16_t outPacked[2])
+{
+    float l1Norm = fabsf(normal[0]) + fabsf(normal[1]) + fabsf(normal[2]);
+    if(l1Norm == 0.f) {
+        outPacked[0] = outPacked[1] = 0;
+        return;
+    }
+
+    // Project onto the octahedron |x| + |y| + |z| = 1, then fold
+    // the bottom half over the top half so it fits in a square
+    float x = normal[0] / l1Norm;
+    float y = normal[1] / l1Norm;
+    if(normal[2] < 0.f)
+    {
+        float foldedX = (1.f - fabsf(y)) * ((x >= 0.f) ? 1.f : -1.f);
+        float foldedY = (1.f - fabsf(x)) * ((y >= 0.f) ? 1.f : -1.f);
+        x = foldedX;
+        y = foldedY;
+    }
+    outPacked[0] = packSnorm16(x);
+    outPacked[1] = packSnorm16(y);
+}
+
+void unpackOctahedralNormal(const int16_t packed[2], float outNormal[3])
+{
+    float x = unpackSnorm16(packed[0]);
+    float y = unpackSnorm16(packed[1]);
+    float z = 1.f - fabsf(x) - fabsf(y);
+    // Unfold the bottom half of the octahedron
+    float t = fmaxf(-z, 0.f);
+    x += (x >= 0.f) ? -t : t;
+    y += (y >= 0.f) ? -t : t;
+
+    float length = sqrtf(x*x + y*y + z*z);
+    outNormal[0] = x / length;
+    outNormal[1] = y / length;
+    outNormal[2] = z / length;
+}
+
+void packVertices(LoadedObj* loadedObj)
+{
+    assert(!loadedObj->mappedFile);
+
+    // Positions are stored relative to the mesh's bounding box
+    const float* boundsMin = loadedObj->boundsMin;
+    const float* boundsMax = loadedObj->boundsMax;
+    float posQuantiseScale[3];
+    for(int i=0; i<3; ++i)
+    {
+        float extent = boundsMax[i] - boundsMin[i];
+        loadedObj->packedPosOffset[i] = boundsMin[i];
+        loadedObj->packedPosScale[i] = extent;
+        posQuantiseScale[i] = (extent > 0.f) ? 65535.f / extent : 0.f;
+    }
+
+    free(loadedObj->packedVertexBuffer);
+    loadedObj->packedVertexBuffer = (PackedVertexData*)malloc(loadedObj->numVertices * sizeof(PackedVertexData));
+    for(uint32_t v=0; v<loadedObj->numVertices; ++v)
+    {
+        const VertexData* in = loadedObj->vertexBuffer + v;
+        PackedVertexData* out = loadedObj->packedVertexBuffer + v;
+        for(int i=0; i<3; ++i)
+        {
+            float q = (in->pos[i] - boundsMin[i]) * posQuantiseScale[i];
+            out->pos[i] = (uint16_t)lrintf(fmaxf(0.f, fminf(65535.f, q)));
+        }
+        out->pos[3] = 0;
+        out->uv[0] = packHalf(in->uv[0]);
+        out->uv[1] = packHalf(in->uv[1]);
+        packOctahedralNormal(in->norm, out->norm);
+    }
+}
+
+PackedVertexError analysePackedVertexError(const LoadedObj& loadedObj)
+{
+    PackedVertexError result = {};
+    if(!loadedObj.packedVertexBuffer || loadedObj.numVertices == 0)
+        return result;
+
+    double posErrorSum = 0, uvErrorSum = 0, normalErrorSum = 0;
+    for(uint32_t v=0; v<loadedObj.numVertices; ++v)
+    {
+        const VertexData* original = loadedObj.vertexBuffer + v;
+        const PackedVertexData* packed = loadedObj.packedVertexBuffer + v;
+
+        float posErrorSq = 0.f;
+        for(int i=0; i<3; ++i)
+        {
+            float p = loadedObj.packedPosOffset[i] + (packed->pos[i] / 65535.f) * loadedObj.packedPosScale[i];
+            posErrorSq += (p - original->pos[i]) * (p - original->pos[i]);
+        }
+        float posError = sqrtf(posErrorSq);
+
+        float uvError = fmaxf(fabsf(unpackHalf(packed->uv[0]) - original->uv[0]),
+                              fabsf(unpackHalf(packed->uv[1]) - original->uv[1]));
+
+        // NOTE: Meshes without normals have zero-length ones, which
+        // don't have a meaningful angle to compare against
+        float normalError = 0.f;
+        const float* o = original->norm;
+        float originalLength = sqrtf(o[0]*o[0] + o[1]*o[1] + o[2]*o[2]);
+        if(originalLength > 0.f)
+        {
+            float n[3];
+            unpackOctahedralNormal(packed->norm, n);
+            float cosAngle = (n[0]*o[0] + n[1]*o[1] + n[2]*o[2]) / originalLength;
+            normalError = acosf(fmaxf(-1.f, fminf(1.f, cosAngle))) * (180.f / (float)M_PI);
+        }
+
+        result.maxPosError = fmaxf(result.maxPosError, posError);
+        result.maxUvError = fmaxf(result.maxUvError, uvError);
+        result.maxNormalErrorDegrees = fmaxf(result.maxNormalErrorDegrees, normalError);
+        posErrorSum += posError;
+        uvErrorSum += uvError;
+        normalErrorSum += normalError;
+    }
+    result.avgPosError = (float)(posErrorSum / loadedObj.numVertices);
+    result.avgUvError = (float)(uvErrorSum / loadedObj.numVertices);
+    result.avgNormalErrorDegrees = (float)(normalErrorSum / loadedObj.numVertices);
+    return result;
+}
@@ -0,0 +1,88 @@
+#pragma once
+
+#include "ObjLoading.h"
+
+// Optional processing passes that reorder a LoadedObj's buffers so
+// the GPU can draw it more efficiently. None of them change how the
+// mesh looks. They can't be used on meshes mapped from a mesh cache,
+// use the matching ObjLoadFlags to bake the results into the cache.
+// Triangles are only reordered within each submesh, so they keep
+// their materials and the submeshes' index ranges stay valid.
+
+// Reorders triangles so vertices are reused while they're still in the
+// GPU's post-transform cache, using Tom Forsyth's "Linear-Speed Vertex
+// Cache Optimisation" algorithm.
+void optimiseVertexCache(LoadedObj* loadedObj);
+// Same as optimiseVertexCache(), but reorders the triangles
+// of a standalone 32-bit index array in place
+void optimiseVertexCacheIndices(uint32_t* indices, size_t numIndices, size_t numVertices);
+
+// Reorders triangles to reduce overdraw, without undoing much of
+// optimiseVertexCache()'s work. The index buffer is split into clusters
+// wherever the vertex cache would be restarting anyway, or where doing so
+// only makes ACMR worse by up to 'threshold' (1.05 = 5% worse). Clusters
+// facing away from the centre of the mesh are drawn first, since they're
+// likely to occlude the rest. Run this after optimiseVertexCache().
+void optimiseOverdraw(LoadedObj* loadedObj, float threshold = 1.05f);
+
+// Reorders the vertex buffer, and the tangent buffer if there is one, into the
+// order the index buffer first references each vertex, so vertex fetches walk
+// memory linearly.
+// Run this after optimiseVertexCache() and optimiseOverdraw().
+void optimiseVertexFetch(LoadedObj* loadedObj);
+
+struct VertexCacheStats
+{
+    // Number of times the vertex shader would run with a FIFO
+    // post-transform cache of the size passed to analyseVertexCache()
+    uint32_t numVertexShaderInvocations;
+    // Average cache miss ratio: invocations per triangle.
+    // 3.0 is the worst case, 0.5 is the best possible for large grids.
+    float acmr;
+    // Average transform to vertex ratio: invocations per vertex.
+    // 1.0 is the best possible.
+    float atvr;
+};
+
+// Simulates the post-transform vertex cache to measure how well
+// loadedObj's index buffer reuses transformed vertices
+VertexCacheStats analyseVertexCache(const LoadedObj& loadedObj, uint32_t cacheSize = 16);
+
+struct OverdrawStats
+{
+    uint64_t numPixelsCovered;
+    // Pixels that passed the depth test when they were drawn,
+    // i.e. the number of times the fragment shader would run
+    uint64_t numPixelsShaded;
+    // Shaded per covered pixel, 1.0 means no overdraw at all
+    float overdraw;
+};
+
+// Measures overdraw without a GPU by rasterising loadedObj in its current
+// triangle order from 14 orthographic viewpoints around it, each into a
+// 'resolution' x 'resolution' depth buffer. Back faces are culled.
+OverdrawStats analyseOverdraw(const LoadedObj& loadedObj, uint32_t resolution = 256);
+
+// Fills in loadedObj's packedVertexBuffer from its vertexBuffer, halving the
+// size of each vertex (see PackedVertexData). Any pass that reorders the
+// vertex buffer must run before this.
+void packVertices(LoadedObj* loadedObj);
+
+// Decodes PackedVertexData components the same way the GPU does
+float unpackHalf(uint16_t h);
+void unpackOctahedralNormal(const int16_t packed[2], float outNormal[3]);
+
+struct PackedVertexError
+{
+    // In the same units as the mesh
+    float maxPosError;
+    float avgPosError;
+    float maxUvError;
+    float avgUvError;
+    // Angle between original and decoded normals
+    float maxNormalErrorDegrees;
+    float avgNormalErrorDegrees;
+};
+
+// Measures how far loadedObj's packed vertices are from the originals
+PackedVertexError analysePackedVertexError(const LoadedObj& loadedObj);
@@ -0,0 +1,615 @@
+#include "MeshSimplification.h"
+#include "MeshOptimisation.h"
+
+#include <assert.h>
+#include <float.h> //FLT_MAX
+#include <math.h> //sqrtf(), fabsf(), fmaxf()
+#include <stdlib.h> //malloc(), calloc(), free(), qsort()
+#include <string.h> //memcpy(), memcmp(), memset()
+
+// Based on "Simplifying Surfaces with Color and Texture using Quadric Error
+// Metrics" by Michael Garland and Paul Heckbert (1998), with the pass
+// structure used by meshopt_simplify() in Arseny Kapoulkine's meshoptimizer
+
+// Weights of uvs and normals relative to positions, which are normalised
+// to fit the mesh in a unit cube. Higher weights preserve the attributes
+// better at the expense of the shape.
+#define SIMPLIFY_UV_WEIGHT 1.f
+#define SIMPLIFY_NORMAL_WEIGHT 0.5f
+
+// Each vertex is treated as a point in 8D: position, uv and normal
+#define QUADRIC_MAX_DIM 8
+#define QUADRIC_MAX_A_SIZE (QUADRIC_MAX_DIM * (QUADRIC_MAX_DIM + 1) / 2)
+#define QUADRIC_POSITION_DIM 3
+
+#define SIMPLIFY_NO_VERTEX 0xFFFFFFFF
+
+// Each LOD aims for this fraction of the previous LOD's triangles
+#define LOD_TRIANGLE_RATIO 0.5f
+// Stop making LODs once simplification can't get this far towards the target
+#define LOD_MIN_REDUCTION 0.85f
+#define LOD_MIN_TRIANGLES 8
+
+// Sum of area-weighted squared distances to a set of triangles' planes,
+// evaluated at v as: vT*A*v + 2*bT*v + c
+struct Quadric
+{
+    // Symmetric, so only the upper triangle is stored, row by row
+    float a[QUADRIC_MAX_A_SIZE];
+    float b[QUADRIC_MAX_DIM];
+    float c;
+    // Total area of the triangles, used to turn the sum into an average
+    float weight;
+};
+
+static float dot(const float* a, const float* b, int dim)
+{
+    float result = 0.f;
+    for(int i=0; i<dim; ++i)
+        result += a[i] * b[i];
+    return result;
+}
+
+static void triangleNormal(const float* p0, const float* p1, const float* p2, float* outNormal)
+{
+    float d1[3] = {p1[0]-p0[0], p1[1]-p0[1], p1[2]-p0[2]};
+    float d2[3] = {p2[0]-p0[0], p2[1]-p0[1], p2[2]-p0[2]};
+    outNormal[0] = d1[1]*d2[2] - d1[2]*d2[1];
+    outNormal[1] = d1[2]*d2[0] - d1[0]*d2[2];
+    outNormal[2] = d1[0]*d2[1] - d1[1]*d2[0];
+}
+
+// Adds a triangle's plane in position space: A = n*nT, b = d*n, c = d^2
+// NOTE: Unlike the general form below this is exact for flat regions,
+// which matters since it's used to report how far the surface moved
+static void addTrianglePlaneToQuadric(Quadric* q, const float* p0, const float* p1, const float* p2)
+{
+    float n[3];
+    triangleNormal(p0, p1, p2, n);
+    float nLength = sqrtf(dot(n, n, 3));
+    if(nLength == 0.f)
+        return;
+    for(int i=0; i<3; ++i)
+        n[i] /= nLength;
+    float d = -dot(n, p0, 3);
+    float area = 0.5f * nLength;
+
+    int k = 0;
+    for(int i=0; i<3; ++i)
+    {
+        for(int j=i; j<3; ++j)
+            q->a[k++] += area * n[i]*n[j];
+        q->b[i] += area * d*n[i];
+    }
+    q->c += area * d*d;
+    q->weight += area;
+}
+
+// Adds a triangle with vertices in 'dim' dimensions, as described in
+// section 4 of Garland & Heckbert's paper
+static void addTriangleToQuadric(Quadric* q, const float* p0, const float* p1, const float* p2, int dim)
+{
+    // Orthonormal basis e1, e2 of the triangle's plane
+    float e1[QUADRIC_MAX_DIM], e2[QUADRIC_MAX_DIM];
+    for(int i=0; i<dim; ++i) {
+        e1[i] = p1[i] - p0[i];
+        e2[i] = p2[i] - p0[i];
+    }
+    float e1Length = sqrtf(dot(e1, e1, dim));
+    if(e1Length == 0.f)
+        return;
+    for(int i=0; i<dim; ++i)
+        e1[i] /= e1Length;
+    float e2DotE1 = dot(e2, e1, dim);
+    for(int i=0; i<dim; ++i)
+        e2[i] -= e2DotE1 * e1[i];
+    float e2Length = sqrtf(dot(e2, e2, dim));
+    if(e2Length == 0.f)
+        return;
+    for(int i=0; i<dim; ++i)
+        e2[i] /= e2Length;
+
+    // NOTE: Weight by the triangle's area in position space, so big
+    // triangles matter more than small ones however they're attributed
+    float n[3];
+    triangleNormal(p0, p1, p2, n);
+    float area = 0.5f * sqrtf(dot(n, n, 3));
+
+    // A = I - e1*e1T - e2*e2T
+    // b = (p0.e1)*e1 + (p0.e2)*e2 - p0
+    // c = p0.p0 - (p0.e1)^2 - (p0.e2)^2
+    float p0DotE1 = dot(p0, e1, dim);
+    float p0DotE2 = dot(p0, e2, dim);
+    int k = 0;
+    for(int i=0; i<dim; ++i)
+    {
+        for(int j=i; j<dim; ++j)
+            q->a[k++] += area * ((i == j ? 1.f : 0.f) - e1[i]*e1[j] - e2[i]*e2[j]);
+        q->b[i] += area * (p0DotE1*e1[i] + p0DotE2*e2[i] - p0[i]);
+    }
+    q->c += area * (dot(p0, p0, dim) - p0DotE1*p0DotE1 - p0DotE2*p0DotE2);
+    q->weight += area;
+}
+
+static void addQuadric(Quadric* q, const Quadric& other)
+{
+    for(int i=0; i<QUADRIC_MAX_A_SIZE; ++i)
+        q->a[i] += other.a[i];
+    for(int i=0; i<QUADRIC_MAX_DIM; ++i)
+        q->b[i] += other.b[i];
+    q->c += other.c;
+    q->weight += other.weight;
+}
+
+// Returns the average squared distance from v to the quadric's planes
+static float evaluateQuadric(const Quadric& q, const float* v, int dim)
+{
+    float result = q.c;
+    int k = 0;
+    for(int i=0; i<dim; ++i)
+    {
+        result += 2.f * q.b[i] * v[i];
+        result += q.a[k++] * v[i] * v[i];
+        for(int j=i+1; j<dim; ++j)
+            result += 2.f * q.a[k++] * v[i] * v[j];
+    }
+    // NOTE: Can come out slightly negative due to rounding
+    return (q.weight > 0.f) ? fmaxf(result, 0.f) / q.weight : 0.f;
+}
+
+static uint32_t hashPosition(const float* pos)
+{
+    uint32_t bits[3];
+    memcpy(bits, pos, sizeof(bits));
+    return (bits[0] * 73856093) ^ (bits[1] * 19349663) ^ (bits[2] * 83492791);
+}
+
+// Sets positionIds[v] to the lowest index of a vertex with the same position
+// as v, so vertices split by uv or normal seams can be treated as one
+static void findPositionIds(const VertexData* vertices, uint32_t numVertices, uint32_t* positionIds)
+{
+    uint32_t tableSize = 1;
+    while(tableSize < 2*numVertices)
+        tableSize *= 2;
+    uint32_t* table = (uint32_t*)malloc(tableSize * sizeof(uint32_t));
+    memset(table, 0xFF, tableSize * sizeof(uint32_t));
+
+    for(uint32_t v=0; v<numVertices; ++v)
+    {
+        const float* pos = vertices[v].pos;
+        uint32_t slot = hashPosition(pos) & (tableSize - 1);
+        while(table[slot] != SIMPLIFY_NO_VERTEX && memcmp(vertices[table[slot]].pos, pos, sizeof(vertices[v].pos)) != 0)
+            slot = (slot + 1) & (tableSize - 1);
+
+        if(table[slot] == SIMPLIFY_NO_VERTEX)
+            table[slot] = v;
+        positionIds[v] = table[slot];
+    }
+    free(table);
+}
+
+static int compareUint64(const void* a, const void* b)
+{
+    uint64_t x = *(const uint64_t*)a;
+    uint64_t y = *(const uint64_t*)b;
+    return (x < y) ? -1 : (x > y);
+}
+
+// Locks vertices whose neighbourhood can't be collapsed without tearing
+// or distorting the mesh: those with several vertices at the same position
+// (uv or normal seams), and those on edges that don't have exactly two
+// triangles (open borders and non-manifold edges)
+static void findLockedPositions(const uint32_t* indices, uint32_t numIndices, const uint32_t* positionIds,
+                                uint32_t numVertices, bool* isLocked)
+{
+    uint32_t* firstVertexAtPosition = (uint32_t*)malloc(numVertices * sizeof(uint32_t));
+    memset(firstVertexAtPosition, 0xFF, numVertices * sizeof(uint32_t));
+    for(uint32_t i=0; i<numIndices; ++i)
+    {
+        uint32_t v = indices[i];
+        uint32_t p = positionIds[v];
+        if(firstVertexAtPosition[p] == SIMPLIFY_NO_VERTEX)
+            firstVertexAtPosition[p] = v;
+        else if(firstVertexAtPosition[p] != v)
+            isLocked[p] = true;
+    }
+    free(firstVertexAtPosition);
+
+    // Count each edge's triangles by sorting the edges
+    uint64_t* edges = (uint64_t*)malloc(numIndices * sizeof(uint64_t));
+    uint32_t numEdges = 0;
+    for(uint32_t i=0; i<numIndices; i+=3)
+    {
+        for(int k=0; k<3; ++k)
+        {
+            uint32_t a = positionIds[indices[i + k]];
+            uint32_t b = positionIds[indices[i + (k+1)%3]];
+            if(a == b)
+                continue;
+            edges[numEdges++] = (a < b) ? ((uint64_t)a << 32 | b) : ((uint64_t)b << 32 | a);
+        }
+    }
+    qsort(edges, numEdges, sizeof(uint64_t), compareUint64);
+    for(uint32_t i=0; i<numEdges; )
+    {
+        uint32_t runEnd = i + 1;
+        while(runEnd < numEdges && edges[runEnd] == edges[i])
+            ++runEnd;
+        if(runEnd - i != 2) {
+            isLocked[edges[i] >> 32] = true;
+            isLocked[edges[i] & 0xFFFFFFFF] = true;
+        }
+        i = runEnd;
+    }
+    free(edges);
+}
+
+struct EdgeCollapse
+{
+    // Vertex 'from' is replaced with vertex 'to' everywhere
+    uint32_t from;
+    uint32_t to;
+    float cost;
+};
+
+static int compareEdgeCollapseCosts(const void* a, const void* b)
+{
+    float x = ((const EdgeCollapse*)a)->cost;
+    float y = ((const EdgeCollapse*)b)->cost;
+    return (x < y) ? -1 : (x > y);
+}
+
+uint32_t simplifyMesh(uint32_t* outIndices, const uint32_t* indices, uint32_t numIndices,
+                      const VertexData* vertices, uint32_t numVertices,
+                      uint32_t targetNumIndices, float maxError, float* outError)
+{
+    assert(numIndices % 3 == 0);
+    memcpy(outIndices, indices, numIndices * sizeof(uint32_t));
+    if(outError)
+        *outError = 0.f;
+    if(numIndices <= targetNumIndices || numVertices == 0)
+        return numIndices;
+
+    // Normalise positions to a unit cube so the attribute weights don't
+    // depend on the mesh's scale, and to keep the quadrics well conditioned
+    float boundsMin[3], boundsMax[3];
+    for(int j=0; j<3; ++j) {
+        boundsMin[j] = FLT_MAX;
+        boundsMax[j] = -FLT_MAX;
+    }
+    for(uint32_t v=0; v<numVertices; ++v) {
+        for(int j=0; j<3; ++j) {
+            boundsMin[j] = fminf(boundsMin[j], vertices[v].pos[j]);
+            boundsMax[j] = fmaxf(boundsMax[j], vertices[v].pos[j]);
+        }
+    }
+    float scale = fmaxf(boundsMax[0] - boundsMin[0], fmaxf(boundsMax[1] - boundsMin[1], boundsMax[2] - boundsMin[2]));
+    float invScale = (scale > 0.f) ? 1.f / scale : 0.f;
+    float maxNormalisedErrorSq = (maxError * invScale) * (maxError * invScale);
+
+    float* points = (float*)malloc(numVertices * QUADRIC_MAX_DIM * sizeof(float));
+    for(uint32_t v=0; v<numVertices; ++v)
+    {
+        float* point = points + v*QUADRIC_MAX_DIM;
+        for(int j=0; j<3; ++j) {
+            point[j] = (vertices[v].pos[j] - boundsMin[j]) * invScale;
+            point[5+j] = vertices[v].norm[j] * SIMPLIFY_NORMAL_WEIGHT;
+        }
+        point[3] = vertices[v].uv[0] * SIMPLIFY_UV_WEIGHT;
+        point[4] = vertices[v].uv[1] * SIMPLIFY_UV_WEIGHT;
+    }
+
+    uint32_t* positionIds = (uint32_t*)malloc(numVertices * sizeof(uint32_t));
+    findPositionIds(vertices, numVertices, positionIds);
+    bool* isLocked = (bool*)calloc(numVertices, sizeof(bool));
+    findLockedPositions(outIndices, numIndices, positionIds, numVertices, isLocked);
+
+    // Attribute quadrics are per vertex, plane quadrics are per position
+    // and only used to measure how far the surface has moved
+    Quadric* attributeQuadrics = (Quadric*)calloc(numVertices, sizeof(Quadric));
+    Quadric* positionQuadrics = (Quadric*)calloc(numVertices, sizeof(Quadric));
+    for(uint32_t i=0; i<numIndices; i+=3)
+    {
+        const float* p0 = points + outIndices[i]*QUADRIC_MAX_DIM;
+        const float* p1 = points + outIndices[i+1]*QUADRIC_MAX_DIM;
+        const float* p2 = points + outIndices[i+2]*QUADRIC_MAX_DIM;
+        for(int k=0; k<3; ++k)
+        {
+            uint32_t v = outIndices[i+k];
+            addTriangleToQuadric(&attributeQuadrics[v], p0, p1, p2, QUADRIC_MAX_DIM);
+            addTrianglePlaneToQuadric(&positionQuadrics[positionIds[v]], p0, p1, p2);
+        }
+    }
+
+    uint32_t* adjacencyOffsets = (uint32_t*)malloc((numVertices + 1) * sizeof(uint32_t));
+    uint32_t* adjacentTriangles = (uint32_t*)malloc(numIndices * sizeof(uint32_t));
+    EdgeCollapse* collapses = (EdgeCollapse*)malloc(numIndices * sizeof(EdgeCollapse));
+    uint32_t* remap = (uint32_t*)malloc(numVertices * sizeof(uint32_t));
+    bool* isTouched = (bool*)malloc(numVertices * sizeof(bool));
+    float resultErrorSq = 0.f;
+
+    // Each pass collapses as many edges as it can without two collapses
+    // touching the same triangles, since the costs and flip checks are
+    // only valid for the mesh as it was at the start of the pass
+    while(numIndices > targetNumIndices)
+    {
+        // Vertex to triangle adjacency
+        memset(adjacencyOffsets, 0, (numVertices + 1) * sizeof(uint32_t));
+        for(uint32_t i=0; i<numIndices; ++i)
+            ++adjacencyOffsets[outIndices[i] + 1];
+        for(uint32_t v=0; v<numVertices; ++v)
+            adjacencyOffsets[v+1] += adjacencyOffsets[v];
+        for(uint32_t i=0; i<numIndices; ++i) {
+            uint32_t v = outIndices[i];
+            adjacentTriangles[adjacencyOffsets[v]++] = i / 3;
+        }
+        // NOTE: The loop above left each offset at the start of the next vertex's triangles
+        for(uint32_t v=numVertices; v>0; --v)
+            adjacencyOffsets[v] = adjacencyOffsets[v-1];
+        adjacencyOffsets[0] = 0;
+
+        // Every unlocked vertex can collapse onto any vertex it shares an edge
+        // with. Unlocked vertices only have edges with two triangles, which
+        // run in opposite directions, so each triangle edge a->b only needs
+        // to add the collapse of a onto b to cover both directions.
+        uint32_t numCollapses = 0;
+        for(uint32_t i=0; i<numIndices; i+=3)
+        {
+            for(int k=0; k<3; ++k)
+            {
+                uint32_t a = outIndices[i + k];
+                uint32_t b = outIndices[i + (k+1)%3];
+                if(positionIds[a] == positionIds[b] || isLocked[positionIds[a]])
+                    continue;
+                EdgeCollapse collapse = {a, b, evaluateQuadric(attributeQuadrics[a], points + b*QUADRIC_MAX_DIM, QUADRIC_MAX_DIM)};
+                collapses[numCollapses++] = collapse;
+            }
+        }
+        qsort(collapses, numCollapses, sizeof(EdgeCollapse), compareEdgeCollapseCosts);
+
+        for(uint32_t v=0; v<numVertices; ++v)
+            remap[v] = v;
+        memset(isTouched, 0, numVertices * sizeof(bool));
+
+        uint32_t numIndicesLeft = numIndices;
+        uint32_t numCollapsesApplied = 0;
+        for(uint32_t c=0; c<numCollapses && numIndicesLeft > targetNumIndices; ++c)
+        {
+            const EdgeCollapse& collapse = collapses[c];
+            uint32_t fromPos = positionIds[collapse.from];
+            uint32_t toPos = positionIds[collapse.to];
+            if(isTouched[fromPos] || isTouched[toPos])
+                continue;
+
+            float errorSq = evaluateQuadric(positionQuadrics[fromPos], points + collapse.to*QUADRIC_MAX_DIM, QUADRIC_POSITION_DIM);
+            if(errorSq > maxNormalisedErrorSq)
+                continue;
+
+            // Reject collapses that would flip a triangle over. Triangles
+            // containing both vertices disappear so don't need checking.
+            // NOTE: 'from' isn't on a seam, so these are all its triangles
+            bool flips = false;
+            uint32_t numRemovedTriangles = 0;
+            for(uint32_t j=adjacencyOffsets[collapse.from]; j<adjacencyOffsets[collapse.from+1]; ++j)
+            {
+                const uint32_t* tri = outIndices + 3*adjacentTriangles[j];
+                if(positionIds[tri[0]] == toPos || positionIds[tri[1]] == toPos || positionIds[tri[2]] == toPos) {
+                    ++numRemovedTriangles;
+                    continue;
+                }
+                const float* p[3];
+                const float* moved[3];
+                for(int k=0; k<3; ++k) {
+                    p[k] = points + tri[k]*QUADRIC_MAX_DIM;
+                    moved[k] = (tri[k] == collapse.from) ? points + collapse.to*QUADRIC_MAX_DIM : p[k];
+                }
+                float before[3], after[3];
+                triangleNormal(p[0], p[1], p[2], before);
+                triangleNormal(moved[0], moved[1], moved[2], after);
+                if(dot(before, after, 3) <= 0.f) {
+                    flips = true;
+                    break;
+                }
+            }
+            if(flips)
+                continue;
+
+            remap[collapse.from] = collapse.to;
+            addQuadric(&attributeQuadrics[collapse.to], attributeQuadrics[collapse.from]);
+            addQuadric(&positionQuadrics[toPos], positionQuadrics[fromPos]);
+            resultErrorSq = fmaxf(resultErrorSq, errorSq);
+            numIndicesLeft -= 3 * numRemovedTriangles;
+            ++numCollapsesApplied;
+
+            for(uint32_t j=adjacencyOffsets[collapse.from]; j<adjacencyOffsets[collapse.from+1]; ++j)
+            {
+                const uint32_t* tri = outIndices + 3*adjacentTriangles[j];
+                for(int k=0; k<3; ++k)
+                    isTouched[positionIds[tri[k]]] = true;
+            }
+        }
+        if(numCollapsesApplied == 0)
+            break;
+
+        // Apply the collapses and remove triangles that became degenerate
+        uint32_t numIndicesWritten = 0;
+        for(uint32_t i=0; i<numIndices; i+=3)
+        {
+            uint32_t a = remap[outIndices[i]];
+            uint32_t b = remap[outIndices[i+1]];
+            uint32_t c = remap[outIndices[i+2]];
+            if(positionIds[a] == positionIds[b] || positionIds[b] == positionIds[c] || positionIds[c] == positionIds[a])
+                continue;
+            outIndices[numIndicesWritten++] = a;
+            outIndices[numIndicesWritten++] = b;
+            outIndices[numIndicesWritten++] = c;
+        }
+        numIndices = numIndicesWritten;
+    }
+
+    if(outError)
+        *outError = sqrtf(resultErrorSq) * scale;
+
+    free(isTouched);
+    free(remap);
+    free(collapses);
+    free(adjacentTriangles);
+    free(adjacencyOffsets);
+    free(positionQuadrics);
+    free(attributeQuadrics);
+    free(isLocked);
+    free(positionIds);
+    free(points);
+
+    return numIndices;
+}
+
+void generateLods(LoadedObj* loadedObj)
+{
+    assert(!loadedObj->mappedFile);
+
+    // Simplify each LOD from the previous one, which is much
+    // quicker than starting from the full detail mesh each time.
+    // Submeshes are simplified separately so they keep their materials,
+    // and are kept end to end without padding while we work on them.
+    uint32_t numSubmeshes = loadedObj->numSubmeshes;
+    uint32_t* submeshOffsets = (uint32_t*)malloc(numSubmeshes * sizeof(uint32_t));
+    uint32_t* submeshNumIndices = (uint32_t*)malloc(numSubmeshes * sizeof(uint32_t));
+    uint32_t* indices = (uint32_t*)malloc(loadedObj->numIndices * sizeof(uint32_t));
+    uint32_t* simplified = (uint32_t*)malloc(loadedObj->numIndices * sizeof(uint32_t));
+    uint32_t numIndices = 0;
+    for(uint32_t s=0; s<numSubmeshes; ++s)
+    {
+        const ObjSubmesh* submesh = loadedObj->submeshes + s;
+        submeshOffsets[s] = numIndices;
+        submeshNumIndices[s] = submesh->numIndices[0];
+        for(uint32_t i=0; i<submesh->numIndices[0]; ++i)
+            indices[numIndices++] = getIndex(*loadedObj, submesh->indexOffset[0] + i);
+    }
+
+    // NOTE: Metal needs index buffer offsets to be multiples of 4 bytes,
+    // so each LOD and submesh starts on a multiple of this many indices
+    uint32_t indexAlignment = 4 / loadedObj->bytesPerIndex;
+
+    // Worst case every LOD only loses LOD_MIN_REDUCTION of the last one's 
+    // triangles, plus a padding triangle before each submesh
+    uint32_t lodIndexCapacity = 0;
+    for(uint32_t i=1, n=numIndices; i<MESH_MAX_LODS; ++i) {
+        n = (uint32_t)(n * LOD_MIN_REDUCTION);
+        lodIndexCapacity += n + indexAlignment + 3 * numSubmeshes;
+    }
+    uint32_t* lodIndices = (uint32_t*)malloc(lodIndexCapacity * sizeof(uint32_t));
+
+    MeshLod* lods = loadedObj->lods;
+    lods[0].indexOffset = 0;
+    lods[0].numIndices = loadedObj->numIndices;
+    lods[0].error = 0.f;
+    uint32_t numLods = 1;
+    uint32_t numLodIndices = 0;
+    while(numLods < MESH_MAX_LODS && numIndices / 3 > LOD_MIN_TRIANGLES)
+    {
+        uint32_t numSimplifiedIndices = 0;
+        float error = 0.f;
+        for(uint32_t s=0; s<numSubmeshes; ++s)
+        {
+            const uint32_t* submeshIndices = indices + submeshOffsets[s];
+            uint32_t* out = simplified + numSimplifiedIndices;
+            submeshOffsets[s] = numSimplifiedIndices;
+            if(submeshNumIndices[s] / 3 <= LOD_MIN_TRIANGLES) {
+                // Too small to be worth simplifying any further
+                memcpy(out, submeshIndices, submeshNumIndices[s] * sizeof(uint32_t));
+            }
+            else {
+                uint32_t targetNumIndices = (uint32_t)(submeshNumIndices[s] / 3 * LOD_TRIANGLE_RATIO) * 3;
+                float submeshError;
+                submeshNumIndices[s] = simplifyMesh(out, submeshIndices, submeshNumIndices[s],
+                                                    loadedObj->vertexBuffer, loadedObj->numVertices,
+                                                    targetNumIndices, FLT_MAX, &submeshError);
+                error = fmaxf(error, submeshError);
+            }
+            numSimplifiedIndices += submeshNumIndices[s];
+        }
+        if(numSimplifiedIndices == 0 || numSimplifiedIndices > numIndices * LOD_MIN_REDUCTION)
+            break; // Locked vertices are stopping us getting much further
+
+        while((loadedObj->numIndices + numLodIndices) % indexAlignment != 0)
+            lodIndices[numLodIndices++] = 0;
+        lods[numLods].indexOffset = loadedObj->numIndices + numLodIndices;
+        for(uint32_t s=0; s<numSubmeshes; ++s)
+        {
+            // Pad with whole degenerate triangles so the LOD
+            // can still be drawn in one go, see ObjSubmesh
+            while((loadedObj->numIndices + numLodIndices) % indexAlignment != 0) {
+                memset(lodIndices + numLodIndices, 0, 3 * sizeof(uint32_t));
+                numLodIndices += 3;
+            }
+            uint32_t* submeshIndices = simplified + submeshOffsets[s];
+            optimiseVertexCacheIndices(submeshIndices, submeshNumIndices[s], loadedObj->numVertices);
+            memcpy(lodIndices + numLodIndices, submeshIndices, submeshNumIndices[s] * sizeof(uint32_t));
+
+            ObjSubmesh* submesh = loadedObj->submeshes + s;
+            submesh->indexOffset[numLods] = loadedObj->numIndices + numLodIndices;
+            submesh->numIndices[numLods] = submeshNumIndices[s];
+            numLodIndices += submeshNumIndices[s];
+        }
+        lods[numLods].numIndices = loadedObj->numIndices + numLodIndices - lods[numLods].indexOffset;
+        // NOTE: Errors are relative to the previous LOD, so add them up to
+        // get a conservative estimate relative to the full detail mesh
+        lods[numLods].error = lods[numLods-1].error + error;
+        ++numLods;
+
+        uint32_t* temp = indices;
+        indices = simplified;
+        simplified = temp;
+        numIndices = numSimplifiedIndices;
+    }
+    loadedObj->numLods = numLods;
+    loadedObj->numLodIndices = numLodIndices;
+
+    free(loadedObj->lodIndexBuffer);
+    loadedObj->lodIndexBuffer = malloc(numLodIndices * loadedObj->bytesPerIndex);
+    if(loadedObj->bytesPerIndex == sizeof(uint16_t)) {
+        uint16_t* lodIndexBuffer16 = (uint16_t*)loadedObj->lodIndexBuffer;
+        for(uint32_t i=0; i<numLodIndices; ++i)
+            lodIndexBuffer16[i] = (uint16_t)lodIndices[i];
+    }
+    else {
+        memcpy(loadedObj->lodIndexBuffer, lodIndices, numLodIndices * sizeof(uint32_t));
+    }
+
+    free(lodIndices);
+    free(simplified);
+    free(indices);
+    free(submeshNumIndices);
+    free(submeshOffsets);
+}
+
+uint32_t selectLod(const LoadedObj& loadedObj, const float4x4& modelView, const float4x4& projection,
+                   float viewportHeight, float maxErrorPixels)
+{
+    if(loadedObj.numLods <= 1)
+        return 0;
+
+    // Distance from the camera to the nearest point of the bounding sphere
+    const float* c = loadedObj.boundsCenter;
+    float centerViewZ = modelView.m[0][2]*c[0] + modelView.m[1][2]*c[1] + modelView.m[2][2]*c[2] + modelView.m[3][2];
+    float maxScale = 0.f;
+    for(int col=0; col<3; ++col)
+        maxScale = fmaxf(maxScale, sqrtf(dot(modelView.m[col], modelView.m[col], 3)));
+    // NOTE: View space looks down negative z
+    float distance = -centerViewZ - loadedObj.boundsRadius * maxScale;
+    if(distance <= 0.f)
+        return 0;
+
+    // An error of e at this distance covers e * pixelsPerUnit pixels,
+    // where projection.m[1][1] is 1/tan(fovY/2) from makePerspectiveMat()
+    float pixelsPerUnit = maxScale * projection.m[1][1] * 0.5f * viewportHeight / distance;
+    uint32_t result = 0;
+    for(uint32_t i=1; i<loadedObj.numLods; ++i)
+    {
+        if(loadedObj.lods[i].error * pixelsPerUnit > maxErrorPixels)
+            break;
+        result = i;
+    }
+    return result;
+}
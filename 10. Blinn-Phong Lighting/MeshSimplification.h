@@ -0,0 +1,36 @@
+#pragma once
+
+#include "ObjLoading.h"
+#include "3DMaths.h"
+
+// Reduces the number of triangles in 'indices' by repeatedly collapsing edges,
+// picking the collapse that changes the mesh the least each time. Changes are
+// measured with quadric error metrics over position, uv and normal together,
+// so collapses that would stretch textures or bend shading are avoided too.
+// Vertices on open borders, uv/normal seams and non-manifold edges are locked.
+// Collapses only ever move vertices onto existing ones, so the simplified
+// indices still index into 'vertices' unchanged.
+//
+// Stops once 'targetNumIndices' or fewer are left, or when no collapse moves
+// the surface by less than 'maxError' (in the same units as the mesh).
+// Writes the result to 'outIndices', which needs room for 'numIndices', and
+// returns how many indices were written. If 'outError' isn't null it's set
+// to the estimated distance the surface moved, in mesh units.
+uint32_t simplifyMesh(uint32_t* outIndices, const uint32_t* indices, uint32_t numIndices,
+                      const VertexData* vertices, uint32_t numVertices,
+                      uint32_t targetNumIndices, float maxError, float* outError = NULL);
+
+// Fills in loadedObj's lods and lodIndexBuffer with a chain of
+// progressively simpler versions of its index buffer, each with roughly half
+// the triangles of the previous one. Each submesh is simplified on its own and
+// gets its own range of every LOD, and is optimised for the vertex cache.
+// Any pass that reorders the vertex buffer must run before this.
+void generateLods(LoadedObj* loadedObj);
+
+// Returns the index of the simplest of loadedObj's lods whose error is no
+// bigger than 'maxErrorPixels' once projected onto the screen, for a mesh
+// drawn with the given model-view and projection matrices (as made by
+// makePerspectiveMat()) into a viewport 'viewportHeight' pixels tall.
+// Returns 0 (full detail) if the camera is inside the mesh's bounding sphere.
+uint32_t selectLod(const LoadedObj& loadedObj, const float4x4& modelView, const float4x4& projection,
+                   float viewportHeight, float maxErrorPixels = 1.f);
@@ -0,0 +1,401 @@
+#include "Meshlets.h"
+
+#include <assert.h>
+#include <math.h> //sqrtf(), asinf(), fmaxf()
+#include <stdlib.h> //malloc(), realloc(), free()
+
+// Loosely based on meshopt_buildMeshlets() and meshopt_computeMeshletBounds()
+// from Arseny Kapoulkine's meshoptimizer project
+
+// Upper bound on maxTriangles, so per-triangle scratch can live on the stack
+#define MESHLET_MAX_TRIANGLES_LIMIT 512
+#define MESHLET_NO_LOCAL_INDEX 0xFFFF
+#define MESHLET_NO_TRIANGLE 0xFFFFFFFF
+
+struct MeshletBuilder
+{
+    const uint32_t* indices;
+    uint32_t numTriangles;
+
+    // Range of triangles in the submesh being split into meshlets
+    uint32_t firstTriangle;
+    uint32_t endTriangle;
+
+    // Vertex to triangle adjacency. The first numLiveTriangles[v] entries
+    // starting at adjacencyOffsets[v] are the triangles using vertex v
+    // that haven't been added to a meshlet yet.
+    uint32_t* adjacencyOffsets;
+    uint32_t* numLiveTriangles;
+    uint32_t* adjacentTriangles;
+
+    // Index of each vertex within the current meshlet's vertex list
+    uint16_t* localIndices;
+
+    Meshlet current;
+};
+
+static float dot3(const float a[3], const float b[3])
+{
+    return a[0]*b[0] + a[1]*b[1] + a[2]*b[2];
+}
+
+// Number of vertices adding triangle 'tri' would add to the current meshlet
+static uint32_t countNewVertices(const MeshletBuilder* builder, uint32_t tri)
+{
+    const uint32_t* v = builder->indices + 3*tri;
+    uint32_t result = 0;
+    for(int i=0; i<3; ++i)
+    {
+        bool isRepeat = (i > 0 && v[i] == v[0]) || (i > 1 && v[i] == v[1]);
+        if(builder->localIndices[v[i]] == MESHLET_NO_LOCAL_INDEX && !isRepeat)
+            ++result;
+    }
+    return result;
+}
+
+// Finds the unused triangle adjacent to the current meshlet that adds the
+// fewest new vertices to it. Ties go to the triangle whose vertices have the
+// fewest other triangles left, so we don't strand triangles on the border.
+static uint32_t findBestAdjacentTriangle(const MeshletBuilder* builder, const uint32_t* meshletVertices)
+{
+    uint32_t bestTri = MESHLET_NO_TRIANGLE;
+    uint32_t bestNumNewVertices = 4;
+    uint32_t bestNumLiveTriangles = 0;
+    for(uint32_t i=0; i<builder->current.numVertices; ++i)
+    {
+        uint32_t v = meshletVertices[builder->current.vertexOffset + i];
+        const uint32_t* adjacent = builder->adjacentTriangles + builder->adjacencyOffsets[v];
+        for(uint32_t j=0; j<builder->numLiveTriangles[v]; ++j)
+        {
+            uint32_t tri = adjacent[j];
+            // NOTE: Vertices can be shared with other submeshes,
+            // but meshlets only ever hold one submesh's triangles
+            if(tri < builder->firstTriangle || tri >= builder->endTriangle)
+                continue;
+            uint32_t numNewVertices = countNewVertices(builder, tri);
+            if(numNewVertices > bestNumNewVertices)
+                continue;
+
+            const uint32_t* triVertices = builder->indices + 3*tri;
+            uint32_t numLiveTriangles = builder->numLiveTriangles[triVertices[0]]
+                                      + builder->numLiveTriangles[triVertices[1]]
+                                      + builder->numLiveTriangles[triVertices[2]];
+            if(numNewVertices < bestNumNewVertices || numLiveTriangles < bestNumLiveTriangles)
+            {
+                bestTri = tri;
+                bestNumNewVertices = numNewVertices;
+                bestNumLiveTriangles = numLiveTriangles;
+            }
+        }
+    }
+    return bestTri;
+}
+
+static void removeLiveTriangle(MeshletBuilder* builder, uint32_t v, uint32_t tri)
+{
+    uint32_t* adjacent = builder->adjacentTriangles + builder->adjacencyOffsets[v];
+    uint32_t numLive = builder->numLiveTriangles[v];
+    for(uint32_t i=0; i<numLive; ++i)
+    {
+        if(adjacent[i] == tri) {
+            adjacent[i] = adjacent[numLive-1];
+            --builder->numLiveTriangles[v];
+            return;
+        }
+    }
+    assert(false);
+}
+
+static void computeMeshletBounds(const LoadedObj& loadedObj, Meshlet* meshlet)
+{
+    const uint32_t* meshletVertices = loadedObj.meshletVertices + meshlet->vertexOffset;
+    const uint8_t* meshletTriangles = loadedObj.meshletTriangles + 3*meshlet->triangleOffset;
+
+    // Bounding sphere using Ritter's algorithm: start with a sphere spanning
+    // the two most distant of the points with min/max x, y and z, then
+    // grow it to cover any points outside
+    const float* extremes[6];
+    for(int axis=0; axis<3; ++axis)
+        extremes[2*axis] = extremes[2*axis+1] = loadedObj.vertexBuffer[meshletVertices[0]].pos;
+    for(uint32_t i=1; i<meshlet->numVertices; ++i)
+    {
+        const float* p = loadedObj.vertexBuffer[meshletVertices[i]].pos;
+        for(int axis=0; axis<3; ++axis)
+        {
+            if(p[axis] < extremes[2*axis][axis]) extremes[2*axis] = p;
+            if(p[axis] > extremes[2*axis+1][axis]) extremes[2*axis+1] = p;
+        }
+    }
+    int widestAxis = 0;
+    float widestDistanceSq = -1.f;
+    for(int axis=0; axis<3; ++axis)
+    {
+        const float* a = extremes[2*axis];
+        const float* b = extremes[2*axis+1];
+        float d[3] = {b[0]-a[0], b[1]-a[1], b[2]-a[2]};
+        if(dot3(d, d) > widestDistanceSq) {
+            widestAxis = axis;
+            widestDistanceSq = dot3(d, d);
+        }
+    }
+    const float* a = extremes[2*widestAxis];
+    const float* b = extremes[2*widestAxis+1];
+    float center[3] = {(a[0]+b[0])*0.5f, (a[1]+b[1])*0.5f, (a[2]+b[2])*0.5f};
+    float radius = sqrtf(widestDistanceSq) * 0.5f;
+    for(uint32_t i=0; i<meshlet->numVertices; ++i)
+    {
+        const float* p = loadedObj.vertexBuffer[meshletVertices[i]].pos;
+        float d[3] = {p[0]-center[0], p[1]-center[1], p[2]-center[2]};
+        float distance = sqrtf(dot3(d, d));
+        if(distance > radius)
+        {
+            // Move the center towards p just enough to cover it
+            float newRadius = (radius + distance) * 0.5f;
+            float k = (newRadius - radius) / distance;
+            for(int j=0; j<3; ++j)
+                center[j] += d[j] * k;
+            radius = newRadius;
+        }
+    }
+    for(int j=0; j<3; ++j)
+        meshlet->center[j] = center[j];
+    meshlet->radius = radius;
+
+    // Normal cone. The axis is the average of the triangles' normals,
+    // and the cone's half-angle is set by the normal furthest from it.
+    float triNormals[MESHLET_MAX_TRIANGLES_LIMIT][3];
+    float axis[3] = {};
+    for(uint32_t t=0; t<meshlet->numTriangles; ++t)
+    {
+        const float* p0 = loadedObj.vertexBuffer[meshletVertices[meshletTriangles[3*t]]].pos;
+        const float* p1 = loadedObj.vertexBuffer[meshletVertices[meshletTriangles[3*t+1]]].pos;
+        const float* p2 = loadedObj.vertexBuffer[meshletVertices[meshletTriangles[3*t+2]]].pos;
+        float e1[3] = {p1[0]-p0[0], p1[1]-p0[1], p1[2]-p0[2]};
+        float e2[3] = {p2[0]-p0[0], p2[1]-p0[1], p2[2]-p0[2]};
+        float* n = triNormals[t];
+        n[0] = e1[1]*e2[2] - e1[2]*e2[1];
+        n[1] = e1[2]*e2[0] - e1[0]*e2[2];
+        n[2] = e1[0]*e2[1] - e1[1]*e2[0];
+        float area = sqrtf(dot3(n, n));
+        // NOTE: Degenerate triangles are never drawn, so they don't
+        // constrain the cone. Give them a zero normal to skip them.
+        float invArea = (area > 0.f) ? 1.f / area : 0.f;
+        for(int j=0; j<3; ++j) {
+            n[j] *= invArea;
+            axis[j] += n[j];
+        }
+    }
+    float axisLength = sqrtf(dot3(axis, axis));
+    float minDot = 1.f;
+    if(axisLength > 0.f)
+    {
+        for(int j=0; j<3; ++j)
+            axis[j] /= axisLength;
+        for(uint32_t t=0; t<meshlet->numTriangles; ++t)
+        {
+            if(dot3(triNormals[t], triNormals[t]) > 0.f)
+                minDot = fminf(minDot, dot3(axis, triNormals[t]));
+        }
+    }
+    for(int j=0; j<3; ++j) {
+        meshlet->coneAxis[j] = axis[j];
+        meshlet->coneApex[j] = center[j];
+    }
+
+    if(axisLength == 0.f || minDot <= 0.f)
+    {
+        // Normals span a hemisphere or more, some triangle
+        // always faces the camera wherever it is
+        meshlet->coneCutoff = 1.f;
+        return;
+    }
+
+    // Move the apex back along the axis until it's behind every
+    // triangle's plane, so the cone test works for perspective views
+    float maxT = 0.f;
+    for(uint32_t t=0; t<meshlet->numTriangles; ++t)
+    {
+        const float* n = triNormals[t];
+        if(dot3(n, n) == 0.f)
+            continue;
+        const float* p0 = loadedObj.vertexBuffer[meshletVertices[meshletTriangles[3*t]]].pos;
+        float toCenter[3] = {center[0]-p0[0], center[1]-p0[1], center[2]-p0[2]};
+        maxT = fmaxf(maxT, dot3(toCenter, n) / dot3(axis, n));
+    }
+    for(int j=0; j<3; ++j)
+        meshlet->coneApex[j] = center[j] - axis[j] * maxT;
+
+    // A view direction within (90 - halfAngle) degrees of the axis sees all
+    // the triangles from behind, and cos(90 - halfAngle) = sin(halfAngle)
+    meshlet->coneCutoff = sqrtf(1.f - minDot*minDot);
+}
+
+static void finishMeshlet(LoadedObj* loadedObj, MeshletBuilder* builder)
+{
+    Meshlet* meshlet = &builder->current;
+    if(meshlet->numTriangles == 0)
+        return;
+
+    computeMeshletBounds(*loadedObj, meshlet);
+    loadedObj->meshlets[loadedObj->numMeshlets++] = *meshlet;
+    loadedObj->numMeshletVertices += meshlet->numVertices;
+    loadedObj->numMeshletTriangles += meshlet->numTriangles;
+
+    for(uint32_t i=0; i<meshlet->numVertices; ++i)
+        builder->localIndices[loadedObj->meshletVertices[meshlet->vertexOffset + i]] = MESHLET_NO_LOCAL_INDEX;
+
+    *meshlet = {};
+    meshlet->vertexOffset = loadedObj->numMeshletVertices;
+    meshlet->triangleOffset = loadedObj->numMeshletTriangles;
+}
+
+void buildMeshlets(LoadedObj* loadedObj, uint32_t maxVertices, uint32_t maxTriangles)
+{
+    assert(!loadedObj->mappedFile);
+    assert(maxVertices >= 3 && maxVertices <= 256);
+    assert(maxTriangles >= 1 && maxTriangles <= MESHLET_MAX_TRIANGLES_LIMIT);
+
+    uint32_t numVertices = loadedObj->numVertices;
+    uint32_t numTriangles = loadedObj->numIndices / 3;
+
+    free(loadedObj->meshlets);
+    free(loadedObj->meshletVertices);
+    free(loadedObj->meshletTriangles);
+    // Worst case is one meshlet per triangle
+    loadedObj->meshlets = (Meshlet*)malloc(numTriangles * sizeof(Meshlet));
+    loadedObj->meshletVertices = (uint32_t*)malloc(numTriangles * 3 * sizeof(uint32_t));
+    loadedObj->meshletTriangles = (uint8_t*)malloc(numTriangles * 3);
+    loadedObj->numMeshlets = 0;
+    loadedObj->numMeshletVertices = 0;
+    loadedObj->numMeshletTriangles = 0;
+
+    MeshletBuilder builder = {};
+    uint32_t* indices = (uint32_t*)malloc(numTriangles * 3 * sizeof(uint32_t));
+    for(uint32_t i=0; i<numTriangles*3; ++i)
+        indices[i] = getIndex(*loadedObj, i);
+    builder.indices = indices;
+    builder.numTriangles = numTriangles;
+
+    // Build adjacency with a counting sort of triangle corners by vertex.
+    // The padding between submeshes is skipped, it never goes in a meshlet.
+    builder.adjacencyOffsets = (uint32_t*)malloc(numVertices * sizeof(uint32_t));
+    builder.numLiveTriangles = (uint32_t*)calloc(numVertices, sizeof(uint32_t));
+    builder.adjacentTriangles = (uint32_t*)malloc(numTriangles * 3 * sizeof(uint32_t));
+    for(uint32_t s=0; s<loadedObj->numSubmeshes; ++s)
+    {
+        const ObjSubmesh* submesh = loadedObj->submeshes + s;
+        for(uint32_t i=submesh->indexOffset[0]; i<submesh->indexOffset[0] + submesh->numIndices[0]; ++i)
+            ++builder.numLiveTriangles[indices[i]];
+    }
+    uint32_t offset = 0;
+    for(uint32_t v=0; v<numVertices; ++v) {
+        builder.adjacencyOffsets[v] = offset;
+        offset += builder.numLiveTriangles[v];
+        builder.numLiveTriangles[v] = 0;
+    }
+    for(uint32_t s=0; s<loadedObj->numSubmeshes; ++s)
+    {
+        const ObjSubmesh* submesh = loadedObj->submeshes + s;
+        for(uint32_t i=submesh->indexOffset[0]; i<submesh->indexOffset[0] + submesh->numIndices[0]; ++i) {
+            uint32_t v = indices[i];
+            builder.adjacentTriangles[builder.adjacencyOffsets[v] + builder.numLiveTriangles[v]++] = i / 3;
+        }
+    }
+
+    builder.localIndices = (uint16_t*)malloc(numVertices * sizeof(uint16_t));
+    for(uint32_t v=0; v<numVertices; ++v)
+        builder.localIndices[v] = MESHLET_NO_LOCAL_INDEX;
+
+    bool* isTriangleUsed = (bool*)calloc(numTriangles, sizeof(bool));
+    for(uint32_t s=0; s<loadedObj->numSubmeshes; ++s)
+    {
+        ObjSubmesh* submesh = loadedObj->submeshes + s;
+        builder.firstTriangle = submesh->indexOffset[0] / 3;
+        builder.endTriangle = builder.firstTriangle + submesh->numIndices[0] / 3;
+        submesh->meshletOffset = loadedObj->numMeshlets;
+
+        uint32_t nextUnusedTriangle = builder.firstTriangle;
+        for(uint32_t t=builder.firstTriangle; t<builder.endTriangle; ++t)
+        {
+            uint32_t tri = findBestAdjacentTriangle(&builder, loadedObj->meshletVertices);
+            if(tri == MESHLET_NO_TRIANGLE)
+            {
+                // Nothing connected to the current meshlet is left. Carry on in
+                // index buffer order, which is spatially coherent if the mesh
+                // has been optimised for the vertex cache.
+                while(isTriangleUsed[nextUnusedTriangle])
+                    ++nextUnusedTriangle;
+                tri = nextUnusedTriangle;
+            }
+
+            Meshlet* meshlet = &builder.current;
+            if(meshlet->numVertices + countNewVertices(&builder, tri) > maxVertices
+               || meshlet->numTriangles == maxTriangles)
+            {
+                finishMeshlet(loadedObj, &builder);
+            }
+
+            const uint32_t* triVertices = indices + 3*tri;
+            uint8_t* outTriangle = loadedObj->meshletTriangles + 3*(meshlet->triangleOffset + meshlet->numTriangles);
+            for(int i=0; i<3; ++i)
+            {
+                uint32_t v = triVertices[i];
+                if(builder.localIndices[v] == MESHLET_NO_LOCAL_INDEX) {
+                    builder.localIndices[v] = (uint16_t)meshlet->numVertices;
+                    loadedObj->meshletVertices[meshlet->vertexOffset + meshlet->numVertices++] = v;
+                }
+                outTriangle[i] = (uint8_t)builder.localIndices[v];
+                removeLiveTriangle(&builder, v, tri);
+            }
+            ++meshlet->numTriangles;
+            isTriangleUsed[tri] = true;
+        }
+        finishMeshlet(loadedObj, &builder);
+        submesh->numMeshlets = loadedObj->numMeshlets - submesh->meshletOffset;
+    }
+
+    loadedObj->meshlets = (Meshlet*)realloc(loadedObj->meshlets, loadedObj->numMeshlets * sizeof(Meshlet));
+    loadedObj->meshletVertices = (uint32_t*)realloc(loadedObj->meshletVertices, loadedObj->numMeshletVertices * sizeof(uint32_t));
+    loadedObj->meshletTriangles = (uint8_t*)realloc(loadedObj->meshletTriangles, loadedObj->numMeshletTriangles * 3);
+
+    free(isTriangleUsed);
+    free(builder.localIndices);
+    free(builder.adjacentTriangles);
+    free(builder.numLiveTriangles);
+    free(builder.adjacencyOffsets);
+    free(indices);
+}
+
+MeshletStats analyseMeshlets(const LoadedObj& loadedObj, uint32_t maxVertices, uint32_t maxTriangles)
+{
+    MeshletStats result = {};
+    result.numMeshlets = loadedObj.numMeshlets;
+    if(loadedObj.numMeshlets == 0)
+        return result;
+
+    const float* boundsMin = loadedObj.boundsMin;
+    const float* boundsMax = loadedObj.boundsMax;
+    float diagonal[3] = {boundsMax[0]-boundsMin[0], boundsMax[1]-boundsMin[1], boundsMax[2]-boundsMin[2]};
+    float meshRadius = sqrtf(dot3(diagonal, diagonal)) * 0.5f;
+
+    double coneAngleSum = 0, radiusSum = 0;
+    for(uint32_t i=0; i<loadedObj.numMeshlets; ++i)
+    {
+        const Meshlet& meshlet = loadedObj.meshlets[i];
+        if(meshlet.coneCutoff >= 1.f)
+            ++result.numMeshletsWithoutCone;
+        else
+            coneAngleSum += asinf(meshlet.coneCutoff) * (180.f / (float)M_PI);
+        radiusSum += meshlet.radius;
+    }
+
+    result.vertexFill = (float)loadedObj.numMeshletVertices / ((float)loadedObj.numMeshlets * maxVertices);
+    result.triangleFill = (float)loadedObj.numMeshletTriangles / ((float)loadedObj.numMeshlets * maxTriangles);
+    result.vertexDuplication = (float)loadedObj.numMeshletVertices / (float)loadedObj.numVertices;
+    uint32_t numMeshletsWithCone = loadedObj.numMeshlets - result.numMeshletsWithoutCone;
+    if(numMeshletsWithCone > 0)
+        result.avgConeAngleDegrees = (float)(coneAngleSum / numMeshletsWithCone);
+    if(meshRadius > 0.f)
+        result.avgRelativeRadius = (float)(radiusSum / loadedObj.numMeshlets) / meshRadius;
+    return result;
+}
@@ -0,0 +1,85 @@
+#pragma once
+
+#include "ObjLoading.h"
+
+// Splits a LoadedObj's triangles into small clusters ("meshlets") that
+// can be culled as a whole, by bounding sphere against the view frustum
+// or by normal cone when every triangle in them faces away from the camera.
+// Each meshlet has its own small vertex list, and its triangles index into
+// that list with 8-bit local indices:
+//   vertex index = loadedObj.meshletVertices[meshlet.vertexOffset + localIndex]
+//   localIndex   = loadedObj.meshletTriangles[3*(meshlet.triangleOffset + t) + corner]
+
+// Defaults that suit mesh shaders, which typically output
+// up to 64 vertices and 126 primitives per threadgroup
+#define MESHLET_MAX_VERTICES 64
+#define MESHLET_MAX_TRIANGLES 124
+
+struct Meshlet
+{
+    // Bounding sphere of the meshlet's vertices
+    float center[3];
+    float radius;
+
+    // Normal cone: every triangle in the meshlet faces away from a camera at
+    // cameraPos if dot(normalise(coneApex - cameraPos), coneAxis) >= coneCutoff.
+    // coneCutoff is 1 if the triangles' normals are too spread out for
+    // that to ever be true, see isMeshletBackFacing().
+    float coneApex[3];
+    float coneCutoff;
+    float coneAxis[3];
+
+    uint32_t vertexOffset;
+    uint32_t triangleOffset;
+    uint32_t numVertices;
+    uint32_t numTriangles;
+};
+
+// Fills in loadedObj's meshlets, meshletVertices and meshletTriangles, and
+// each submesh's meshletOffset and numMeshlets. Meshlets never mix submeshes,
+// so each one can be drawn with a single material.
+// Triangles are added greedily to the current meshlet, favouring ones that
+// share the most vertices with it, so meshlets end up compact and full.
+// Any pass that reorders the vertex buffer must run before this.
+// maxVertices can be at most 256, since local indices are 8-bit,
+// and maxTriangles at most 512.
+void buildMeshlets(LoadedObj* loadedObj, uint32_t maxVertices = MESHLET_MAX_VERTICES,
+                   uint32_t maxTriangles = MESHLET_MAX_TRIANGLES);
+
+// Returns true if every triangle in 'meshlet' is back-facing
+// when viewed from cameraPos, so it can be skipped entirely
+inline bool isMeshletBackFacing(const Meshlet& meshlet, const float cameraPos[3])
+{
+    if(meshlet.coneCutoff >= 1.f)
+        return false;
+    float d[3] = {
+        meshlet.coneApex[0] - cameraPos[0],
+        meshlet.coneApex[1] - cameraPos[1],
+        meshlet.coneApex[2] - cameraPos[2]
+    };
+    float dDotAxis = d[0]*meshlet.coneAxis[0] + d[1]*meshlet.coneAxis[1] + d[2]*meshlet.coneAxis[2];
+    float dLengthSq = d[0]*d[0] + d[1]*d[1] + d[2]*d[2];
+    // NOTE: Equivalent to dot(normalise(d), coneAxis) >= coneCutoff without the sqrt
+    return dDotAxis >= 0.f && dDotAxis*dDotAxis >= meshlet.coneCutoff*meshlet.coneCutoff*dLengthSq;
+}
+
+struct MeshletStats
+{
+    uint32_t numMeshlets;
+    // Average vertices/triangles per meshlet as a fraction of the limits
+    // passed to buildMeshlets(). 1.0 means every meshlet is full.
+    float vertexFill;
+    float triangleFill;
+    // Vertices stored in meshletVertices per vertex in the vertex buffer.
+    // Vertices shared by several meshlets are transformed once per meshlet.
+    float vertexDuplication;
+    // Average half-angle of the normal cones, over meshlets that have one.
+    // Smaller cones can be back-face culled from more viewpoints.
+    float avgConeAngleDegrees;
+    uint32_t numMeshletsWithoutCone;
+    // Average bounding sphere radius relative to the whole mesh's
+    float avgRelativeRadius;
+};
+
+MeshletStats analyseMeshlets(const LoadedObj& loadedObj, uint32_t maxVertices = MESHLET_MAX_VERTICES,
+                             uint32_t maxTriangles = MESHLET_MAX_TRIANGLES);
@@ -1,4 +1,9 @@
 #include "ObjLoading.h"
+#include "ThreadPool.h"
+#include "MeshOptimisation.h"
+#include "Meshlets.h"
+#include "MeshSimplification.h"
+#include "MemoryArena.h"
 
 #include <fcntl.h> //open()
 #include <unistd.h> //close()
@@ -6,7 +11,19 @@
 #include <sys/mman.h> //mmap()
 
 #include <assert.h>
-#include <math.h> //pow(), fabs(), sqrtf()
+#include <float.h> //FLT_EPSILON
+#include <math.h> //rintf(), sqrtf(), fminf(), fmaxf(), acosf()
+#include <stdio.h> //snprintf(), rename()
+#include <stdlib.h> //malloc(), realloc(), free(), strtof()
+#include <string.h> //memcpy(), memcmp(), memset()
+
+#if defined(__AVX2__)
+#include <immintrin.h>
+#elif defined(__SSE2__)
+#include <emmintrin.h>
+#elif defined(__ARM_NEON)
+#include <arm_neon.h>
+#endif
 
 // Based on the .obj loading code by Arseny Kapoulkine
 // in the meshoptimizer project
@@ -35,6 +52,268 @@ static int parseInt(const char* s, const char** end)
     return sign ? -int(result) : int(result);
 }
 
+// 128-bit approximations of 5^q for every power of ten a float can need,
+// normalised so the top bit is set. Truncated for q >= 0 and rounded up
+// for q < 0, as the Eisel-Lemire algorithm requires.
+#define FLOAT_SMALLEST_POWER_OF_TEN -65
+#define FLOAT_LARGEST_POWER_OF_TEN 38
+static const uint64_t powersOfFive128[FLOAT_LARGEST_POWER_OF_TEN - FLOAT_SMALLEST_POWER_OF_TEN + 1][2] = {
+    {0x86ccbb52ea94baea, 0x98e947129fc2b4e9}, // 5^-65
+    {0xa87fea27a539e9a5, 0x3f2398d747b36224}, // 5^-64
+    {0xd29fe4b18e88640e, 0x8eec7f0d19a03aad}, // 5^-63
+    {0x83a3eeeef9153e89, 0x1953cf68300424ac}, // 5^-62
+    {0xa48ceaaab75a8e2b, 0x5fa8c3423c052dd7}, // 5^-61
+    {0xcdb02555653131b6, 0x3792f412cb06794d}, // 5^-60
+    {0x808e17555f3ebf11, 0xe2bbd88bbee40bd0}, // 5^-59
+    {0xa0b19d2ab70e6ed6, 0x5b6aceaeae9d0ec4}, // 5^-58
+    {0xc8de047564d20a8b, 0xf245825a5a445275}, // 5^-57
+    {0xfb158592be068d2e, 0xeed6e2f0f0d56712}, // 5^-56
+    {0x9ced737bb6c4183d, 0x55464dd69685606b}, // 5^-55
+    {0xc428d05aa4751e4c, 0xaa97e14c3c26b886}, // 5^-54
+    {0xf53304714d9265df, 0xd53dd99f4b3066a8}, // 5^-53
+    {0x993fe2c6d07b7fab, 0xe546a8038efe4029}, // 5^-52
+    {0xbf8fdb78849a5f96, 0xde98520472bdd033}, // 5^-51
+    {0xef73d256a5c0f77c, 0x963e66858f6d4440}, // 5^-50
+    {0x95a8637627989aad, 0xdde7001379a44aa8}, // 5^-49
+    {0xbb127c53b17ec159, 0x5560c018580d5d52}, // 5^-48
+    {0xe9d71b689dde71af, 0xaab8f01e6e10b4a6}, // 5^-47
+    {0x9226712162ab070d, 0xcab3961304ca70e8}, // 5^-46
+    {0xb6b00d69bb55c8d1, 0x3d607b97c5fd0d22}, // 5^-45
+    {0xe45c10c42a2b3b05, 0x8cb89a7db77c506a}, // 5^-44
+    {0x8eb98a7a9a5b04e3, 0x77f3608e92adb242}, // 5^-43
+    {0xb267ed1940f1c61c, 0x55f038b237591ed3}, // 5^-42
+    {0xdf01e85f912e37a3, 0x6b6c46dec52f6688}, // 5^-41
+    {0x8b61313bbabce2c6, 0x2323ac4b3b3da015}, // 5^-40
+    {0xae397d8aa96c1b77, 0xabec975e0a0d081a}, // 5^-39
+    {0xd9c7dced53c72255, 0x96e7bd358c904a21}, // 5^-38
+    {0x881cea14545c7575, 0x7e50d64177da2e54}, // 5^-37
+    {0xaa242499697392d2, 0xdde50bd1d5d0b9e9}, // 5^-36
+    {0xd4ad2dbfc3d07787, 0x955e4ec64b44e864}, // 5^-35
+    {0x84ec3c97da624ab4, 0xbd5af13bef0b113e}, // 5^-34
+    {0xa6274bbdd0fadd61, 0xecb1ad8aeacdd58e}, // 5^-33
+    {0xcfb11ead453994ba, 0x67de18eda5814af2}, // 5^-32
+    {0x81ceb32c4b43fcf4, 0x80eacf948770ced7}, // 5^-31
+    {0xa2425ff75e14fc31, 0xa1258379a94d028d}, // 5^-30
+    {0xcad2f7f5359a3b3e, 0x096ee45813a04330}, // 5^-29
+    {0xfd87b5f28300ca0d, 0x8bca9d6e188853fc}, // 5^-28
+    {0x9e74d1b791e07e48, 0x775ea264cf55347e}, // 5^-27
+    {0xc612062576589dda, 0x95364afe032a819e}, // 5^-26
+    {0xf79687aed3eec551, 0x3a83ddbd83f52205}, // 5^-25
+    {0x9abe14cd44753b52, 0xc4926a9672793543}, // 5^-24
+    {0xc16d9a0095928a27, 0x75b7053c0f178294}, // 5^-23
+    {0xf1c90080baf72cb1, 0x5324c68b12dd6339}, // 5^-22
+    {0x971da05074da7bee, 0xd3f6fc16ebca5e04}, // 5^-21
+    {0xbce5086492111aea, 0x88f4bb1ca6bcf585}, // 5^-20
+    {0xec1e4a7db69561a5, 0x2b31e9e3d06c32e6}, // 5^-19
+    {0x9392ee8e921d5d07, 0x3aff322e62439fd0}, // 5^-18
+    {0xb877aa3236a4b449, 0x09befeb9fad487c3}, // 5^-17
+    {0xe69594bec44de15b, 0x4c2ebe687989a9b4}, // 5^-16
+    {0x901d7cf73ab0acd9, 0x0f9d37014bf60a11}, // 5^-15
+    {0xb424dc35095cd80f, 0x538484c19ef38c95}, // 5^-14
+    {0xe12e13424bb40e13, 0x2865a5f206b06fba}, // 5^-13
+    {0x8cbccc096f5088cb, 0xf93f87b7442e45d4}, // 5^-12
+    {0xafebff0bcb24aafe, 0xf78f69a51539d749}, // 5^-11
+    {0xdbe6fecebdedd5be, 0xb573440e5a884d1c}, // 5^-10
+    {0x89705f4136b4a597, 0x31680a88f8953031}, // 5^-9
+    {0xabcc77118461cefc, 0xfdc20d2b36ba7c3e}, // 5^-8
+    {0xd6bf94d5e57a42bc, 0x3d32907604691b4d}, // 5^-7
+    {0x8637bd05af6c69b5, 0xa63f9a49c2c1b110}, // 5^-6
+    {0xa7c5ac471b478423, 0x0fcf80dc33721d54}, // 5^-5
+    {0xd1b71758e219652b, 0xd3c36113404ea4a9}, // 5^-4
+    {0x83126e978d4fdf3b, 0x645a1cac083126ea}, // 5^-3
+    {0xa3d70a3d70a3d70a, 0x3d70a3d70a3d70a4}, // 5^-2
+    {0xcccccccccccccccc, 0xcccccccccccccccd}, // 5^-1
+    {0x8000000000000000, 0x0000000000000000}, // 5^0
+    {0xa000000000000000, 0x0000000000000000}, // 5^1
+    {0xc800000000000000, 0x0000000000000000}, // 5^2
+    {0xfa00000000000000, 0x0000000000000000}, // 5^3
+    {0x9c40000000000000, 0x0000000000000000}, // 5^4
+    {0xc350000000000000, 0x0000000000000000}, // 5^5
+    {0xf424000000000000, 0x0000000000000000}, // 5^6
+    {0x9896800000000000, 0x0000000000000000}, // 5^7
+    {0xbebc200000000000, 0x0000000000000000}, // 5^8
+    {0xee6b280000000000, 0x0000000000000000}, // 5^9
+    {0x9502f90000000000, 0x0000000000000000}, // 5^10
+    {0xba43b74000000000, 0x0000000000000000}, // 5^11
+    {0xe8d4a51000000000, 0x0000000000000000}, // 5^12
+    {0x9184e72a00000000, 0x0000000000000000}, // 5^13
+    {0xb5e620f480000000, 0x0000000000000000}, // 5^14
+    {0xe35fa931a0000000, 0x0000000000000000}, // 5^15
+    {0x8e1bc9bf04000000, 0x0000000000000000}, // 5^16
+    {0xb1a2bc2ec5000000, 0x0000000000000000}, // 5^17
+    {0xde0b6b3a76400000, 0x0000000000000000}, // 5^18
+    {0x8ac7230489e80000, 0x0000000000000000}, // 5^19
+    {0xad78ebc5ac620000, 0x0000000000000000}, // 5^20
+    {0xd8d726b7177a8000, 0x0000000000000000}, // 5^21
+    {0x878678326eac9000, 0x0000000000000000}, // 5^22
+    {0xa968163f0a57b400, 0x0000000000000000}, // 5^23
+    {0xd3c21bcecceda100, 0x0000000000000000}, // 5^24
+    {0x84595161401484a0, 0x0000000000000000}, // 5^25
+    {0xa56fa5b99019a5c8, 0x0000000000000000}, // 5^26
+    {0xcecb8f27f4200f3a, 0x0000000000000000}, // 5^27
+    {0x813f3978f8940984, 0x4000000000000000}, // 5^28
+    {0xa18f07d736b90be5, 0x5000000000000000}, // 5^29
+    {0xc9f2c9cd04674ede, 0xa400000000000000}, // 5^30
+    {0xfc6f7c4045812296, 0x4d00000000000000}, // 5^31
+    {0x9dc5ada82b70b59d, 0xf020000000000000}, // 5^32
+    {0xc5371912364ce305, 0x6c28000000000000}, // 5^33
+    {0xf684df56c3e01bc6, 0xc732000000000000}, // 5^34
+    {0x9a130b963a6c115c, 0x3c7f400000000000}, // 5^35
+    {0xc097ce7bc90715b3, 0x4b9f100000000000}, // 5^36
+    {0xf0bdc21abb48db20, 0x1e86d40000000000}, // 5^37
+    {0x96769950b50d88f4, 0x1314448000000000}, // 5^38
+};
+
+// Converts mantissa * 10^power to the nearest float's bit pattern using
+// the Eisel-Lemire algorithm, as in Daniel Lemire's fast_float library.
+// mantissa must be non-zero.
+static inline uint32_t decimalToFloatBits(uint64_t mantissa, int power)
+{
+    if(power < FLOAT_SMALLEST_POWER_OF_TEN)
+        return 0;
+    if(power > FLOAT_LARGEST_POWER_OF_TEN)
+        return 0x7F800000; // inf
+
+    // Normalise the mantissa so its top bit is set and multiply by 5^power.
+    // We need 23 mantissa bits plus 3 for rounding: only look at the low
+    // half of the power if the high product is ambiguous in those bits.
+    int leadingZeroes = __builtin_clzll(mantissa);
+    uint64_t w = mantissa << leadingZeroes;
+    const uint64_t* power5 = powersOfFive128[power - FLOAT_SMALLEST_POWER_OF_TEN];
+    unsigned __int128 product = (unsigned __int128)w * power5[0];
+    uint64_t productHigh = (uint64_t)(product >> 64);
+    uint64_t productLow = (uint64_t)product;
+    const uint64_t precisionMask = 0xFFFFFFFFFFFFFFFFull >> (23 + 3);
+    if((productHigh & precisionMask) == precisionMask)
+    {
+        uint64_t secondHigh = (uint64_t)(((unsigned __int128)w * power5[1]) >> 64);
+        productLow += secondHigh;
+        if(secondHigh > productLow)
+            ++productHigh;
+    }
+
+    // Keep 25 bits: 24 for the result (with the implicit 1) plus a rounding bit
+    int upperBit = (int)(productHigh >> 63);
+    int shift = upperBit + 64 - 23 - 3;
+    uint64_t resultMantissa = productHigh >> shift;
+    // NOTE: (217706 * power) >> 16 is floor(log2(10^power)), 127 is the float exponent bias
+    int power2 = ((217706 * power) >> 16) + 63 + upperBit - leadingZeroes + 127;
+
+    if(power2 <= 0)
+    {
+        // Subnormal
+        if(-power2 + 1 >= 64)
+            return 0;
+        resultMantissa >>= -power2 + 1;
+        resultMantissa += resultMantissa & 1;
+        resultMantissa >>= 1;
+        // Rounding may have carried into the smallest normal exponent
+        power2 = (resultMantissa < (1u << 23)) ? 0 : 1;
+        return (uint32_t(power2) << 23) | uint32_t(resultMantissa & ((1u << 23) - 1));
+    }
+
+    // NOTE: Exactly halfway between two floats is only possible for small
+    // powers of ten, where we need to round to even rather than up
+    if(productLow <= 1 && power >= -17 && power <= 10 && (resultMantissa & 3) == 1
+       && (resultMantissa << shift) == productHigh)
+    {
+        resultMantissa &= ~1ull;
+    }
+
+    resultMantissa += resultMantissa & 1;
+    resultMantissa >>= 1;
+    if(resultMantissa >= (2u << 23)) {
+        resultMantissa = 1u << 23;
+        ++power2;
+    }
+    if(power2 >= 0xFF)
+        return 0x7F800000;
+
+    return (uint32_t(power2) << 23) | uint32_t(resultMantissa & ((1u << 23) - 1));
+}
+
+// Reads the exponent part of a float, e.g. "e-5", with s pointing at the 'e'
+static int parseExponent(const char* s, const char** end)
+{
+    ++s;
+
+    // read exponent sign
+    int expSign = (*s == '-') ? -1 : 1;
+    if(*s == '-' || *s == '+') 
+        ++s;
+
+    // read exponent
+    // NOTE: Anything this big is 0 or inf anyway, just don't overflow
+    int expPower = 0;
+    while (unsigned(*s - '0') < 10)
+    {
+        if(expPower < 0x10000)
+            expPower = expPower * 10 + (*s - '0');
+        ++s;
+    }
+
+    *end = s;
+    return expSign * expPower;
+}
+
+// NOTE: bitwise OR with ' ' will transform an uppercase char 
+// to lowercase while leaving lowercase chars unchanged
+static bool isExponent(char c)
+{
+    return (c | ' ') == 'e';
+}
+
+// Slow path of parseFloat() for numbers with more than 19 digits, which
+// don't fit in 64 bits. 'digits' points after the sign, at the first digit
+// or the '.', 'integerEnd' at the first non-digit after the integer part
+// and 'digitsEnd' at the first non-digit after the fractional part.
+// NOTE: noinline keeps parseFloat() small, this is very rarely needed
+__attribute__((noinline))
+static float parseLongFloat(const char* begin, const char* digits, const char* integerEnd, 
+                            const char* digitsEnd, const char** end)
+{
+    // Keep the first 19 significant digits (leading zeroes
+    // don't count) and note if any non-zero ones were dropped
+    uint64_t mantissa = 0;
+    int numSignificantDigits = 0;
+    int power = 0;
+    bool isTruncated = false;
+    for (const char* c = digits; c < digitsEnd; ++c)
+    {
+        if (c == integerEnd)
+            continue; // skip the '.'
+        if (numSignificantDigits < 19) {
+            mantissa = mantissa * 10 + (*c - '0');
+            numSignificantDigits += (mantissa != 0);
+            power -= (c > integerEnd);
+        }
+        else {
+            power += (c < integerEnd);
+            isTruncated |= (*c != '0');
+        }
+    }
+    *end = digitsEnd;
+    if (isExponent(**end))
+        power += parseExponent(*end, end);
+
+    if(mantissa == 0)
+        return (*begin == '-') ? -0.f : 0.f;
+
+    uint32_t bits = decimalToFloatBits(mantissa, power);
+    // NOTE: If digits were dropped the true value lies between mantissa 
+    // and mantissa+1. If those round to different floats we need every
+    // digit to decide, which strtof() does.
+    if(isTruncated && decimalToFloatBits(mantissa + 1, power) != bits)
+        return strtof(begin, NULL);
+
+    if(*begin == '-')
+        bits |= 0x80000000;
+    float result;
+    memcpy(&result, &bits, sizeof(result));
+    return result;
+}
+
+// Correctly rounded, i.e. returns the same result as strtof()
 static float parseFloat(const char* s, const char** end)
 {
     static const double powers[] = {1e0, 1e+1, 1e+2, 1e+3, 1e+4, 1e+5, 1e+6, 1e+7, 1e+8, 1e+9, 1e+10, 1e+11, 1e+12, 1e+13, 1e+14, 1e+15, 1e+16, 1e+17, 1e+18, 1e+19, 1e+20, 1e+21, 1e+22};
@@ -42,69 +321,83 @@ static float parseFloat(const char* s, const char** end)
     // skip whitespace
     while (*s == ' ' || *s == '\t')
         ++s;
+    const char* begin = s;
 
     // read sign
-    double sign = (*s == '-') ? -1 : 1;
+    bool isNegative = (*s == '-');
     if(*s == '-' || *s == '+') 
         ++s;
 
     // read integer part
-    double result = 0;
-    int power = 0;
-
+    uint64_t mantissa = 0;
+    const char* digits = s;
     while (unsigned(*s - '0') < 10)
     {
-        result = result * 10 + (double)(*s - '0');
+        mantissa = mantissa * 10 + (*s - '0');
         ++s;
     }
+    const char* integerEnd = s;
+    int numDigits = int(integerEnd - digits);
+    int power = 0;
 
     // read fractional part
     if (*s == '.')
     {
         ++s;
+        const char* fractionBegin = s;
 
         while (unsigned(*s - '0') < 10)
         {
-            result = result * 10 + (double)(*s - '0');
+            mantissa = mantissa * 10 + (*s - '0');
             ++s;
-            --power;
         }
+        power = -int(s - fractionBegin);
+        numDigits -= power;
     }
 
-    // read exponent part
-    // NOTE: bitwise OR with ' ' will transform an uppercase char 
-    // to lowercase while leaving lowercase chars unchanged
-    if ((*s | ' ') == 'e')
-    {
-        ++s;
-
-        // read exponent sign
-        int expSign = (*s == '-') ? -1 : 1;
-        if(*s == '-' || *s == '+') 
-            ++s;
-
-        // read exponent
-        int expPower = 0;
-        while (unsigned(*s - '0') < 10)
-        {
-            expPower = expPower * 10 + (*s - '0');
-            ++s;
-        }
+    // NOTE: 19 digits always fit in 64 bits, with more the mantissa may have overflowed
+    if (numDigits > 19)
+        return parseLongFloat(begin, digits, integerEnd, s, end);
 
-        power += expSign * expPower;
-    }
+    // read exponent part
+    if (isExponent(*s))
+        power += parseExponent(s, &s);
 
     // return end-of-string
     *end = s;
 
-    // note: this is precise if result < 9e15
-    // for longer inputs we lose a bit of precision here
-    if (unsigned(-power) < sizeof(powers) / sizeof(powers[0]))
-        return float(sign * result / powers[-power]);
-    else if (unsigned(power) < sizeof(powers) / sizeof(powers[0]))
-        return float(sign * result * powers[power]);
+    float result;
+    if(mantissa == 0)
+    {
+        result = 0.f;
+    }
+    else if(mantissa <= (1ull << 53) && power >= -22 && power <= 22)
+    {
+        // NOTE: Fast path for most numbers in .obj files: the mantissa and
+        // power of ten are both exact doubles, so one multiply or divide 
+        // gives the correctly rounded double. Rounding that to float again
+        // is only wrong if the double landed exactly halfway between two
+        // floats, i.e. its 29 extra mantissa bits are 0x10000000.
+        // Converting from int64_t is cheaper than uint64_t on x86.
+        double m = double(int64_t(mantissa));
+        double d = (power < 0) ? m / powers[-power] : m * powers[power];
+        uint64_t dBits;
+        memcpy(&dBits, &d, sizeof(dBits));
+        if((dBits & 0x1FFFFFFF) != 0x10000000) {
+            result = float(d);
+        }
+        else {
+            uint32_t bits = decimalToFloatBits(mantissa, power);
+            memcpy(&result, &bits, sizeof(result));
+        }
+    }
     else
-        return float(sign * result * pow(10.0, power));
+    {
+        uint32_t bits = decimalToFloatBits(mantissa, power);
+        memcpy(&result, &bits, sizeof(result));
+    }
+
+    return isNegative ? -result : result;
 }
 
 static const char* parseFaceElement(const char* s, int& vi, int& vti, int& vni)
@@ -136,9 +429,155 @@ static int fixupIndex(int index, size_t size)
     return (index >= 0) ? index - 1 : int(size) + index;
 }
 
-static bool areAlmostEqual(float a, float b)
+// Vertices whose attributes differ by less than this are welded
+// together when loading with ObjLoadFlag_MergeByValue
+#define OBJ_WELD_EPSILON 0.00001f
+
+static uint32_t quantiseFloat(float f)
+{
+    // Snap to a grid with spacing OBJ_WELD_EPSILON so values that are
+    // almost equal produce identical keys. Adding 0 folds -0 into +0.
+    float snapped = rintf(f * (1.f / OBJ_WELD_EPSILON)) + 0.f;
+    uint32_t bits;
+    memcpy(&bits, &snapped, sizeof(bits));
+    return bits;
+}
+
+// Key used to decide whether two face corners refer to the same vertex.
+// Either holds the (vp, vt, vn) index triple or the quantised attribute
+// values, depending on ObjLoadFlag_MergeByValue. Unused words are zero.
+// The last word is set for faces whose uvs are mirrored, when
+// generating tangents, see addFace().
+#define VERTEX_KEY_NUM_WORDS 9
+struct VertexKey
+{
+    uint32_t words[VERTEX_KEY_NUM_WORDS];
+};
+
+static uint32_t hashVertexKey(const VertexKey* key)
+{
+    // Murmur-style mixing of each word into the running hash
+    uint32_t h = 0x9747b28c;
+    for(int i=0; i<VERTEX_KEY_NUM_WORDS; ++i)
+    {
+        uint32_t k = key->words[i] * 0xcc9e2d51;
+        k = (k << 15) | (k >> 17);
+        h ^= k * 0x1b873593;
+        h = ((h << 13) | (h >> 19)) * 5 + 0xe6546b64;
+    }
+    h ^= h >> 16;
+    h *= 0x85ebca6b;
+    h ^= h >> 13;
+    return h;
+}
+
+// loadObj() allocates from the caller's MemoryArena if it's given one,
+// otherwise with malloc(). Outputs are pushed onto the start of the arena,
+// scratch space onto the end, which is all freed at once when it's done.
+static void* allocObjOutput(MemoryArena* arena, size_t numBytes)
+{
+    void* result = arena ? pushSize(arena, numBytes) : malloc(numBytes);
+    assert(result || numBytes == 0);
+    return result;
+}
+
+static void* allocObjScratch(MemoryArena* arena, size_t numBytes)
+{
+    void* result = arena ? pushScratchSize(arena, numBytes) : malloc(numBytes);
+    assert(result || numBytes == 0);
+    return result;
+}
+
+static void freeObjScratch(MemoryArena* arena, void* memory)
+{
+    if(!arena)
+        free(memory);
+}
+
+// Gives back the end of the most recent output allocation
+static void* shrinkObjOutput(MemoryArena* arena, void* memory, size_t numBytes, size_t newNumBytes)
+{
+    assert(newNumBytes <= numBytes);
+    if(arena) {
+        popSize(arena, numBytes - newNumBytes);
+        return memory;
+    }
+    if(newNumBytes == 0)
+        return memory; // Don't let realloc() free it
+    return realloc(memory, newNumBytes);
+}
+
+// Open-addressing hash table mapping VertexKeys to indices in the
+// output vertex buffer. The keys themselves live in a separate array
+// indexed by vertex, slots only store the index and the cached hash.
+struct VertexHashSlot
+{
+    uint32_t vertexIndex;
+    uint32_t hash;
+};
+
+#define VERTEX_HASH_EMPTY_SLOT 0xFFFFFFFF
+
+struct VertexHashTable
+{
+    VertexHashSlot* slots;
+    size_t capacity; // Always a power of two
+    size_t numEntries;
+};
+
+// NOTE: Tables only grow once there are more than expectedNumEntries,
+// which must never happen for tables allocated from an arena
+static void initVertexHashTable(VertexHashTable* table, size_t expectedNumEntries, MemoryArena* arena)
+{
+    // Keep load factor at or below 0.5 so probe sequences stay short
+    size_t capacity = 64;
+    while(capacity < 2 * expectedNumEntries)
+        capacity *= 2;
+
+    table->slots = (VertexHashSlot*)allocObjScratch(arena, capacity * sizeof(VertexHashSlot));
+    memset(table->slots, 0xFF, capacity * sizeof(VertexHashSlot));
+    table->capacity = capacity;
+    table->numEntries = 0;
+}
+
+static void growVertexHashTable(VertexHashTable* table)
+{
+    VertexHashSlot* oldSlots = table->slots;
+    size_t oldCapacity = table->capacity;
+
+    table->capacity *= 2;
+    table->slots = (VertexHashSlot*)malloc(table->capacity * sizeof(VertexHashSlot));
+    assert(table->slots);
+    memset(table->slots, 0xFF, table->capacity * sizeof(VertexHashSlot));
+
+    size_t mask = table->capacity - 1;
+    for(size_t i=0; i<oldCapacity; ++i)
+    {
+        if(oldSlots[i].vertexIndex == VERTEX_HASH_EMPTY_SLOT)
+            continue;
+        size_t slot = oldSlots[i].hash & mask;
+        while(table->slots[slot].vertexIndex != VERTEX_HASH_EMPTY_SLOT)
+            slot = (slot + 1) & mask;
+        table->slots[slot] = oldSlots[i];
+    }
+    free(oldSlots);
+}
+
+// Returns the slot holding 'key', or the empty slot where it should be inserted
+static VertexHashSlot* findVertexHashSlot(VertexHashTable* table, const VertexKey* keys, const VertexKey* key, uint32_t hash)
 {
-    return (fabs(a-b) < 0.00001f);
+    size_t mask = table->capacity - 1;
+    size_t slot = hash & mask;
+    while(true)
+    {
+        VertexHashSlot* s = table->slots + slot;
+        if(s->vertexIndex == VERTEX_HASH_EMPTY_SLOT)
+            return s;
+        if(s->hash == hash && memcmp(keys + s->vertexIndex, key, sizeof(VertexKey)) == 0)
+            return s;
+        // Linear probing
+        slot = (slot + 1) & mask;
+    }
 }
 
 static void growArray(void** array, size_t* capacity, size_t itemSize)
@@ -148,62 +587,242 @@ static void growArray(void** array, size_t* capacity, size_t itemSize)
     assert(*array);
 }
 
-LoadedObj loadObj(const char* filename)
+// A face corner's attribute indices, already converted to be 0-based.
+// Missing texture coordinate/normal indices are -1.
+struct FaceCorner
 {
-    LoadedObj result = {};
+    int32_t vp, vt, vn;
+    uint16_t smoothing;
+    // Number of corners in the face, only set on the face's first corner
+    uint16_t faceNumCorners;
+};
 
-    int file = open(filename, O_RDONLY);
-    if (file < 0)
-        return result;
-    
-    struct stat fs;
-    fstat(file, &fs);
+#define OBJ_SMOOTHING_OFF 0
+#define OBJ_SMOOTHING_ON 1
+// Smoothing state before a chunk's first 's' statement depends on
+// earlier chunks, so it's resolved when the chunks are stitched together
+#define OBJ_SMOOTHING_INHERIT 2
 
-    uint32_t fileNumBytes = fs.st_size;
+#define OBJ_MAX_FACE_CORNERS 0xFFFF
+// Faces with more corners than this are always fan triangulated
+#define OBJ_MAX_EAR_CLIPPING_CORNERS 64
 
-    const char* fileBytes = (const char*)mmap(0, fileNumBytes, PROT_READ, MAP_PRIVATE, file, 0);
-    
-    if (fileBytes == (void*)-1)
-        return result;
+// Don't bother splitting files into chunks smaller than this
+#define OBJ_MIN_CHUNK_NUM_BYTES (256 * 1024)
+// Chunks can't be bigger than this, so offsets within them fit in 32 bits
+#define OBJ_MAX_CHUNK_NUM_BYTES (1024 * 1024 * 1024)
 
-    uint32_t numVertexPositions = 0;
-    uint32_t numVertexTexCoords = 0;
-    uint32_t numVertexNormals = 0;
-    uint32_t numFaces = 0;
+// A name from a statement like usemtl, pointing into the .obj file
+struct ObjName
+{
+    const char* chars;
+    uint32_t length;
+};
 
-    const char* s = fileBytes;
-    while(s < fileBytes + fileNumBytes)
+// A usemtl statement, which applies to the faces from corner cornerIndex on
+struct ObjMaterialSwitch
+{
+    size_t cornerIndex;
+    ObjName materialName;
+};
+
+// A range of whole lines from the .obj file. When loading with a
+// ThreadPool each chunk is counted and parsed by a separate job.
+struct ObjChunk
+{
+    const char* begin;
+    const char* end;
+
+    // Filled in by countObjChunk()
+    uint32_t numVertexPositions;
+    uint32_t numVertexTexCoords;
+    uint32_t numVertexNormals;
+    uint32_t numFaces;
+    // Offsets from 'begin' to the start of every v/vt/vn/f/s/usemtl/mtllib
+    // line, so the parse pass can skip straight to the lines it cares about
+    uint32_t* lineOffsets;
+    size_t numLines;
+    size_t lineCapacity;
+
+    // Sums of the counts of all preceding chunks, so each chunk knows
+    // where to write its attributes and can resolve relative indices
+    uint32_t firstVertexPosition;
+    uint32_t firstVertexTexCoord;
+    uint32_t firstVertexNormal;
+
+    // Attribute buffers for the whole file, shared between chunks
+    float* vpBuffer;
+    float* vtBuffer;
+    float* vnBuffer;
+
+    // Filled in by parseObjChunk()
+    FaceCorner* corners;
+    size_t numCorners;
+    size_t cornerCapacity;
+    size_t numTriangles;
+    uint32_t smoothingAtEnd;
+    ObjMaterialSwitch* materialSwitches;
+    size_t numMaterialSwitches;
+    size_t materialSwitchCapacity;
+    // Arguments of mtllib statements, which can name several files
+    ObjName* materialLibraries;
+    size_t numMaterialLibraries;
+    size_t materialLibraryCapacity;
+};
+
+// Finding line starts is the bulk of the counting pass, so it's done
+// OBJ_SCAN_WIDTH bytes at a time. findNewlines() returns a mask with
+// OBJ_SCAN_MATCH_BITS set at position (i * OBJ_SCAN_BITS_PER_BYTE) 
+// for every byte s[i] that is a newline.
+#if defined(__AVX2__)
+#define OBJ_SCAN_WIDTH 32
+#define OBJ_SCAN_BITS_PER_BYTE 1
+#define OBJ_SCAN_MATCH_BITS 0x1ull
+static inline uint64_t findNewlines(const char* s)
+{
+    __m256i bytes = _mm256_loadu_si256((const __m256i*)s);
+    __m256i isNewline = _mm256_cmpeq_epi8(bytes, _mm256_set1_epi8('\n'));
+    return (uint32_t)_mm256_movemask_epi8(isNewline);
+}
+#elif defined(__SSE2__)
+#define OBJ_SCAN_WIDTH 16
+#define OBJ_SCAN_BITS_PER_BYTE 1
+#define OBJ_SCAN_MATCH_BITS 0x1ull
+static inline uint64_t findNewlines(const char* s)
+{
+    __m128i bytes = _mm_loadu_si128((const __m128i*)s);
+    __m128i isNewline = _mm_cmpeq_epi8(bytes, _mm_set1_epi8('\n'));
+    return (uint32_t)_mm_movemask_epi8(isNewline);
+}
+#elif defined(__ARM_NEON)
+#define OBJ_SCAN_WIDTH 16
+// NEON has no movemask, narrowing the comparison result 
+// gives us a nibble per byte instead
+#define OBJ_SCAN_BITS_PER_BYTE 4
+#define OBJ_SCAN_MATCH_BITS 0xFull
+static inline uint64_t findNewlines(const char* s)
+{
+    uint8x16_t bytes = vld1q_u8((const uint8_t*)s);
+    uint8x16_t isNewline = vceqq_u8(bytes, vdupq_n_u8('\n'));
+    uint8x8_t nibbles = vshrn_n_u16(vreinterpretq_u16_u8(isNewline), 4);
+    return vget_lane_u64(vreinterpret_u64_u8(nibbles), 0);
+}
+#else
+#define OBJ_SCAN_WIDTH 8
+#define OBJ_SCAN_BITS_PER_BYTE 1
+#define OBJ_SCAN_MATCH_BITS 0x1ull
+static inline uint64_t findNewlines(const char* s)
+{
+    uint64_t mask = 0;
+    for(int i=0; i<OBJ_SCAN_WIDTH; ++i)
+        mask |= (uint64_t)(s[i] == '\n') << i;
+    return mask;
+}
+#endif
+
+// Counts the line starting at 's' and records its offset if it's
+// a statement the parse pass handles
+static inline void classifyObjLine(ObjChunk* chunk, const char* s)
+{
+    if(*s == 'v'){
+        if(s + 1 >= chunk->end) return;
+        char c = *(s+1);
+        if(c == ' ') ++chunk->numVertexPositions;
+        else if(c == 't') ++chunk->numVertexTexCoords;
+        else if(c == 'n') ++chunk->numVertexNormals;
+        else return;
+    }
+    else if(*s == 'f') ++chunk->numFaces;
+    // NOTE: The parse pass checks for "usemtl" and "mtllib" properly
+    else if(*s != 's' && *s != 'u' && *s != 'm') return;
+
+    if(chunk->numLines + 1 > chunk->lineCapacity){
+        growArray((void**)(&chunk->lineOffsets), &chunk->lineCapacity, sizeof(uint32_t));
+    }
+    chunk->lineOffsets[chunk->numLines++] = (uint32_t)(s - chunk->begin);
+}
+
+static void countObjChunk(void* userData)
+{
+    ObjChunk* chunk = (ObjChunk*)userData;
+
+    if(chunk->begin < chunk->end)
+        classifyObjLine(chunk, chunk->begin);
+
+    const char* s = chunk->begin;
+    for(; s + OBJ_SCAN_WIDTH <= chunk->end; s += OBJ_SCAN_WIDTH)
     {
-        if(*s == 'v'){
-            ++s;
-            if(*s == ' ') ++numVertexPositions;
-            else if(*s == 't') ++numVertexTexCoords;
-            else if(*s == 'n') ++numVertexNormals;
+        uint64_t newlineMask = findNewlines(s);
+        while(newlineMask)
+        {
+            int bitIndex = __builtin_ctzll(newlineMask);
+            newlineMask &= ~(OBJ_SCAN_MATCH_BITS << bitIndex);
+
+            const char* lineStart = s + (bitIndex / OBJ_SCAN_BITS_PER_BYTE) + 1;
+            if(lineStart < chunk->end)
+                classifyObjLine(chunk, lineStart);
         }
-        else if(*s == 'f') ++numFaces;
+    }
+    // Handle the leftover bytes that don't fill a whole SIMD register
+    for(; s < chunk->end; ++s)
+    {
+        if(*s == '\n' && s + 1 < chunk->end)
+            classifyObjLine(chunk, s + 1);
+    }
+}
 
-        while(*s != 0 && *s++ != '\n');
+// Returns true if the line at 's' starts with 'keyword' followed by whitespace
+static bool isObjKeyword(const char* s, const char* end, const char* keyword)
+{
+    for(; *keyword; ++keyword, ++s) {
+        if(s >= end || *s != *keyword)
+            return false;
     }
+    return s < end && (*s == ' ' || *s == '\t');
+}
 
-    float* vpBuffer = (float*)malloc(numVertexPositions * 3 * sizeof(float));
-    float* vtBuffer = (float*)malloc(numVertexTexCoords * 2 * sizeof(float));
-    float* vnBuffer = (float*)malloc(numVertexNormals * 3 * sizeof(float));
-    float* vpIt = vpBuffer;
-    float* vtIt = vtBuffer;
-    float* vnIt = vnBuffer;
+// Reads the rest of the line at 's', without surrounding whitespace
+static ObjName parseObjName(const char* s, const char* end)
+{
+    while(s < end && (*s == ' ' || *s == '\t'))
+        ++s;
+    const char* nameEnd = s;
+    while(nameEnd < end && *nameEnd != '\n' && *nameEnd != '\r')
+        ++nameEnd;
+    while(nameEnd > s && (*(nameEnd-1) == ' ' || *(nameEnd-1) == '\t'))
+        --nameEnd;
 
-    size_t vertexBufferCapacity = 0;
-    size_t indexBufferCapacity = 0;
-    size_t vertexBufferSize = 0;
-    size_t indexBufferSize = 0;
-    VertexData* outVertexBuffer = NULL;
-    uint16_t* outIndexBuffer = NULL;
+    ObjName result = {s, (uint32_t)(nameEnd - s)};
+    return result;
+}
+
+static void parseObjChunk(void* userData)
+{
+    ObjChunk* chunk = (ObjChunk*)userData;
+
+    float* vpIt = chunk->vpBuffer + 3 * chunk->firstVertexPosition;
+    float* vtIt = chunk->vtBuffer + 2 * chunk->firstVertexTexCoord;
+    float* vnIt = chunk->vnBuffer + 3 * chunk->firstVertexNormal;
 
-    bool smoothNormals = false;
+    // Number of each attribute seen so far in the file, 
+    // used to resolve relative (negative) face indices
+    uint32_t numVertexPositions = chunk->firstVertexPosition;
+    uint32_t numVertexTexCoords = chunk->firstVertexTexCoord;
+    uint32_t numVertexNormals = chunk->firstVertexNormal;
 
-    s = fileBytes;
-    while(s < fileBytes + fileNumBytes)
+    // Assume mostly triangles to avoid regrowing the corner array
+    chunk->cornerCapacity = 0;
+    if(chunk->numFaces > 0){
+        chunk->cornerCapacity = 3 * chunk->numFaces;
+        chunk->corners = (FaceCorner*)malloc(chunk->cornerCapacity * sizeof(FaceCorner));
+        assert(chunk->corners);
+    }
+
+    uint32_t smoothing = OBJ_SMOOTHING_INHERIT;
+
+    for(size_t lineIndex=0; lineIndex<chunk->numLines; ++lineIndex)
     {
+        const char* s = chunk->begin + chunk->lineOffsets[lineIndex];
         char currChar = *s;
         if(currChar == 'v'){
             ++s;
@@ -212,113 +831,1616 @@ LoadedObj loadObj(const char* filename)
                 *vpIt++ = parseFloat(s, &s);
                 *vpIt++ = parseFloat(s, &s);
                 *vpIt++ = parseFloat(s, &s);
+                ++numVertexPositions;
             }
             else if(currChar == 't'){
                 *vtIt++ = parseFloat(s, &s);
                 *vtIt++ = parseFloat(s, &s);
+                ++numVertexTexCoords;
             }
             else if(currChar == 'n'){
                 *vnIt++ = parseFloat(s, &s);
                 *vnIt++ = parseFloat(s, &s);
                 *vnIt++ = parseFloat(s, &s);
+                ++numVertexNormals;
             }
         }
         else if(currChar == 'f')
         {
             ++s;
-            while(*s != '\n')
+            size_t firstCorner = chunk->numCorners;
+            while(true)
             {
+                while (*s == ' ' || *s == '\t')
+                    ++s;
+                if(s >= chunk->end || *s == '\n' || *s == '\r')
+                    break;
+
                 int vpIdx = 0, vtIdx = 0, vnIdx = 0;
                 s = parseFaceElement(s, vpIdx, vtIdx, vnIdx);
                 assert(vpIdx != 0);
 
-                vpIdx = fixupIndex(vpIdx, numVertexPositions);
-                vtIdx = fixupIndex(vtIdx, numVertexTexCoords);
-                vnIdx = fixupIndex(vnIdx, numVertexNormals);
-                
-                VertexData newVert = {
-                    vpBuffer[3*vpIdx], vpBuffer[3*vpIdx+1], vpBuffer[3*vpIdx+2],
-                    vtBuffer[2*vtIdx], vtBuffer[2*vtIdx+1],
-                    vnBuffer[3*vnIdx], vnBuffer[3*vnIdx+1], vnBuffer[3*vnIdx+2],
-                };
-
-                // Search vertexBuffer for matching vertex
-                int index;
-                for(index=0; index<vertexBufferSize; ++index) 
-                {
-                    VertexData* v = outVertexBuffer + index;
-                    bool posMatch = areAlmostEqual(v->pos[0], newVert.pos[0])
-                                 && areAlmostEqual(v->pos[1], newVert.pos[1])
-                                 && areAlmostEqual(v->pos[2], newVert.pos[2]);
-                    bool uvMatch = areAlmostEqual(v->uv[0], newVert.uv[0])
-                                && areAlmostEqual(v->uv[1], newVert.uv[1]);
-                    bool normMatch = areAlmostEqual(v->norm[0], newVert.norm[0])
-                                  && areAlmostEqual(v->norm[1], newVert.norm[1])
-                                  && areAlmostEqual(v->norm[2], newVert.norm[2]);
-                    if(posMatch && uvMatch)
-                    {
-                        if(normMatch || smoothNormals){
-                            v->norm[0] += newVert.norm[0];
-                            v->norm[1] += newVert.norm[1];
-                            v->norm[2] += newVert.norm[2];
-                            break;
-                        }
-                    }
+                if(chunk->numCorners + 1 > chunk->cornerCapacity){
+                    growArray((void**)(&chunk->corners), &chunk->cornerCapacity, sizeof(FaceCorner));
                 }
-                if(index == vertexBufferSize){
-                    if(vertexBufferSize + 1 > vertexBufferCapacity){
-                        growArray((void**)(&outVertexBuffer), &vertexBufferCapacity, sizeof(VertexData));
-                    }
-                    outVertexBuffer[vertexBufferSize++] = newVert;
-                }
-                if(indexBufferSize + 1 > indexBufferCapacity){
-                        growArray((void**)(&outIndexBuffer), &indexBufferCapacity, sizeof(uint16_t));
-                }
-                outIndexBuffer[indexBufferSize++] = index;
+                FaceCorner* corner = chunk->corners + chunk->numCorners++;
+                corner->vp = fixupIndex(vpIdx, numVertexPositions);
+                corner->vt = fixupIndex(vtIdx, numVertexTexCoords);
+                corner->vn = fixupIndex(vnIdx, numVertexNormals);
+                corner->smoothing = smoothing;
+                corner->faceNumCorners = 0;
+            }
+
+            size_t faceNumCorners = chunk->numCorners - firstCorner;
+            if(faceNumCorners < 3 || faceNumCorners > OBJ_MAX_FACE_CORNERS) {
+                // Not a polygon we can do anything with, skip it
+                chunk->numCorners = firstCorner;
+            }
+            else {
+                chunk->corners[firstCorner].faceNumCorners = (uint16_t)faceNumCorners;
+                chunk->numTriangles += faceNumCorners - 2;
+            }
+        }
+        else if(isObjKeyword(s, chunk->end, "usemtl"))
+        {
+            if(chunk->numMaterialSwitches + 1 > chunk->materialSwitchCapacity){
+                growArray((void**)(&chunk->materialSwitches), &chunk->materialSwitchCapacity, sizeof(ObjMaterialSwitch));
+            }
+            ObjMaterialSwitch* materialSwitch = chunk->materialSwitches + chunk->numMaterialSwitches++;
+            materialSwitch->cornerIndex = chunk->numCorners;
+            materialSwitch->materialName = parseObjName(s + 6, chunk->end);
+        }
+        else if(isObjKeyword(s, chunk->end, "mtllib"))
+        {
+            if(chunk->numMaterialLibraries + 1 > chunk->materialLibraryCapacity){
+                growArray((void**)(&chunk->materialLibraries), &chunk->materialLibraryCapacity, sizeof(ObjName));
             }
+            chunk->materialLibraries[chunk->numMaterialLibraries++] = parseObjName(s + 6, chunk->end);
         }
         else if(currChar == 's' && *(++s) == ' ')
         {
             ++s;
             if((*s == 'o' && *(s+1) == 'f' && *(s+2) == 'f') || *s == '0')
-                smoothNormals = false;
+                smoothing = OBJ_SMOOTHING_OFF;
             else {
                 assert((*s == 'o' && *(s+1) == 'n') || (*s >= '1'&& *s <= '9'));
-                smoothNormals = true;
+                smoothing = OBJ_SMOOTHING_ON;
             }
         }
-        
-        while(*s != 0 && *s++ != '\n');
     }
 
-    // Normalise the normals
-    for(int i=0; i<vertexBufferSize; ++i){
-        VertexData* v = outVertexBuffer + i;
-        float normLength = sqrtf(v->norm[0]*v->norm[0] 
-                         + v->norm[1]*v->norm[1]
-                         + v->norm[2]*v->norm[2]);
-        float invNormLength = 1.f / normLength;
-        v->norm[0] *= invNormLength;
-        v->norm[1] *= invNormLength;
-        v->norm[2] *= invNormLength;
+    chunk->smoothingAtEnd = smoothing;
+}
+
+// Turns face corners into unique vertices
+struct VertexBuilder
+{
+    uint32_t flags;
+    const float* vpBuffer;
+    const float* vtBuffer;
+    const float* vnBuffer;
+
+    VertexData* vertices;
+    // Only with ObjLoadFlag_GenerateTangents. Accumulates the tangents of
+    // the triangles around each vertex, see finaliseTangents().
+    VertexTangent* tangents;
+    VertexKey* keys;
+    size_t numVertices;
+    VertexHashTable hashTable;
+};
+
+// Returns the index of the vertex for 'corner', adding a new one
+// to the builder if there isn't a matching vertex already
+static uint32_t addFaceCorner(VertexBuilder* builder, const FaceCorner* corner, bool smoothNormals, bool isUvMirrored)
+{
+    VertexData newVert = {};
+    memcpy(newVert.pos, builder->vpBuffer + 3*corner->vp, sizeof(newVert.pos));
+    if(corner->vt >= 0)
+        memcpy(newVert.uv, builder->vtBuffer + 2*corner->vt, sizeof(newVert.uv));
+    if(corner->vn >= 0)
+        memcpy(newVert.norm, builder->vnBuffer + 3*corner->vn, sizeof(newVert.norm));
+
+    VertexKey key = {};
+    if(builder->flags & ObjLoadFlag_MergeByValue)
+    {
+        key.words[0] = quantiseFloat(newVert.pos[0]);
+        key.words[1] = quantiseFloat(newVert.pos[1]);
+        key.words[2] = quantiseFloat(newVert.pos[2]);
+        key.words[3] = quantiseFloat(newVert.uv[0]);
+        key.words[4] = quantiseFloat(newVert.uv[1]);
+        if(smoothNormals){
+            // Normals get averaged so they shouldn't prevent a merge
+            key.words[5] = key.words[6] = key.words[7] = VERTEX_HASH_EMPTY_SLOT;
+        }
+        else {
+            key.words[5] = quantiseFloat(newVert.norm[0]);
+            key.words[6] = quantiseFloat(newVert.norm[1]);
+            key.words[7] = quantiseFloat(newVert.norm[2]);
+        }
+    }
+    else
+    {
+        key.words[0] = corner->vp;
+        key.words[1] = corner->vt;
+        // Normals get averaged so they shouldn't prevent a merge
+        key.words[2] = smoothNormals ? VERTEX_HASH_EMPTY_SLOT : corner->vn;
     }
+    key.words[VERTEX_KEY_NUM_WORDS - 1] = isUvMirrored;
+    uint32_t hash = hashVertexKey(&key);
 
-    free(vpBuffer);
-    free(vtBuffer);
-    free(vnBuffer);
-    munmap((void*)fileBytes, fileNumBytes);
-    close(file);
+    // Search vertexBuffer for matching vertex
+    VertexHashSlot* slot = findVertexHashSlot(&builder->hashTable, builder->keys, &key, hash);
+    uint32_t index = slot->vertexIndex;
+    if(index != VERTEX_HASH_EMPTY_SLOT)
+    {
+        VertexData* v = builder->vertices + index;
+        v->norm[0] += newVert.norm[0];
+        v->norm[1] += newVert.norm[1];
+        v->norm[2] += newVert.norm[2];
+        return index;
+    }
 
-    result.numVertices = vertexBufferSize;
-    result.numIndices = indexBufferSize;
-    result.vertexBuffer = outVertexBuffer;
-    result.indexBuffer = outIndexBuffer;
+    index = builder->numVertices++;
+    slot->vertexIndex = index;
+    slot->hash = hash;
+    builder->vertices[index] = newVert;
+    builder->keys[index] = key;
+    if(builder->tangents)
+    {
+        VertexTangent* t = builder->tangents + index;
+        t->tangent[0] = t->tangent[1] = t->tangent[2] = 0.f;
+        t->bitangentSign = isUvMirrored ? -1.f : 1.f;
+    }
 
-    return result;
+    if(++builder->hashTable.numEntries * 2 > builder->hashTable.capacity)
+        growVertexHashTable(&builder->hashTable);
+
+    return index;
 }
 
-void freeLoadedObj(LoadedObj loadedObj)
+// Twice the signed area of 2D triangle abc, positive if counter-clockwise
+static float signedArea2D(const float* a, const float* b, const float* c)
+{
+    return (b[0] - a[0]) * (c[1] - a[1]) - (b[1] - a[1]) * (c[0] - a[0]);
+}
+
+// Triangulates a polygon face with 'numCorners' <= OBJ_MAX_EAR_CLIPPING_CORNERS,
+// writing 3 * (numCorners - 2) indices to 'outIndices'. Convex faces are fan
+// triangulated, concave ones are ear clipped. Triangles keep the face's winding.
+static void triangulateFace(const float* vpBuffer, const FaceCorner* corners, const uint32_t* cornerVertexIndices, 
+                            uint32_t numCorners, uint32_t* outIndices)
 {
-    free(loadedObj.vertexBuffer);
-    free(loadedObj.indexBuffer);
+    assert(numCorners >= 3 && numCorners <= OBJ_MAX_EAR_CLIPPING_CORNERS);
+
+    // Project the face onto the plane its normal is most aligned with.
+    // Newell's method gives a robust normal even for concave faces.
+    float normal[3] = {};
+    for(uint32_t i=0; i<numCorners; ++i)
+    {
+        const float* a = vpBuffer + 3*corners[i].vp;
+        const float* b = vpBuffer + 3*corners[(i+1) % numCorners].vp;
+        normal[0] += (a[1] - b[1]) * (a[2] + b[2]);
+        normal[1] += (a[2] - b[2]) * (a[0] + b[0]);
+        normal[2] += (a[0] - b[0]) * (a[1] + b[1]);
+    }
+    int dropAxis = 0;
+    if(fabsf(normal[1]) > fabsf(normal[dropAxis])) dropAxis = 1;
+    if(fabsf(normal[2]) > fabsf(normal[dropAxis])) dropAxis = 2;
+    int uAxis = (dropAxis + 1) % 3;
+    int vAxis = (dropAxis + 2) % 3;
+    // Flip so the face is always counter-clockwise in 2D
+    float windingSign = (normal[dropAxis] < 0.f) ? -1.f : 1.f;
+
+    float positions2D[OBJ_MAX_EAR_CLIPPING_CORNERS][2];
+    for(uint32_t i=0; i<numCorners; ++i)
+    {
+        const float* p = vpBuffer + 3*corners[i].vp;
+        positions2D[i][0] = p[uAxis];
+        positions2D[i][1] = p[vAxis] * windingSign;
+    }
+
+    bool isConvex = true;
+    for(uint32_t i=0; i<numCorners && isConvex; ++i)
+    {
+        const float* a = positions2D[(i + numCorners - 1) % numCorners];
+        const float* b = positions2D[i];
+        const float* c = positions2D[(i + 1) % numCorners];
+        isConvex = signedArea2D(a, b, c) >= 0.f;
+    }
+
+    if(isConvex)
+    {
+        for(uint32_t i=1; i+1<numCorners; ++i)
+        {
+            *outIndices++ = cornerVertexIndices[0];
+            *outIndices++ = cornerVertexIndices[i];
+            *outIndices++ = cornerVertexIndices[i+1];
+        }
+        return;
+    }
+
+    // Ear clipping: repeatedly cut off a convex corner whose
+    // triangle doesn't contain any of the remaining corners
+    uint8_t prev[OBJ_MAX_EAR_CLIPPING_CORNERS];
+    uint8_t next[OBJ_MAX_EAR_CLIPPING_CORNERS];
+    for(uint32_t i=0; i<numCorners; ++i)
+    {
+        prev[i] = (uint8_t)((i + numCorners - 1) % numCorners);
+        next[i] = (uint8_t)((i + 1) % numCorners);
+    }
+
+    uint32_t numRemaining = numCorners;
+    uint32_t curr = 0;
+    uint32_t numCornersSinceLastEar = 0;
+    while(numRemaining > 3)
+    {
+        uint32_t p = prev[curr];
+        uint32_t n = next[curr];
+        const float* a = positions2D[p];
+        const float* b = positions2D[curr];
+        const float* c = positions2D[n];
+
+        bool isEar = signedArea2D(a, b, c) > 0.f;
+        for(uint32_t i=next[n]; isEar && i!=p; i=next[i])
+        {
+            const float* q = positions2D[i];
+            isEar = !(signedArea2D(a, b, q) >= 0.f 
+                   && signedArea2D(b, c, q) >= 0.f 
+                   && signedArea2D(c, a, q) >= 0.f);
+        }
+
+        // If we've gone all the way round without finding an ear the
+        // face is self-intersecting or degenerate, clip anyway so we finish
+        if(isEar || numCornersSinceLastEar > numRemaining)
+        {
+            *outIndices++ = cornerVertexIndices[p];
+            *outIndices++ = cornerVertexIndices[curr];
+            *outIndices++ = cornerVertexIndices[n];
+            next[p] = (uint8_t)n;
+            prev[n] = (uint8_t)p;
+            --numRemaining;
+            numCornersSinceLastEar = 0;
+            curr = n;
+        }
+        else
+        {
+            ++numCornersSinceLastEar;
+            curr = n;
+        }
+    }
+    *outIndices++ = cornerVertexIndices[prev[curr]];
+    *outIndices++ = cornerVertexIndices[curr];
+    *outIndices++ = cornerVertexIndices[next[curr]];
+}
+
+// Returns true if the face's uvs wind the opposite way to its positions,
+// i.e. the texture is mirrored across it
+static bool isFaceUvMirrored(const VertexBuilder* builder, const FaceCorner* faceCorners)
+{
+    // Shoelace formula for twice the signed area of the uv polygon
+    static const float noUv[2] = {};
+    uint32_t faceNumCorners = faceCorners->faceNumCorners;
+    float uvArea = 0.f;
+    for(uint32_t i=0; i<faceNumCorners; ++i)
+    {
+        const FaceCorner* a = faceCorners + i;
+        const FaceCorner* b = faceCorners + (i+1) % faceNumCorners;
+        const float* uvA = (a->vt >= 0) ? builder->vtBuffer + 2*a->vt : noUv;
+        const float* uvB = (b->vt >= 0) ? builder->vtBuffer + 2*b->vt : noUv;
+        uvArea += uvA[0] * uvB[1] - uvB[0] * uvA[1];
+    }
+    return uvArea < 0.f;
+}
+
+// Adds triangle abc's tangent to each of its vertices' sums, weighted by
+// the angle at that corner like MikkTSpace does, so the result doesn't 
+// depend on how the faces around a vertex were triangulated
+static void accumulateTriangleTangent(VertexBuilder* builder, const uint32_t* triangle)
+{
+    const VertexData* v[3] = {
+        builder->vertices + triangle[0], 
+        builder->vertices + triangle[1], 
+        builder->vertices + triangle[2]
+    };
+    float edge1[3], edge2[3];
+    for(int i=0; i<3; ++i){
+        edge1[i] = v[1]->pos[i] - v[0]->pos[i];
+        edge2[i] = v[2]->pos[i] - v[0]->pos[i];
+    }
+    float du1 = v[1]->uv[0] - v[0]->uv[0];
+    float dv1 = v[1]->uv[1] - v[0]->uv[1];
+    float du2 = v[2]->uv[0] - v[0]->uv[0];
+    float dv2 = v[2]->uv[1] - v[0]->uv[1];
+
+    // Solve edge = du * T + dv * B for the direction u increases along
+    float uvArea = du1 * dv2 - du2 * dv1;
+    if(uvArea == 0.f)
+        return; // No uvs, or degenerate in uv space
+    float tangent[3];
+    for(int i=0; i<3; ++i)
+        tangent[i] = (edge1[i] * dv2 - edge2[i] * dv1) / uvArea;
+    float tangentLength = sqrtf(tangent[0]*tangent[0] + tangent[1]*tangent[1] + tangent[2]*tangent[2]);
+    if(tangentLength == 0.f)
+        return;
+
+    for(int c=0; c<3; ++c)
+    {
+        float toNext[3], toPrev[3];
+        for(int i=0; i<3; ++i){
+            toNext[i] = v[(c+1) % 3]->pos[i] - v[c]->pos[i];
+            toPrev[i] = v[(c+2) % 3]->pos[i] - v[c]->pos[i];
+        }
+        float lengths = sqrtf((toNext[0]*toNext[0] + toNext[1]*toNext[1] + toNext[2]*toNext[2])
+                            * (toPrev[0]*toPrev[0] + toPrev[1]*toPrev[1] + toPrev[2]*toPrev[2]));
+        if(lengths == 0.f)
+            continue;
+        float cosAngle = (toNext[0]*toPrev[0] + toNext[1]*toPrev[1] + toNext[2]*toPrev[2]) / lengths;
+        float angle = acosf(fmaxf(-1.f, fminf(1.f, cosAngle)));
+
+        float weight = angle / tangentLength;
+        VertexTangent* t = builder->tangents + triangle[c];
+        t->tangent[0] += tangent[0] * weight;
+        t->tangent[1] += tangent[1] * weight;
+        t->tangent[2] += tangent[2] * weight;
+    }
+}
+
+// Adds the vertices for a face starting at 'faceCorners' to the builder,
+// and writes 3 * (faceNumCorners - 2) triangle indices to 'outIndices'
+static void addFace(VertexBuilder* builder, const FaceCorner* faceCorners, bool smoothNormals, uint32_t* outIndices)
+{
+    uint32_t faceNumCorners = faceCorners->faceNumCorners;
+    // NOTE: Mirrored faces get their own vertices, since a vertex
+    // can only have one bitangent sign
+    bool isUvMirrored = builder->tangents && isFaceUvMirrored(builder, faceCorners);
+    if(faceNumCorners <= OBJ_MAX_EAR_CLIPPING_CORNERS)
+    {
+        uint32_t cornerVertexIndices[OBJ_MAX_EAR_CLIPPING_CORNERS];
+        for(uint32_t i=0; i<faceNumCorners; ++i)
+            cornerVertexIndices[i] = addFaceCorner(builder, faceCorners + i, smoothNormals, isUvMirrored);
+
+        if(faceNumCorners == 3)
+            memcpy(outIndices, cornerVertexIndices, 3 * sizeof(uint32_t));
+        else
+            triangulateFace(builder->vpBuffer, faceCorners, cornerVertexIndices, faceNumCorners, outIndices);
+    }
+    else
+    {
+        // Too big to ear clip, assume it's convex and fan it
+        uint32_t firstVertexIndex = addFaceCorner(builder, faceCorners, smoothNormals, isUvMirrored);
+        uint32_t prevVertexIndex = addFaceCorner(builder, faceCorners + 1, smoothNormals, isUvMirrored);
+        for(uint32_t i=2; i<faceNumCorners; ++i)
+        {
+            uint32_t vertexIndex = addFaceCorner(builder, faceCorners + i, smoothNormals, isUvMirrored);
+            outIndices[3*(i-2)] = firstVertexIndex;
+            outIndices[3*(i-2) + 1] = prevVertexIndex;
+            outIndices[3*(i-2) + 2] = vertexIndex;
+            prevVertexIndex = vertexIndex;
+        }
+    }
+
+    if(builder->tangents)
+    {
+        for(uint32_t i=0; i<faceNumCorners - 2; ++i)
+            accumulateTriangleTangent(builder, outIndices + 3*i);
+    }
+}
+
+static void normaliseNormals(VertexData* vertices, size_t numVertices)
+{
+    for(size_t i=0; i<numVertices; ++i){
+        VertexData* v = vertices + i;
+        float normLength = sqrtf(v->norm[0]*v->norm[0] 
+                         + v->norm[1]*v->norm[1]
+                         + v->norm[2]*v->norm[2]);
+        if(normLength == 0.f)
+            continue; // No normals in file
+        float invNormLength = 1.f / normLength;
+        v->norm[0] *= invNormLength;
+        v->norm[1] *= invNormLength;
+        v->norm[2] *= invNormLength;
+    }
+}
+
+// Turns the tangent sums accumulated by addFace() into unit tangents
+// perpendicular to each vertex's normal. Run this after normaliseNormals().
+static void finaliseTangents(const VertexData* vertices, VertexTangent* tangents, size_t numVertices)
+{
+    for(size_t i=0; i<numVertices; ++i)
+    {
+        const float* n = vertices[i].norm;
+        float* t = tangents[i].tangent;
+
+        // Gram-Schmidt
+        float tDotN = t[0]*n[0] + t[1]*n[1] + t[2]*n[2];
+        t[0] -= n[0] * tDotN;
+        t[1] -= n[1] * tDotN;
+        t[2] -= n[2] * tDotN;
+        float tangentLength = sqrtf(t[0]*t[0] + t[1]*t[1] + t[2]*t[2]);
+        if(tangentLength == 0.f){
+            // No uvs, or the tangent was parallel to the normal. 
+            // Pick any axis so there's still a valid tangent frame.
+            float axis[3] = {0.f, 0.f, 0.f};
+            axis[(fabsf(n[0]) < 0.9f) ? 0 : 1] = 1.f;
+            float axisDotN = axis[0]*n[0] + axis[1]*n[1] + axis[2]*n[2];
+            for(int j=0; j<3; ++j)
+                t[j] = axis[j] - n[j] * axisDotN;
+            tangentLength = sqrtf(t[0]*t[0] + t[1]*t[1] + t[2]*t[2]);
+        }
+        float invTangentLength = 1.f / tangentLength;
+        t[0] *= invTangentLength;
+        t[1] *= invTangentLength;
+        t[2] *= invTangentLength;
+    }
+}
+
+// The SIMD paths load each position as 4 floats, picking up the u after it,
+// and ignore the 4th lane. Vertices are 32 bytes so that's always in bounds.
+static void findPositionBounds(const VertexData* vertices, size_t numVertices, float* outMin, float* outMax)
+{
+    assert(numVertices > 0);
+#if defined(__SSE2__)
+    __m128 boundsMin = _mm_loadu_ps(vertices[0].pos);
+    __m128 boundsMax = boundsMin;
+    for(size_t v=1; v<numVertices; ++v)
+    {
+        __m128 p = _mm_loadu_ps(vertices[v].pos);
+        boundsMin = _mm_min_ps(boundsMin, p);
+        boundsMax = _mm_max_ps(boundsMax, p);
+    }
+    float lanes[2][4];
+    _mm_storeu_ps(lanes[0], boundsMin);
+    _mm_storeu_ps(lanes[1], boundsMax);
+#elif defined(__ARM_NEON)
+    float32x4_t boundsMin = vld1q_f32(vertices[0].pos);
+    float32x4_t boundsMax = boundsMin;
+    for(size_t v=1; v<numVertices; ++v)
+    {
+        float32x4_t p = vld1q_f32(vertices[v].pos);
+        boundsMin = vminq_f32(boundsMin, p);
+        boundsMax = vmaxq_f32(boundsMax, p);
+    }
+    float lanes[2][4];
+    vst1q_f32(lanes[0], boundsMin);
+    vst1q_f32(lanes[1], boundsMax);
+#else
+    float lanes[2][4] = {};
+    memcpy(lanes[0], vertices[0].pos, sizeof(vertices[0].pos));
+    memcpy(lanes[1], vertices[0].pos, sizeof(vertices[0].pos));
+    for(size_t v=1; v<numVertices; ++v) {
+        for(int i=0; i<3; ++i) {
+            lanes[0][i] = fminf(lanes[0][i], vertices[v].pos[i]);
+            lanes[1][i] = fmaxf(lanes[1][i], vertices[v].pos[i]);
+        }
+    }
+#endif
+    memcpy(outMin, lanes[0], 3 * sizeof(float));
+    memcpy(outMax, lanes[1], 3 * sizeof(float));
+}
+
+// Returns the squared distance from 'center' to the furthest vertex
+static float findMaxDistanceSq(const VertexData* vertices, size_t numVertices, const float* center)
+{
+#if defined(__SSE2__)
+    __m128 c = _mm_setr_ps(center[0], center[1], center[2], 0.f);
+    __m128 xyzMask = _mm_castsi128_ps(_mm_setr_epi32(-1, -1, -1, 0));
+    __m128 maxDistanceSq = _mm_setzero_ps();
+    for(size_t v=0; v<numVertices; ++v)
+    {
+        __m128 d = _mm_and_ps(_mm_sub_ps(_mm_loadu_ps(vertices[v].pos), c), xyzMask);
+        __m128 dSq = _mm_mul_ps(d, d);
+        // Sum the lanes, ending up with the total in lane 0
+        dSq = _mm_add_ps(dSq, _mm_movehl_ps(dSq, dSq));
+        dSq = _mm_add_ss(dSq, _mm_shuffle_ps(dSq, dSq, 1));
+        maxDistanceSq = _mm_max_ss(maxDistanceSq, dSq);
+    }
+    return _mm_cvtss_f32(maxDistanceSq);
+#elif defined(__ARM_NEON) && defined(__aarch64__)
+    float32x4_t c = {center[0], center[1], center[2], 0.f};
+    float maxDistanceSq = 0.f;
+    for(size_t v=0; v<numVertices; ++v)
+    {
+        float32x4_t d = vsubq_f32(vld1q_f32(vertices[v].pos), c);
+        d = vsetq_lane_f32(0.f, d, 3);
+        maxDistanceSq = fmaxf(maxDistanceSq, vaddvq_f32(vmulq_f32(d, d)));
+    }
+    return maxDistanceSq;
+#else
+    float maxDistanceSq = 0.f;
+    for(size_t v=0; v<numVertices; ++v) {
+        float d[3];
+        for(int i=0; i<3; ++i)
+            d[i] = vertices[v].pos[i] - center[i];
+        maxDistanceSq = fmaxf(maxDistanceSq, d[0]*d[0] + d[1]*d[1] + d[2]*d[2]);
+    }
+    return maxDistanceSq;
+#endif
+}
+
+// Fills in loadedObj's bounding box and bounding sphere
+static void computeBounds(LoadedObj* loadedObj)
+{
+    const VertexData* vertices = loadedObj->vertexBuffer;
+    size_t numVertices = loadedObj->numVertices;
+    if(numVertices == 0)
+        return;
+
+    findPositionBounds(vertices, numVertices, loadedObj->boundsMin, loadedObj->boundsMax);
+
+    // Ritter's method: start with a sphere through the vertices at either end of
+    // the box's longest axis, then grow it just enough to take in each vertex 
+    // that's outside it. Usually within 5-20% of the minimal sphere.
+    int axis = 0;
+    for(int i=1; i<3; ++i) {
+        if(loadedObj->boundsMax[i] - loadedObj->boundsMin[i] > loadedObj->boundsMax[axis] - loadedObj->boundsMin[axis])
+            axis = i;
+    }
+    const float* a = NULL;
+    const float* b = NULL;
+    for(size_t v=0; v<numVertices && !(a && b); ++v) {
+        if(!a && vertices[v].pos[axis] == loadedObj->boundsMin[axis]) a = vertices[v].pos;
+        if(!b && vertices[v].pos[axis] == loadedObj->boundsMax[axis]) b = vertices[v].pos;
+    }
+    assert(a && b);
+    float center[3], d[3];
+    for(int i=0; i<3; ++i){
+        center[i] = 0.5f * (a[i] + b[i]);
+        d[i] = b[i] - center[i];
+    }
+    float radius = sqrtf(d[0]*d[0] + d[1]*d[1] + d[2]*d[2]);
+    for(size_t v=0; v<numVertices; ++v)
+    {
+        const float* p = vertices[v].pos;
+        for(int i=0; i<3; ++i)
+            d[i] = p[i] - center[i];
+        float distanceSq = d[0]*d[0] + d[1]*d[1] + d[2]*d[2];
+        if(distanceSq <= radius * radius)
+            continue;
+        float distance = sqrtf(distanceSq);
+        float newRadius = 0.5f * (radius + distance);
+        float t = (newRadius - radius) / distance;
+        for(int i=0; i<3; ++i)
+            center[i] += d[i] * t;
+        radius = newRadius;
+    }
+
+    // Measure the sphere's radius again against every vertex, since the growing
+    // steps can overshoot, and keep the sphere around the box's centre instead
+    // if that's tighter. The small pad covers rounding in the square root.
+    float boxCenter[3];
+    for(int i=0; i<3; ++i)
+        boxCenter[i] = 0.5f * (loadedObj->boundsMin[i] + loadedObj->boundsMax[i]);
+    float boxRadius = sqrtf(findMaxDistanceSq(vertices, numVertices, boxCenter));
+    radius = sqrtf(findMaxDistanceSq(vertices, numVertices, center));
+    if(boxRadius < radius){
+        memcpy(center, boxCenter, sizeof(center));
+        radius = boxRadius;
+    }
+    memcpy(loadedObj->boundsCenter, center, sizeof(center));
+    loadedObj->boundsRadius = radius * (1.f + 4.f * FLT_EPSILON);
+}
+
+static void runOptimisationPasses(LoadedObj* loadedObj, uint32_t flags)
+{
+    if(flags & (ObjLoadFlag_OptimiseVertexCache | ObjLoadFlag_OptimiseOverdraw))
+    {
+        optimiseVertexCache(loadedObj);
+        if(flags & ObjLoadFlag_OptimiseOverdraw)
+            optimiseOverdraw(loadedObj);
+        optimiseVertexFetch(loadedObj);
+    }
+}
+
+// Returns the length of the directory part of 'path', including the last '/'
+static size_t getDirectoryLength(const char* path)
+{
+    const char* lastSlash = strrchr(path, '/');
+    return lastSlash ? (size_t)(lastSlash - path + 1) : 0;
+}
+
+// Copies 'name' into a fixed size char array, truncating it if it doesn't fit
+static void copyObjName(char* dest, size_t destSize, ObjName name)
+{
+    size_t length = (name.length < destSize - 1) ? name.length : destSize - 1;
+    memcpy(dest, name.chars, length);
+    dest[length] = '\0';
+}
+
+struct ObjMaterialList
+{
+    ObjMaterial* materials;
+    size_t numMaterials;
+    size_t capacity;
+};
+
+static ObjMaterial* addMaterial(ObjMaterialList* list, ObjName name)
+{
+    if(list->numMaterials + 1 > list->capacity){
+        growArray((void**)(&list->materials), &list->capacity, sizeof(ObjMaterial));
+    }
+    ObjMaterial* material = list->materials + list->numMaterials++;
+    memset(material, 0, sizeof(ObjMaterial));
+    copyObjName(material->name, sizeof(material->name), name);
+    for(int i=0; i<3; ++i)
+        material->diffuseColor[i] = 1.f;
+    material->specularExponent = 1.f;
+    material->opacity = 1.f;
+    return material;
+}
+
+// Returns the index of the material called 'name',
+// adding one with default values if there isn't one
+static uint32_t findMaterial(ObjMaterialList* list, ObjName name)
+{
+    char truncatedName[OBJ_MAX_NAME_LENGTH];
+    copyObjName(truncatedName, sizeof(truncatedName), name);
+    for(size_t i=0; i<list->numMaterials; ++i) {
+        if(strcmp(list->materials[i].name, truncatedName) == 0)
+            return (uint32_t)i;
+    }
+    addMaterial(list, name);
+    return (uint32_t)(list->numMaterials - 1);
+}
+
+static void parseColor(const char* s, float* outColor)
+{
+    for(int i=0; i<3; ++i)
+        outColor[i] = parseFloat(s, &s);
+}
+
+// Adds the materials in .mtl file 'filename' to 'list'
+static bool loadMtl(const char* filename, ObjMaterialList* list)
+{
+    int file = open(filename, O_RDONLY);
+    if (file < 0)
+        return false;
+
+    struct stat fs;
+    fstat(file, &fs);
+    size_t fileNumBytes = fs.st_size;
+
+    // NOTE: .mtl files are tiny so just read the whole thing. The newline
+    // on the end stops parsing running off the end of the last line.
+    char* fileBytes = (char*)malloc(fileNumBytes + 1);
+    size_t numBytesRead = 0;
+    while(numBytesRead < fileNumBytes)
+    {
+        ssize_t n = read(file, fileBytes + numBytesRead, fileNumBytes - numBytesRead);
+        if(n <= 0)
+            break;
+        numBytesRead += n;
+    }
+    close(file);
+    fileBytes[numBytesRead] = '\n';
+
+    const char* s = fileBytes;
+    const char* end = fileBytes + numBytesRead + 1;
+    size_t directoryLength = getDirectoryLength(filename);
+    ObjMaterial* material = NULL;
+    while(s < end)
+    {
+        while (*s == ' ' || *s == '\t')
+            ++s;
+
+        if(isObjKeyword(s, end, "newmtl"))
+            material = addMaterial(list, parseObjName(s + 6, end));
+        else if(!material)
+            ; // Nothing to apply the other statements to yet
+        else if(isObjKeyword(s, end, "Ka"))
+            parseColor(s + 2, material->ambientColor);
+        else if(isObjKeyword(s, end, "Kd"))
+            parseColor(s + 2, material->diffuseColor);
+        else if(isObjKeyword(s, end, "Ks"))
+            parseColor(s + 2, material->specularColor);
+        else if(isObjKeyword(s, end, "Ns"))
+            material->specularExponent = parseFloat(s + 2, &s);
+        else if(isObjKeyword(s, end, "d"))
+            material->opacity = parseFloat(s + 1, &s);
+        else if(isObjKeyword(s, end, "Tr"))
+            material->opacity = 1.f - parseFloat(s + 2, &s);
+        else if(isObjKeyword(s, end, "map_Kd"))
+        {
+            ObjName path = parseObjName(s + 6, end);
+            snprintf(material->diffuseTexturePath, sizeof(material->diffuseTexturePath), "%.*s%.*s",
+                     (int)directoryLength, filename, (int)path.length, path.chars);
+        }
+
+        // Skip to the next line
+        while(s < end && *s != '\n')
+            ++s;
+        ++s;
+    }
+
+    free(fileBytes);
+    return true;
+}
+
+// Loads every .mtl file named by the chunks' mtllib statements, in file order.
+// mtllib can name several files separated by spaces, relative to the .obj.
+static void loadMaterialLibraries(const char* objFilename, const ObjChunk* chunks, uint32_t numChunks, ObjMaterialList* list)
+{
+    size_t directoryLength = getDirectoryLength(objFilename);
+    for(uint32_t chunkIndex=0; chunkIndex<numChunks; ++chunkIndex)
+    {
+        const ObjChunk* chunk = chunks + chunkIndex;
+        for(size_t i=0; i<chunk->numMaterialLibraries; ++i)
+        {
+            const char* s = chunk->materialLibraries[i].chars;
+            const char* end = s + chunk->materialLibraries[i].length;
+            while(s < end)
+            {
+                const char* nameEnd = s;
+                while(nameEnd < end && *nameEnd != ' ' && *nameEnd != '\t')
+                    ++nameEnd;
+
+                char path[OBJ_MAX_PATH_LENGTH];
+                snprintf(path, sizeof(path), "%.*s%.*s", (int)directoryLength, objFilename, (int)(nameEnd - s), s);
+                loadMtl(path, list);
+
+                s = nameEnd;
+                while(s < end && (*s == ' ' || *s == '\t'))
+                    ++s;
+            }
+        }
+    }
+}
+
+// Sorts 'indices' into one submesh per material, see ObjSubmesh.
+// triangleMaterials has the material index of every triangle.
+// Returns the sorted indices including any padding.
+static uint32_t* buildSubmeshes(LoadedObj* loadedObj, const uint32_t* indices, const uint32_t* triangleMaterials,
+                                size_t numTriangles, uint32_t numMaterials, MemoryArena* arena)
+{
+    // Counting sort by material, with faces that have no material last.
+    // It's stable, so each submesh keeps the triangles in file order.
+    uint32_t numBuckets = numMaterials + 1;
+    uint32_t* bucketOffsets = (uint32_t*)allocObjScratch(arena, numBuckets * sizeof(uint32_t));
+    memset(bucketOffsets, 0, numBuckets * sizeof(uint32_t));
+    for(size_t t=0; t<numTriangles; ++t) {
+        uint32_t bucket = (triangleMaterials[t] == OBJ_NO_MATERIAL) ? numMaterials : triangleMaterials[t];
+        ++bucketOffsets[bucket];
+    }
+
+    uint32_t numSubmeshes = 0;
+    for(uint32_t b=0; b<numBuckets; ++b) {
+        if(bucketOffsets[b] > 0)
+            ++numSubmeshes;
+    }
+    ObjSubmesh* submeshes = (ObjSubmesh*)allocObjOutput(arena, numSubmeshes * sizeof(ObjSubmesh));
+    memset(submeshes, 0, numSubmeshes * sizeof(ObjSubmesh));
+
+    // NOTE: Metal needs index buffer offsets to be multiples of 4 bytes. 
+    // Padding with a whole degenerate triangle moves an odd 16-bit offset
+    // to an even one, while keeping the buffer a valid triangle list.
+    uint32_t indexAlignment = 4 / loadedObj->bytesPerIndex;
+    uint32_t numIndices = 0;
+    uint32_t submeshIndex = 0;
+    for(uint32_t b=0; b<numBuckets; ++b)
+    {
+        uint32_t numBucketTriangles = bucketOffsets[b];
+        if(numBucketTriangles == 0)
+            continue;
+        while(numIndices % indexAlignment != 0)
+            numIndices += 3;
+
+        ObjSubmesh* submesh = submeshes + submeshIndex++;
+        submesh->materialIndex = (b == numMaterials) ? OBJ_NO_MATERIAL : b;
+        submesh->indexOffset[0] = numIndices;
+        submesh->numIndices[0] = 3 * numBucketTriangles;
+        bucketOffsets[b] = numIndices;
+        numIndices += 3 * numBucketTriangles;
+    }
+
+    // Degenerate triangles just use vertex 0
+    uint32_t* sortedIndices = (uint32_t*)allocObjOutput(arena, numIndices * sizeof(uint32_t));
+    memset(sortedIndices, 0, numIndices * sizeof(uint32_t));
+    for(size_t t=0; t<numTriangles; ++t) {
+        uint32_t bucket = (triangleMaterials[t] == OBJ_NO_MATERIAL) ? numMaterials : triangleMaterials[t];
+        memcpy(sortedIndices + bucketOffsets[bucket], indices + 3*t, 3 * sizeof(uint32_t));
+        bucketOffsets[bucket] += 3;
+    }
+    freeObjScratch(arena, bucketOffsets);
+
+    loadedObj->submeshes = submeshes;
+    loadedObj->numSubmeshes = numSubmeshes;
+    loadedObj->numIndices = numIndices;
+    return sortedIndices;
+}
+
+// Runs func on every chunk, spread across threadPool if there is one
+static void processObjChunks(ThreadPool* threadPool, ObjChunk* chunks, uint32_t numChunks, ThreadPoolJobFunc* func)
+{
+    if(!threadPool || numChunks == 1) {
+        for(uint32_t i=0; i<numChunks; ++i)
+            func(chunks + i);
+        return;
+    }
+
+    ThreadPoolJobGroup jobGroup = {};
+    for(uint32_t i=0; i<numChunks; ++i)
+        threadPoolPushJob(threadPool, &jobGroup, func, chunks + i);
+    threadPoolWait(threadPool, &jobGroup);
+}
+
+LoadedObj loadObj(const char* filename, uint32_t flags, ThreadPool* threadPool, MemoryArena* arena)
+{
+    LoadedObj result = {};
+
+    int file = open(filename, O_RDONLY);
+    if (file < 0)
+        return result;
+    
+    struct stat fs;
+    fstat(file, &fs);
+
+    size_t fileNumBytes = fs.st_size;
+
+    const char* fileBytes = (const char*)mmap(0, fileNumBytes, PROT_READ, MAP_PRIVATE, file, 0);
+    
+    if (fileBytes == (void*)-1) {
+        close(file);
+        return result;
+    }
+
+    // Split the file into chunks of whole lines. Use a few chunks
+    // per thread so uneven chunks don't leave threads idle.
+    uint32_t numChunks = 1;
+    if(threadPool)
+    {
+        uint32_t maxNumChunks = 4 * (threadPool->numThreads + 1);
+        numChunks = (uint32_t)(fileNumBytes / OBJ_MIN_CHUNK_NUM_BYTES);
+        if(numChunks > maxNumChunks) numChunks = maxNumChunks;
+        if(numChunks < 1) numChunks = 1;
+    }
+    // NOTE: Line offsets within a chunk are 32-bit
+    uint32_t minNumChunks = (uint32_t)((fileNumBytes + OBJ_MAX_CHUNK_NUM_BYTES - 1) / OBJ_MAX_CHUNK_NUM_BYTES);
+    if(numChunks < minNumChunks)
+        numChunks = minNumChunks;
+
+    size_t scratchMarker = arena ? beginArenaScratch(arena) : 0;
+    result.allocatedFromArena = (arena != NULL);
+
+    ObjChunk* chunks = (ObjChunk*)allocObjScratch(arena, numChunks * sizeof(ObjChunk));
+    memset(chunks, 0, numChunks * sizeof(ObjChunk));
+
+    const char* fileEnd = fileBytes + fileNumBytes;
+    const char* chunkBegin = fileBytes;
+    for(uint32_t i=0; i<numChunks; ++i)
+    {
+        const char* chunkEnd = fileBytes + ((uint64_t)fileNumBytes * (i+1)) / numChunks;
+        if(chunkEnd < chunkBegin) 
+            chunkEnd = chunkBegin;
+        // Move the split point forward to the start of the next line
+        while(chunkEnd > fileBytes && chunkEnd < fileEnd && *(chunkEnd-1) != '\n')
+            ++chunkEnd;
+
+        chunks[i].begin = chunkBegin;
+        chunks[i].end = chunkEnd;
+        chunkBegin = chunkEnd;
+    }
+
+    processObjChunks(threadPool, chunks, numChunks, countObjChunk);
+
+    uint32_t numVertexPositions = 0;
+    uint32_t numVertexTexCoords = 0;
+    uint32_t numVertexNormals = 0;
+    for(uint32_t i=0; i<numChunks; ++i)
+    {
+        chunks[i].firstVertexPosition = numVertexPositions;
+        chunks[i].firstVertexTexCoord = numVertexTexCoords;
+        chunks[i].firstVertexNormal = numVertexNormals;
+        numVertexPositions += chunks[i].numVertexPositions;
+        numVertexTexCoords += chunks[i].numVertexTexCoords;
+        numVertexNormals += chunks[i].numVertexNormals;
+    }
+
+    float* vpBuffer = (float*)allocObjScratch(arena, numVertexPositions * 3 * sizeof(float));
+    float* vtBuffer = (float*)allocObjScratch(arena, numVertexTexCoords * 2 * sizeof(float));
+    float* vnBuffer = (float*)allocObjScratch(arena, numVertexNormals * 3 * sizeof(float));
+    for(uint32_t i=0; i<numChunks; ++i)
+    {
+        chunks[i].vpBuffer = vpBuffer;
+        chunks[i].vtBuffer = vtBuffer;
+        chunks[i].vnBuffer = vnBuffer;
+    }
+
+    processObjChunks(threadPool, chunks, numChunks, parseObjChunk);
+
+    size_t numCorners = 0;
+    size_t numTriangles = 0;
+    for(uint32_t i=0; i<numChunks; ++i)
+    {
+        numCorners += chunks[i].numCorners;
+        numTriangles += chunks[i].numTriangles;
+    }
+
+    // Every corner produces at most one unique vertex. The vertex buffer is
+    // output straight away at that size, and shrunk once we know how many
+    // there are; nothing else is output until then.
+    VertexBuilder vertexBuilder = {};
+    vertexBuilder.flags = flags;
+    vertexBuilder.vpBuffer = vpBuffer;
+    vertexBuilder.vtBuffer = vtBuffer;
+    vertexBuilder.vnBuffer = vnBuffer;
+    vertexBuilder.vertices = (VertexData*)allocObjOutput(arena, numCorners * sizeof(VertexData));
+    if(flags & ObjLoadFlag_GenerateTangents)
+        vertexBuilder.tangents = (VertexTangent*)allocObjScratch(arena, numCorners * sizeof(VertexTangent));
+    // Unique vertices are looked up by key rather than by searching
+    // the vertex buffer, so dedup is linear in the number of face corners
+    vertexBuilder.keys = (VertexKey*)allocObjScratch(arena, numCorners * sizeof(VertexKey));
+    initVertexHashTable(&vertexBuilder.hashTable, numCorners, arena);
+
+    size_t indexBufferSize = 0;
+    uint32_t* outIndexBuffer = (uint32_t*)allocObjScratch(arena, 3 * numTriangles * sizeof(uint32_t));
+    uint32_t* triangleMaterials = (uint32_t*)allocObjScratch(arena, numTriangles * sizeof(uint32_t));
+
+    // NOTE: Material names point into the file, so this has to happen before it's unmapped
+    ObjMaterialList materialList = {};
+    loadMaterialLibraries(filename, chunks, numChunks, &materialList);
+
+    // Stitch the chunks' faces together in file order
+    uint32_t smoothing = OBJ_SMOOTHING_OFF;
+    uint32_t materialIndex = OBJ_NO_MATERIAL;
+    for(uint32_t chunkIndex=0; chunkIndex<numChunks; ++chunkIndex)
+    {
+        ObjChunk* chunk = chunks + chunkIndex;
+        size_t cornerIndex = 0;
+        size_t materialSwitchIndex = 0;
+        while(cornerIndex < chunk->numCorners)
+        {
+            while(materialSwitchIndex < chunk->numMaterialSwitches 
+                  && chunk->materialSwitches[materialSwitchIndex].cornerIndex <= cornerIndex)
+            {
+                materialIndex = findMaterial(&materialList, chunk->materialSwitches[materialSwitchIndex++].materialName);
+            }
+
+            FaceCorner* faceCorners = chunk->corners + cornerIndex;
+            uint32_t faceNumCorners = faceCorners->faceNumCorners;
+            assert(faceNumCorners >= 3);
+            cornerIndex += faceNumCorners;
+
+            bool smoothNormals = (faceCorners->smoothing == OBJ_SMOOTHING_INHERIT) 
+                               ? (smoothing == OBJ_SMOOTHING_ON)
+                               : (faceCorners->smoothing == OBJ_SMOOTHING_ON);
+            addFace(&vertexBuilder, faceCorners, smoothNormals, outIndexBuffer + indexBufferSize);
+            for(uint32_t i=0; i<faceNumCorners - 2; ++i)
+                triangleMaterials[indexBufferSize / 3 + i] = materialIndex;
+            indexBufferSize += 3 * (faceNumCorners - 2);
+        }
+        // usemtl statements after the chunk's last face still apply to the next chunk
+        while(materialSwitchIndex < chunk->numMaterialSwitches)
+            materialIndex = findMaterial(&materialList, chunk->materialSwitches[materialSwitchIndex++].materialName);
+
+        if(chunk->smoothingAtEnd != OBJ_SMOOTHING_INHERIT)
+            smoothing = chunk->smoothingAtEnd;
+        free(chunk->corners);
+        free(chunk->lineOffsets);
+        free(chunk->materialSwitches);
+        free(chunk->materialLibraries);
+    }
+    assert(indexBufferSize == 3 * numTriangles);
+
+    VertexData* outVertexBuffer = vertexBuilder.vertices;
+    size_t vertexBufferSize = vertexBuilder.numVertices;
+
+    normaliseNormals(outVertexBuffer, vertexBufferSize);
+
+    // Give back the space reserved for vertices that were merged
+    outVertexBuffer = (VertexData*)shrinkObjOutput(arena, outVertexBuffer, numCorners * sizeof(VertexData),
+                                                   vertexBufferSize * sizeof(VertexData));
+
+    if(vertexBuilder.tangents)
+    {
+        finaliseTangents(outVertexBuffer, vertexBuilder.tangents, vertexBufferSize);
+        result.tangentBuffer = (VertexTangent*)allocObjOutput(arena, vertexBufferSize * sizeof(VertexTangent));
+        memcpy(result.tangentBuffer, vertexBuilder.tangents, vertexBufferSize * sizeof(VertexTangent));
+        freeObjScratch(arena, vertexBuilder.tangents);
+    }
+
+    freeObjScratch(arena, chunks);
+    freeObjScratch(arena, vpBuffer);
+    freeObjScratch(arena, vtBuffer);
+    freeObjScratch(arena, vnBuffer);
+    freeObjScratch(arena, vertexBuilder.keys);
+    freeObjScratch(arena, vertexBuilder.hashTable.slots);
+    munmap((void*)fileBytes, fileNumBytes);
+    close(file);
+
+    // Indices are built as 32-bit, use 16-bit if every index fits
+    // to halve the index buffer's size and bandwidth
+    result.bytesPerIndex = (vertexBufferSize <= 0xFFFF + 1) ? sizeof(uint16_t) : sizeof(uint32_t);
+
+    uint32_t* sortedIndexBuffer = buildSubmeshes(&result, outIndexBuffer, triangleMaterials, 
+                                                 numTriangles, (uint32_t)materialList.numMaterials, arena);
+    freeObjScratch(arena, outIndexBuffer);
+    freeObjScratch(arena, triangleMaterials);
+    if(arena)
+        endArenaScratch(arena, scratchMarker);
+    outIndexBuffer = sortedIndexBuffer;
+    indexBufferSize = result.numIndices;
+
+    if(result.bytesPerIndex == sizeof(uint16_t))
+    {
+        // NOTE: Safe to compact in place since each 16-bit index is
+        // written at or before the 32-bit index it was read from
+        uint16_t* outIndexBuffer16 = (uint16_t*)outIndexBuffer;
+        for(size_t i=0; i<indexBufferSize; ++i)
+            outIndexBuffer16[i] = (uint16_t)outIndexBuffer[i];
+        outIndexBuffer = (uint32_t*)shrinkObjOutput(arena, outIndexBuffer, indexBufferSize * sizeof(uint32_t),
+                                                    indexBufferSize * sizeof(uint16_t));
+    }
+
+    result.numVertices = vertexBufferSize;
+    result.vertexBuffer = outVertexBuffer;
+    result.indexBuffer = outIndexBuffer;
+    computeBounds(&result);
+    result.numMaterials = (uint32_t)materialList.numMaterials;
+    result.materials = (ObjMaterial*)allocObjOutput(arena, result.numMaterials * sizeof(ObjMaterial));
+    if(result.numMaterials > 0)
+        memcpy(result.materials, materialList.materials, result.numMaterials * sizeof(ObjMaterial));
+    free(materialList.materials);
+
+    runOptimisationPasses(&result, flags);
+
+    // NOTE: These must come after the passes above, which reorder vertexBuffer
+    if(flags & ObjLoadFlag_BuildMeshlets)
+        buildMeshlets(&result);
+    if(flags & ObjLoadFlag_GenerateLods)
+        generateLods(&result);
+    if(flags & ObjLoadFlag_PackVertices)
+        packVertices(&result);
+
+    return result;
+}
+
+// Batches hold up to this many indices per vertex allowed in a batch,
+// which is plenty for any reasonable mesh (closed meshes have about 6)
+#define OBJ_STREAM_MAX_INDICES_PER_VERTEX 8
+
+struct ObjStream
+{
+    ObjStreamBatchFunc* func;
+    void* userData;
+    uint32_t flags;
+    uint32_t maxBatchNumVertices;
+    uint32_t maxBatchNumIndices;
+
+    VertexBuilder vertexBuilder;
+    uint32_t* indices;
+    uint32_t numIndices;
+
+    ObjStreamBatch batch;
+};
+
+// Hands the current batch to the callback and starts a new one
+static void flushObjStreamBatch(ObjStream* stream)
+{
+    VertexBuilder* builder = &stream->vertexBuilder;
+    if(stream->numIndices == 0)
+        return;
+
+    normaliseNormals(builder->vertices, builder->numVertices);
+    if(builder->tangents)
+        finaliseTangents(builder->vertices, builder->tangents, builder->numVertices);
+
+    ObjSubmesh batchSubmesh = {};
+    batchSubmesh.materialIndex = OBJ_NO_MATERIAL;
+    batchSubmesh.numIndices[0] = stream->numIndices;
+
+    LoadedObj batchObj = {};
+    batchObj.numVertices = (uint32_t)builder->numVertices;
+    batchObj.numIndices = stream->numIndices;
+    batchObj.bytesPerIndex = sizeof(uint32_t);
+    batchObj.vertexBuffer = builder->vertices;
+    batchObj.tangentBuffer = builder->tangents;
+    batchObj.indexBuffer = stream->indices;
+    batchObj.submeshes = &batchSubmesh;
+    batchObj.numSubmeshes = 1;
+    runOptimisationPasses(&batchObj, stream->flags);
+
+    stream->batch.vertices = builder->vertices;
+    stream->batch.tangents = builder->tangents;
+    stream->batch.numVertices = (uint32_t)builder->numVertices;
+    stream->batch.indices = stream->indices;
+    stream->batch.numIndices = stream->numIndices;
+    stream->func(&stream->batch, stream->userData);
+    ++stream->batch.batchIndex;
+
+    builder->numVertices = 0;
+    builder->hashTable.numEntries = 0;
+    memset(builder->hashTable.slots, 0xFF, builder->hashTable.capacity * sizeof(VertexHashSlot));
+    stream->numIndices = 0;
+}
+
+static void reserveArray(void** array, size_t* capacity, size_t requiredCapacity, size_t itemSize)
+{
+    while(*capacity < requiredCapacity)
+        growArray(array, capacity, itemSize);
+}
+
+bool streamObj(const char* filename, ObjStreamBatchFunc* func, void* userData, uint32_t flags,
+               size_t windowNumBytes, uint32_t maxBatchNumVertices)
+{
+    assert(windowNumBytes > 0);
+    assert(maxBatchNumVertices >= 3);
+
+    int file = open(filename, O_RDONLY);
+    if (file < 0)
+        return false;
+
+    struct stat fs;
+    fstat(file, &fs);
+
+    ObjStream stream = {};
+    stream.func = func;
+    stream.userData = userData;
+    stream.flags = flags;
+    stream.maxBatchNumVertices = maxBatchNumVertices;
+    stream.maxBatchNumIndices = OBJ_STREAM_MAX_INDICES_PER_VERTEX * maxBatchNumVertices;
+    stream.batch.fileNumBytes = fs.st_size;
+
+    // NOTE: Leave room for one face beyond the limits, so a face 
+    // bigger than a whole batch can still go in a batch on its own
+    size_t vertexCapacity = maxBatchNumVertices + OBJ_MAX_FACE_CORNERS;
+    size_t indexCapacity = stream.maxBatchNumIndices + 3 * OBJ_MAX_FACE_CORNERS;
+    VertexBuilder* builder = &stream.vertexBuilder;
+    builder->flags = flags;
+    builder->vertices = (VertexData*)malloc(vertexCapacity * sizeof(VertexData));
+    if(flags & ObjLoadFlag_GenerateTangents)
+        builder->tangents = (VertexTangent*)malloc(vertexCapacity * sizeof(VertexTangent));
+    builder->keys = (VertexKey*)malloc(vertexCapacity * sizeof(VertexKey));
+    initVertexHashTable(&builder->hashTable, vertexCapacity, NULL);
+    stream.indices = (uint32_t*)malloc(indexCapacity * sizeof(uint32_t));
+
+    // Attributes for the whole file so far, since faces can refer back to any of them
+    float* vpBuffer = NULL;
+    float* vtBuffer = NULL;
+    float* vnBuffer = NULL;
+    size_t vpCapacity = 0, vtCapacity = 0, vnCapacity = 0;
+    uint32_t numVertexPositions = 0;
+    uint32_t numVertexTexCoords = 0;
+    uint32_t numVertexNormals = 0;
+
+    // +1 for the newline added after the last line of the file
+    size_t windowCapacity = windowNumBytes;
+    char* window = (char*)malloc(windowCapacity + 1);
+    size_t numWindowBytes = 0;
+    bool isAtEnd = false;
+    bool success = true;
+    uint32_t smoothing = OBJ_SMOOTHING_OFF;
+
+    while(!isAtEnd)
+    {
+        while(numWindowBytes < windowCapacity)
+        {
+            ssize_t numBytesRead = read(file, window + numWindowBytes, windowCapacity - numWindowBytes);
+            if(numBytesRead <= 0) {
+                success = (numBytesRead == 0);
+                isAtEnd = true;
+                break;
+            }
+            numWindowBytes += numBytesRead;
+            stream.batch.numFileBytesRead += numBytesRead;
+        }
+
+        // Only process whole lines, any partial line at the
+        // end is moved to the start of the next window
+        size_t numLineBytes = numWindowBytes;
+        if(isAtEnd)
+        {
+            if(numLineBytes > 0 && window[numLineBytes-1] != '\n')
+                window[numLineBytes++] = '\n';
+        }
+        else
+        {
+            while(numLineBytes > 0 && window[numLineBytes-1] != '\n')
+                --numLineBytes;
+            if(numLineBytes == 0) {
+                // One line fills the whole window, make room for the rest of it
+                windowCapacity *= 2;
+                window = (char*)realloc(window, windowCapacity + 1);
+                assert(window);
+                continue;
+            }
+        }
+
+        // The window is parsed exactly like one of loadObj()'s chunks
+        ObjChunk chunk = {};
+        chunk.begin = window;
+        chunk.end = window + numLineBytes;
+        countObjChunk(&chunk);
+
+        reserveArray((void**)&vpBuffer, &vpCapacity, numVertexPositions + chunk.numVertexPositions, 3 * sizeof(float));
+        reserveArray((void**)&vtBuffer, &vtCapacity, numVertexTexCoords + chunk.numVertexTexCoords, 2 * sizeof(float));
+        reserveArray((void**)&vnBuffer, &vnCapacity, numVertexNormals + chunk.numVertexNormals, 3 * sizeof(float));
+        chunk.firstVertexPosition = numVertexPositions;
+        chunk.firstVertexTexCoord = numVertexTexCoords;
+        chunk.firstVertexNormal = numVertexNormals;
+        chunk.vpBuffer = vpBuffer;
+        chunk.vtBuffer = vtBuffer;
+        chunk.vnBuffer = vnBuffer;
+        parseObjChunk(&chunk);
+        numVertexPositions += chunk.numVertexPositions;
+        numVertexTexCoords += chunk.numVertexTexCoords;
+        numVertexNormals += chunk.numVertexNormals;
+
+        builder->vpBuffer = vpBuffer;
+        builder->vtBuffer = vtBuffer;
+        builder->vnBuffer = vnBuffer;
+
+        size_t cornerIndex = 0;
+        while(cornerIndex < chunk.numCorners)
+        {
+            FaceCorner* faceCorners = chunk.corners + cornerIndex;
+            uint32_t faceNumCorners = faceCorners->faceNumCorners;
+            uint32_t faceNumIndices = 3 * (faceNumCorners - 2);
+            cornerIndex += faceNumCorners;
+
+            if(builder->numVertices + faceNumCorners > stream.maxBatchNumVertices
+               || stream.numIndices + faceNumIndices > stream.maxBatchNumIndices)
+            {
+                flushObjStreamBatch(&stream);
+            }
+
+            bool smoothNormals = (faceCorners->smoothing == OBJ_SMOOTHING_INHERIT) 
+                               ? (smoothing == OBJ_SMOOTHING_ON)
+                               : (faceCorners->smoothing == OBJ_SMOOTHING_ON);
+            addFace(builder, faceCorners, smoothNormals, stream.indices + stream.numIndices);
+            stream.numIndices += faceNumIndices;
+        }
+
+        if(chunk.smoothingAtEnd != OBJ_SMOOTHING_INHERIT)
+            smoothing = chunk.smoothingAtEnd;
+        free(chunk.corners);
+        free(chunk.lineOffsets);
+        free(chunk.materialSwitches);
+        free(chunk.materialLibraries);
+
+        if(numLineBytes < numWindowBytes) {
+            memmove(window, window + numLineBytes, numWindowBytes - numLineBytes);
+            numWindowBytes -= numLineBytes;
+        }
+        else {
+            numWindowBytes = 0;
+        }
+    }
+    flushObjStreamBatch(&stream);
+
+    free(window);
+    free(vpBuffer);
+    free(vtBuffer);
+    free(vnBuffer);
+    free(stream.indices);
+    free(builder->vertices);
+    free(builder->tangents);
+    free(builder->keys);
+    free(builder->hashTable.slots);
+    close(file);
+
+    return success;
+}
+
+#define MESH_CACHE_MAGIC 0x4853454D // "MESH"
+#define MESH_CACHE_VERSION 8
+// Sections are aligned so the arrays can be used in place
+#define MESH_CACHE_SECTION_ALIGNMENT 16
+
+enum MeshCacheSection
+{
+    MeshCacheSection_Vertices = 0,
+    MeshCacheSection_Tangents,
+    MeshCacheSection_Indices,
+    MeshCacheSection_Submeshes,
+    MeshCacheSection_Materials,
+    MeshCacheSection_PackedVertices,
+    MeshCacheSection_Meshlets,
+    MeshCacheSection_MeshletVertices,
+    MeshCacheSection_MeshletTriangles,
+    MeshCacheSection_LodIndices,
+    MeshCacheSection_Count
+};
+
+struct MeshCacheHeader
+{
+    uint32_t magic;
+    uint32_t version;
+    uint32_t loadFlags;
+    uint32_t vertexStride;
+
+    // Used to detect when the .obj has changed since the cache was written
+    uint64_t sourceNumBytes;
+    int64_t sourceModifiedTime;
+
+    uint32_t numVertices;
+    uint32_t numIndices;
+    uint32_t bytesPerIndex;
+    uint32_t numSubmeshes;
+    uint32_t numMaterials;
+    uint32_t numMeshlets;
+    uint32_t numMeshletVertices;
+    uint32_t numMeshletTriangles;
+    uint32_t numLods;
+    uint32_t numLodIndices;
+    MeshLod lods[MESH_MAX_LODS];
+    float boundsCenter[3];
+    float boundsRadius;
+    float boundsMin[3];
+    float boundsMax[3];
+    float packedPosOffset[3];
+    float packedPosScale[3];
+
+    uint64_t sectionOffsets[MeshCacheSection_Count];
+    uint64_t sectionNumBytes[MeshCacheSection_Count];
+
+    // Checksum of everything after the header
+    uint64_t checksum;
+};
+
+static uint64_t checksumBytes(const uint8_t* bytes, size_t numBytes)
+{
+    // FNV-1a, but consuming 8 bytes per step to keep up with memory bandwidth
+    uint64_t hash = 0xcbf29ce484222325;
+    size_t i = 0;
+    for(; i + sizeof(uint64_t) <= numBytes; i += sizeof(uint64_t))
+    {
+        uint64_t word;
+        memcpy(&word, bytes + i, sizeof(word));
+        hash = (hash ^ word) * 0x100000001b3;
+    }
+    for(; i < numBytes; ++i)
+        hash = (hash ^ bytes[i]) * 0x100000001b3;
+    return hash;
+}
+
+static size_t alignUp(size_t size, size_t alignment)
+{
+    return (size + alignment - 1) & ~(alignment - 1);
+}
+
+// Returns false if 'file' couldn't be stat'ed
+static bool getFileSizeAndTime(const char* filename, uint64_t* numBytes, int64_t* modifiedTime)
+{
+    struct stat fs;
+    if(stat(filename, &fs) != 0)
+        return false;
+    *numBytes = fs.st_size;
+    *modifiedTime = fs.st_mtime;
+    return true;
+}
+
+static bool readMeshCache(const char* cacheFilename, const char* objFilename, uint32_t flags, LoadedObj* result)
+{
+    int file = open(cacheFilename, O_RDONLY);
+    if (file < 0)
+        return false;
+
+    struct stat fs;
+    fstat(file, &fs);
+    size_t fileNumBytes = fs.st_size;
+    if(fileNumBytes < sizeof(MeshCacheHeader)){
+        close(file);
+        return false;
+    }
+
+    uint8_t* fileBytes = (uint8_t*)mmap(0, fileNumBytes, PROT_READ, MAP_PRIVATE, file, 0);
+    // NOTE: The mapping stays valid after closing the file
+    close(file);
+    if (fileBytes == (void*)-1)
+        return false;
+
+    const MeshCacheHeader* header = (const MeshCacheHeader*)fileBytes;
+    bool isValid = header->magic == MESH_CACHE_MAGIC
+                && header->version == MESH_CACHE_VERSION
+                && header->loadFlags == flags
+                && header->vertexStride == sizeof(VertexData);
+
+    uint64_t sourceNumBytes;
+    int64_t sourceModifiedTime;
+    if(isValid && getFileSizeAndTime(objFilename, &sourceNumBytes, &sourceModifiedTime))
+    {
+        isValid = header->sourceNumBytes == sourceNumBytes
+               && header->sourceModifiedTime == sourceModifiedTime;
+    }
+
+    for(int i=0; isValid && i<MeshCacheSection_Count; ++i)
+    {
+        isValid = header->sectionOffsets[i] <= fileNumBytes 
+               && header->sectionNumBytes[i] <= fileNumBytes - header->sectionOffsets[i];
+    }
+    isValid = isValid 
+           && header->sectionNumBytes[MeshCacheSection_Vertices] == (uint64_t)header->numVertices * sizeof(VertexData)
+           && (header->sectionNumBytes[MeshCacheSection_Tangents] == 0
+               || header->sectionNumBytes[MeshCacheSection_Tangents] == (uint64_t)header->numVertices * sizeof(VertexTangent))
+           && header->sectionNumBytes[MeshCacheSection_Indices] == (uint64_t)header->numIndices * header->bytesPerIndex
+           && header->sectionNumBytes[MeshCacheSection_Submeshes] == (uint64_t)header->numSubmeshes * sizeof(ObjSubmesh)
+           && header->sectionNumBytes[MeshCacheSection_Materials] == (uint64_t)header->numMaterials * sizeof(ObjMaterial)
+           && (header->sectionNumBytes[MeshCacheSection_PackedVertices] == 0
+               || header->sectionNumBytes[MeshCacheSection_PackedVertices] == (uint64_t)header->numVertices * sizeof(PackedVertexData))
+           && header->sectionNumBytes[MeshCacheSection_Meshlets] == (uint64_t)header->numMeshlets * sizeof(Meshlet)
+           && header->sectionNumBytes[MeshCacheSection_MeshletVertices] == (uint64_t)header->numMeshletVertices * sizeof(uint32_t)
+           && header->sectionNumBytes[MeshCacheSection_MeshletTriangles] == (uint64_t)header->numMeshletTriangles * 3
+           && header->sectionNumBytes[MeshCacheSection_LodIndices] == (uint64_t)header->numLodIndices * header->bytesPerIndex
+           && header->numLods <= MESH_MAX_LODS;
+
+    if(isValid)
+    {
+        const uint8_t* payload = fileBytes + sizeof(MeshCacheHeader);
+        isValid = header->checksum == checksumBytes(payload, fileNumBytes - sizeof(MeshCacheHeader));
+    }
+
+    if(!isValid){
+        munmap(fileBytes, fileNumBytes);
+        return false;
+    }
+
+    *result = {};
+    result->numVertices = header->numVertices;
+    result->numIndices = header->numIndices;
+    result->bytesPerIndex = header->bytesPerIndex;
+    result->vertexBuffer = (VertexData*)(fileBytes + header->sectionOffsets[MeshCacheSection_Vertices]);
+    result->indexBuffer = fileBytes + header->sectionOffsets[MeshCacheSection_Indices];
+    if(header->sectionNumBytes[MeshCacheSection_Tangents] > 0)
+        result->tangentBuffer = (VertexTangent*)(fileBytes + header->sectionOffsets[MeshCacheSection_Tangents]);
+    if(header->numSubmeshes > 0)
+        result->submeshes = (ObjSubmesh*)(fileBytes + header->sectionOffsets[MeshCacheSection_Submeshes]);
+    if(header->numMaterials > 0)
+        result->materials = (ObjMaterial*)(fileBytes + header->sectionOffsets[MeshCacheSection_Materials]);
+    result->numSubmeshes = header->numSubmeshes;
+    result->numMaterials = header->numMaterials;
+    if(header->sectionNumBytes[MeshCacheSection_PackedVertices] > 0)
+        result->packedVertexBuffer = (PackedVertexData*)(fileBytes + header->sectionOffsets[MeshCacheSection_PackedVertices]);
+    if(header->numMeshlets > 0)
+    {
+        result->meshlets = (Meshlet*)(fileBytes + header->sectionOffsets[MeshCacheSection_Meshlets]);
+        result->meshletVertices = (uint32_t*)(fileBytes + header->sectionOffsets[MeshCacheSection_MeshletVertices]);
+        result->meshletTriangles = (uint8_t*)(fileBytes + header->sectionOffsets[MeshCacheSection_MeshletTriangles]);
+    }
+    result->numMeshlets = header->numMeshlets;
+    result->numMeshletVertices = header->numMeshletVertices;
+    result->numMeshletTriangles = header->numMeshletTriangles;
+    if(header->numLodIndices > 0)
+        result->lodIndexBuffer = fileBytes + header->sectionOffsets[MeshCacheSection_LodIndices];
+    result->numLods = header->numLods;
+    result->numLodIndices = header->numLodIndices;
+    memcpy(result->lods, header->lods, sizeof(result->lods));
+    memcpy(result->boundsMin, header->boundsMin, sizeof(result->boundsMin));
+    memcpy(result->boundsMax, header->boundsMax, sizeof(result->boundsMax));
+    memcpy(result->boundsCenter, header->boundsCenter, sizeof(result->boundsCenter));
+    result->boundsRadius = header->boundsRadius;
+    memcpy(result->packedPosOffset, header->packedPosOffset, sizeof(result->packedPosOffset));
+    memcpy(result->packedPosScale, header->packedPosScale, sizeof(result->packedPosScale));
+    result->mappedFile = fileBytes;
+    result->mappedFileNumBytes = fileNumBytes;
+
+    return true;
+}
+
+static bool writeMeshCache(const char* cacheFilename, const char* objFilename, uint32_t flags, const LoadedObj& loadedObj)
+{
+    MeshCacheHeader header = {};
+    header.magic = MESH_CACHE_MAGIC;
+    header.version = MESH_CACHE_VERSION;
+    header.loadFlags = flags;
+    header.vertexStride = sizeof(VertexData);
+    getFileSizeAndTime(objFilename, &header.sourceNumBytes, &header.sourceModifiedTime);
+    header.numVertices = loadedObj.numVertices;
+    header.numIndices = loadedObj.numIndices;
+    header.bytesPerIndex = loadedObj.bytesPerIndex;
+    header.numSubmeshes = loadedObj.numSubmeshes;
+    header.numMaterials = loadedObj.numMaterials;
+    header.numMeshlets = loadedObj.numMeshlets;
+    header.numMeshletVertices = loadedObj.numMeshletVertices;
+    header.numMeshletTriangles = loadedObj.numMeshletTriangles;
+    header.numLods = loadedObj.numLods;
+    header.numLodIndices = loadedObj.numLodIndices;
+    memcpy(header.lods, loadedObj.lods, sizeof(header.lods));
+    memcpy(header.boundsMin, loadedObj.boundsMin, sizeof(header.boundsMin));
+    memcpy(header.boundsMax, loadedObj.boundsMax, sizeof(header.boundsMax));
+    memcpy(header.boundsCenter, loadedObj.boundsCenter, sizeof(header.boundsCenter));
+    header.boundsRadius = loadedObj.boundsRadius;
+
+    const void* sectionData[MeshCacheSection_Count] = {};
+    sectionData[MeshCacheSection_Vertices] = loadedObj.vertexBuffer;
+    sectionData[MeshCacheSection_Indices] = loadedObj.indexBuffer;
+    header.sectionNumBytes[MeshCacheSection_Vertices] = (uint64_t)loadedObj.numVertices * sizeof(VertexData);
+    header.sectionNumBytes[MeshCacheSection_Indices] = (uint64_t)loadedObj.numIndices * loadedObj.bytesPerIndex;
+    if(loadedObj.tangentBuffer)
+    {
+        sectionData[MeshCacheSection_Tangents] = loadedObj.tangentBuffer;
+        header.sectionNumBytes[MeshCacheSection_Tangents] = (uint64_t)loadedObj.numVertices * sizeof(VertexTangent);
+    }
+    sectionData[MeshCacheSection_Submeshes] = loadedObj.submeshes;
+    sectionData[MeshCacheSection_Materials] = loadedObj.materials;
+    header.sectionNumBytes[MeshCacheSection_Submeshes] = (uint64_t)loadedObj.numSubmeshes * sizeof(ObjSubmesh);
+    header.sectionNumBytes[MeshCacheSection_Materials] = (uint64_t)loadedObj.numMaterials * sizeof(ObjMaterial);
+    if(loadedObj.packedVertexBuffer)
+    {
+        sectionData[MeshCacheSection_PackedVertices] = loadedObj.packedVertexBuffer;
+        header.sectionNumBytes[MeshCacheSection_PackedVertices] = (uint64_t)loadedObj.numVertices * sizeof(PackedVertexData);
+        memcpy(header.packedPosOffset, loadedObj.packedPosOffset, sizeof(header.packedPosOffset));
+        memcpy(header.packedPosScale, loadedObj.packedPosScale, sizeof(header.packedPosScale));
+    }
+    sectionData[MeshCacheSection_Meshlets] = loadedObj.meshlets;
+    sectionData[MeshCacheSection_MeshletVertices] = loadedObj.meshletVertices;
+    sectionData[MeshCacheSection_MeshletTriangles] = loadedObj.meshletTriangles;
+    header.sectionNumBytes[MeshCacheSection_Meshlets] = (uint64_t)loadedObj.numMeshlets * sizeof(Meshlet);
+    header.sectionNumBytes[MeshCacheSection_MeshletVertices] = (uint64_t)loadedObj.numMeshletVertices * sizeof(uint32_t);
+    header.sectionNumBytes[MeshCacheSection_MeshletTriangles] = (uint64_t)loadedObj.numMeshletTriangles * 3;
+    sectionData[MeshCacheSection_LodIndices] = loadedObj.lodIndexBuffer;
+    header.sectionNumBytes[MeshCacheSection_LodIndices] = (uint64_t)loadedObj.numLodIndices * loadedObj.bytesPerIndex;
+
+    // Lay the whole file out in memory first so we can checksum it
+    size_t fileNumBytes = alignUp(sizeof(MeshCacheHeader), MESH_CACHE_SECTION_ALIGNMENT);
+    for(int i=0; i<MeshCacheSection_Count; ++i){
+        header.sectionOffsets[i] = fileNumBytes;
+        fileNumBytes = alignUp(fileNumBytes + header.sectionNumBytes[i], MESH_CACHE_SECTION_ALIGNMENT);
+    }
+
+    uint8_t* fileBytes = (uint8_t*)calloc(fileNumBytes, 1);
+    if(!fileBytes)
+        return false;
+    for(int i=0; i<MeshCacheSection_Count; ++i){
+        if(header.sectionNumBytes[i] > 0)
+            memcpy(fileBytes + header.sectionOffsets[i], sectionData[i], header.sectionNumBytes[i]);
+    }
+    header.checksum = checksumBytes(fileBytes + sizeof(MeshCacheHeader), fileNumBytes - sizeof(MeshCacheHeader));
+    memcpy(fileBytes, &header, sizeof(MeshCacheHeader));
+
+    // Write to a temporary file and rename it over the cache, so 
+    // a crash part way through can't leave a truncated cache behind
+    char tempFilename[1024];
+    snprintf(tempFilename, sizeof(tempFilename), "%s.tmp", cacheFilename);
+    bool success = false;
+    int file = open(tempFilename, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+    if(file >= 0)
+    {
+        size_t numBytesWritten = 0;
+        while(numBytesWritten < fileNumBytes)
+        {
+            ssize_t n = write(file, fileBytes + numBytesWritten, fileNumBytes - numBytesWritten);
+            if(n <= 0) break;
+            numBytesWritten += n;
+        }
+        close(file);
+        success = (numBytesWritten == fileNumBytes) && (rename(tempFilename, cacheFilename) == 0);
+        if(!success)
+            unlink(tempFilename);
+    }
+
+    free(fileBytes);
+    return success;
+}
+
+LoadedObj loadObjCached(const char* objFilename, const char* cacheFilename, uint32_t flags, 
+                        ThreadPool* threadPool, MemoryArena* arena)
+{
+    LoadedObj result = {};
+    if(readMeshCache(cacheFilename, objFilename, flags, &result))
+        return result;
+
+    result = loadObj(objFilename, flags, threadPool, arena);
+    if(result.vertexBuffer)
+        writeMeshCache(cacheFilename, objFilename, flags, result);
+
+    return result;
+}
+
+void freeLoadedObj(LoadedObj loadedObj)
+{
+    if(loadedObj.mappedFile){
+        munmap(loadedObj.mappedFile, loadedObj.mappedFileNumBytes);
+        return;
+    }
+    if(!loadedObj.allocatedFromArena){
+        free(loadedObj.vertexBuffer);
+        free(loadedObj.indexBuffer);
+        free(loadedObj.tangentBuffer);
+        free(loadedObj.submeshes);
+        free(loadedObj.materials);
+    }
+    free(loadedObj.packedVertexBuffer);
+    free(loadedObj.meshlets);
+    free(loadedObj.meshletVertices);
+    free(loadedObj.meshletTriangles);
+    free(loadedObj.lodIndexBuffer);
 }
\ No newline at end of file
@@ -1,6 +1,11 @@
 #pragma once
 
 #include <stdint.h>
+#include <stddef.h> //NULL
+
+struct ThreadPool;
+struct Meshlet;
+struct MemoryArena;
 
 // NOTE: This is in no way a complete .obj parser.
 // I just did the minimum required to load simple .obj files,
@@ -21,26 +26,285 @@ struct VertexData
     float uv[2];
     float norm[3];
 };
+
+// Half-size alternative to VertexData, see ObjLoadFlag_PackVertices
+struct PackedVertexData
+{
+    // Position within the mesh's bounds as 16-bit unsigned normalised
+    // integers, see LoadedObj::packedPosOffset/packedPosScale. 
+    // The 4th component is padding.
+    uint16_t pos[4];
+    // Texture coordinates as half floats
+    uint16_t uv[2];
+    // Octahedral-encoded normal as 16-bit signed normalised integers
+    int16_t norm[2];
+};
+
+// Tangent frame for normal mapping, see ObjLoadFlag_GenerateTangents
+struct VertexTangent
+{
+    // Unit vector along the direction u increases, perpendicular to the normal
+    float tangent[3];
+    // 1 or -1. The bitangent is bitangentSign * cross(norm, tangent),
+    // the sign is negative where the texture is mirrored.
+    float bitangentSign;
+};
 #pragma pack(pop)
 
+enum ObjLoadFlags
+{
+    ObjLoadFlag_None = 0,
+    // By default face corners are merged into one vertex when they
+    // share the same (vp, vt, vn) indices. This flag merges corners
+    // whose attribute values are within a small epsilon instead,
+    // which also welds duplicates written with different indices.
+    ObjLoadFlag_MergeByValue = 1 << 0,
+    // Runs optimiseVertexCache() and optimiseVertexFetch() on
+    // the loaded mesh, see MeshOptimisation.h
+    ObjLoadFlag_OptimiseVertexCache = 1 << 1,
+    // Runs optimiseOverdraw() on the loaded mesh after optimising it for
+    // the vertex cache. Implies ObjLoadFlag_OptimiseVertexCache.
+    ObjLoadFlag_OptimiseOverdraw = 1 << 2,
+    // Also fills in LoadedObj::packedVertexBuffer, see packVertices()
+    // in MeshOptimisation.h
+    ObjLoadFlag_PackVertices = 1 << 3,
+    // Also fills in LoadedObj's meshlets, see buildMeshlets() in Meshlets.h
+    ObjLoadFlag_BuildMeshlets = 1 << 4,
+    // Also fills in LoadedObj's lods, see generateLods() in MeshSimplification.h
+    ObjLoadFlag_GenerateLods = 1 << 5,
+    // Also fills in LoadedObj::tangentBuffer. Tangents follow MikkTSpace's
+    // conventions, so normal maps baked by most tools come out right.
+    // Vertices are split where the texture is mirrored, since faces
+    // either side need opposite bitangent signs.
+    ObjLoadFlag_GenerateTangents = 1 << 6,
+};
+
+#define MESH_MAX_LODS 8
+
+struct MeshLod
+{
+    // Range of LoadedObj's combined index buffers, see LoadedObj::lods
+    uint32_t indexOffset;
+    uint32_t numIndices;
+    // How far this LOD's surface is from the original, in mesh units
+    float error;
+};
+
+#define OBJ_MAX_NAME_LENGTH 64
+#define OBJ_MAX_PATH_LENGTH 256
+#define OBJ_NO_MATERIAL 0xFFFFFFFF
+
+// Material from a .mtl file referenced by the .obj's mtllib statements.
+// Only the basic parameters are read, texture options aren't supported.
+struct ObjMaterial
+{
+    // newmtl (truncated to fit)
+    char name[OBJ_MAX_NAME_LENGTH];
+    float ambientColor[3];  // Ka, defaults to 0
+    float diffuseColor[3];  // Kd, defaults to 1
+    float specularColor[3]; // Ks, defaults to 0
+    float specularExponent; // Ns, defaults to 1
+    float opacity;          // d or 1 - Tr, defaults to 1
+    // map_Kd joined onto the .mtl file's directory, so it can be opened 
+    // from the working directory as-is. Empty if there isn't one.
+    char diffuseTexturePath[OBJ_MAX_PATH_LENGTH];
+};
+
+// The triangles that use one material. Submeshes are sorted by materialIndex
+// and there's one per material used, so drawing them in order binds each
+// material once. Each range starts on a 4-byte boundary as Metal requires;
+// the gaps between them are filled with degenerate triangles, so a whole 
+// LOD can still be drawn in one go.
+struct ObjSubmesh
+{
+    // Index into LoadedObj::materials, or OBJ_NO_MATERIAL
+    // for faces before the first usemtl statement
+    uint32_t materialIndex;
+    // The submesh's range of each LOD in LoadedObj's combined index buffers,
+    // in the same form as MeshLod. Element 0 is its range of indexBuffer,
+    // the rest are only filled in when loaded with ObjLoadFlag_GenerateLods.
+    uint32_t indexOffset[MESH_MAX_LODS];
+    uint32_t numIndices[MESH_MAX_LODS];
+    // Range of LoadedObj::meshlets, only filled in when loaded
+    // with ObjLoadFlag_BuildMeshlets. Meshlets never span submeshes.
+    uint32_t meshletOffset;
+    uint32_t numMeshlets;
+};
+
 struct LoadedObj
 {
     uint32_t numVertices;
     uint32_t numIndices;
+    // Size of each index, either 2 or 4 bytes. 16-bit indices are
+    // used whenever numVertices is small enough for them to fit.
+    uint32_t bytesPerIndex;
 
     VertexData* vertexBuffer;
-    uint16_t* indexBuffer;
+    // Points to uint16_t or uint32_t indices depending on bytesPerIndex
+    void* indexBuffer;
+
+    // Only filled in when loaded with ObjLoadFlag_GenerateTangents.
+    // One per vertex, in the same order as vertexBuffer. Kept as a separate
+    // stream so meshes without normal maps don't pay for it.
+    VertexTangent* tangentBuffer;
+
+    // Every triangle in indexBuffer belongs to one submesh, there's
+    // always at least one if there are any triangles. See ObjSubmesh.
+    ObjSubmesh* submeshes;
+    uint32_t numSubmeshes;
+    ObjMaterial* materials;
+    uint32_t numMaterials;
+
+    // Bounding box and bounding sphere of every vertex, for culling 
+    // and selectLod(). The sphere is found with Ritter's method, or is
+    // centred on the box if that's tighter. Zero if there are no vertices.
+    float boundsMin[3];
+    float boundsMax[3];
+    float boundsCenter[3];
+    float boundsRadius;
+
+    // Only filled in when loaded with ObjLoadFlag_PackVertices.
+    // Packed positions decode to: packedPosOffset + pos * packedPosScale
+    PackedVertexData* packedVertexBuffer;
+    float packedPosOffset[3];
+    float packedPosScale[3];
+
+    // Only filled in when loaded with ObjLoadFlag_BuildMeshlets.
+    // Each meshlet's vertices and triangles are a range of meshletVertices
+    // (indices into vertexBuffer) and meshletTriangles (3 8-bit indices
+    // into the meshlet's vertices per triangle), see Meshlets.h
+    Meshlet* meshlets;
+    uint32_t numMeshlets;
+    uint32_t* meshletVertices;
+    uint32_t numMeshletVertices;
+    uint8_t* meshletTriangles;
+    uint32_t numMeshletTriangles;
+
+    // Only filled in when loaded with ObjLoadFlag_GenerateLods.
+    // lodIndexBuffer follows on from indexBuffer, and has the same index
+    // width. Each MeshLod's indexOffset is into the two of them end to end,
+    // so lods[0] is always the full detail indexBuffer. Each LOD starts
+    // on a 4-byte boundary, so there may be padding indices between them.
+    MeshLod lods[MESH_MAX_LODS];
+    uint32_t numLods;
+    void* lodIndexBuffer;
+    uint32_t numLodIndices;
+
+    // Non-null if the buffers above point into a memory-mapped 
+    // mesh cache file rather than being allocated with malloc()
+    void* mappedFile;
+    size_t mappedFileNumBytes;
+    // True if vertexBuffer, indexBuffer, tangentBuffer, submeshes and materials were
+    // pushed onto the MemoryArena passed to loadObj(), see freeLoadedObj()
+    bool allocatedFromArena;
 };
 
+// Returns index i of loadedObj's index buffer, regardless of its width
+inline uint32_t getIndex(const LoadedObj& loadedObj, uint32_t i)
+{
+    if(loadedObj.bytesPerIndex == sizeof(uint16_t))
+        return ((const uint16_t*)loadedObj.indexBuffer)[i];
+    return ((const uint32_t*)loadedObj.indexBuffer)[i];
+}
+
 // Returns a vertex and index buffer loaded from .obj file 'filename'.
 // Vertex buffer format: (tightly packed)
 //   vp.x, vp.y, vp.z, vt.u, vt.v, vn.x, vn.y, vn.z
-// Allocates buffers using malloc().
+// Index buffer format: uint16_t or uint32_t, see bytesPerIndex
+// Faces with more than 3 corners are triangulated, as a fan if
+// they're convex or by ear clipping if they're concave.
+// Materials are read from the .mtl files named by mtllib statements,
+// relative to the .obj's directory, and triangles are grouped into
+// submeshes by the material usemtl assigns them. Materials usemtl names
+// that aren't in any .mtl file are added with default values.
+// Allocates buffers using malloc(), unless 'arena' is given (see below).
+// 'flags' is a combination of ObjLoadFlags.
+// If 'threadPool' is given, large files are split into chunks
+// of whole lines which are counted and parsed in parallel.
+//
+// If 'arena' is given, the vertex buffer, index buffer, tangent buffer,
+// submeshes and materials are pushed onto it at their final sizes, and the
+// loader's scratch space is pushed onto its scratch end and freed before
+// returning. Peak use is at most about 114 bytes per face corner (146 with
+// ObjLoadFlag_GenerateTangents) plus 12 per v/vt/vn line, of which the 
+// outputs keep at most 32 (48) per vertex and 4 per index.
+// It asserts if the arena runs out. The buffers made by the optional
+// passes (packed vertices, meshlets and LODs) still use malloc(), so
+// freeLoadedObj() must still be called; it leaves the arena alone.
 //
 // Usage:
 // LoadedObj myObj = loadObj("test.obj");
 // ... // Send myObj.vertexBuffer to GPU
 // ... // Send myObj.indexBuffer to GPU
 // freeLoadedObj(myObj);
-LoadedObj loadObj(const char* filename);
-void freeLoadedObj(LoadedObj loadedObj);
\ No newline at end of file
+LoadedObj loadObj(const char* filename, uint32_t flags = ObjLoadFlag_None, ThreadPool* threadPool = NULL,
+                  MemoryArena* arena = NULL);
+
+// Same as loadObj(), but goes through a binary cache file at 'cacheFilename'.
+// If the cache exists, was written with the same flags and the .obj's size and
+// modification time still match the ones recorded in it, the cache is mmapped
+// and the returned buffers point straight into it; they must not be written to.
+// Otherwise the .obj is parsed and a new cache is written for next time.
+// If the .obj file is missing a valid cache is still used.
+// NOTE: Changes to .mtl files don't invalidate the cache.
+//
+// Cache file layout: (native endianness)
+//   MeshCacheHeader (magic, version, load flags, source size/timestamp,
+//                    counts, bounds, section offsets and payload checksum)
+//   VertexData[numVertices]
+//   VertexTangent[numVertices]   (if loaded with ObjLoadFlag_GenerateTangents)
+//   uint16_t/uint32_t[numIndices]
+//   ObjSubmesh[numSubmeshes]
+//   ObjMaterial[numMaterials]
+//   PackedVertexData[numVertices] (if loaded with ObjLoadFlag_PackVertices)
+//   Meshlet[numMeshlets]                 (if loaded with ObjLoadFlag_BuildMeshlets)
+//   uint32_t[numMeshletVertices]         (")
+//   uint8_t[3 * numMeshletTriangles]     (")
+//   uint16_t/uint32_t[numLodIndices]     (if loaded with ObjLoadFlag_GenerateLods)
+LoadedObj loadObjCached(const char* objFilename, const char* cacheFilename, 
+                        uint32_t flags = ObjLoadFlag_None, ThreadPool* threadPool = NULL,
+                        MemoryArena* arena = NULL);
+
+void freeLoadedObj(LoadedObj loadedObj);
+
+// A batch of triangles handed to an ObjStreamBatchFunc by streamObj().
+// Batches are self-contained: their indices index into their own vertices,
+// so each can be uploaded or written out on its own. The pointers are only
+// valid until the callback returns.
+struct ObjStreamBatch
+{
+    const VertexData* vertices;
+    // One per vertex if streamed with ObjLoadFlag_GenerateTangents, otherwise null
+    const VertexTangent* tangents;
+    uint32_t numVertices;
+    const uint32_t* indices;
+    uint32_t numIndices;
+
+    uint32_t batchIndex;
+    // How much of the file has been processed, for reporting progress
+    uint64_t numFileBytesRead;
+    uint64_t fileNumBytes;
+};
+
+typedef void ObjStreamBatchFunc(const ObjStreamBatch* batch, void* userData);
+
+#define OBJ_STREAM_DEFAULT_WINDOW_NUM_BYTES (16 * 1024 * 1024)
+#define OBJ_STREAM_DEFAULT_BATCH_NUM_VERTICES (1024 * 1024)
+
+// Loads an .obj file of any size without mapping or allocating the whole
+// thing. The file is read 'windowNumBytes' at a time (more if a single line
+// is longer than that), and the resulting vertices and indices are passed to
+// 'func' in batches of at most 'maxBatchNumVertices' vertices and 
+// 8 * maxBatchNumVertices indices.
+// Memory use is capped at a few windows and batches, plus the file's v/vt/vn
+// attributes (12/8/12 bytes each) since faces can refer back to any of them.
+// Vertices shared by faces in different batches are duplicated in each, and
+// smoothed normals and tangents are only averaged over the faces within a
+// batch. Supports ObjLoadFlag_MergeByValue and ObjLoadFlag_GenerateTangents,
+// and ObjLoadFlag_OptimiseVertexCache and ObjLoadFlag_OptimiseOverdraw
+// which are applied to each batch.
+// Materials are ignored.
+// Returns false if the file couldn't be read.
+bool streamObj(const char* filename, ObjStreamBatchFunc* func, void* userData, uint32_t flags = ObjLoadFlag_None,
+               size_t windowNumBytes = OBJ_STREAM_DEFAULT_WINDOW_NUM_BYTES,
+               uint32_t maxBatchNumVertices = OBJ_STREAM_DEFAULT_BATCH_NUM_VERTICES);
\ No newline at end of file
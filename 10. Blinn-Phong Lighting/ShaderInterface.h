@@ -15,6 +15,7 @@ enum VertexAttributeIndex {
 enum ShaderBufferIndex  {
     ShaderBufferIndex_Attributes = 0,
     ShaderBufferIndex_Uniforms,
+    ShaderBufferIndex_Material,
     BufferIndexCount
 };
 
@@ -43,4 +44,9 @@ struct FSUniforms
     PointLight pointLights[2];
 };
 
+struct MaterialUniforms
+{
+    float4 diffuseColor; //NOTE: Multiplies the diffuse texture, w is opacity
+};
+
 #endif
@@ -0,0 +1,141 @@
+#include "ThreadPool.h"
+
+#include <unistd.h> //sysconf()
+#include <stdlib.h> //malloc(), free()
+#include <assert.h>
+
+uint32_t getNumLogicalCores()
+{
+    long numCores = sysconf(_SC_NPROCESSORS_ONLN);
+    return (numCores > 0) ? (uint32_t)numCores : 1;
+}
+
+// Pops the next job off the queue. Must be called with the mutex held.
+static ThreadPoolJob popJob(ThreadPool* pool)
+{
+    assert(pool->numQueuedJobs > 0);
+    ThreadPoolJob job = pool->jobs[pool->firstJob];
+    pool->firstJob = (pool->firstJob + 1) % THREAD_POOL_MAX_QUEUED_JOBS;
+    --pool->numQueuedJobs;
+    return job;
+}
+
+// Runs 'job' with the mutex released, then marks it as finished.
+// Must be called with the mutex held.
+static void runJob(ThreadPool* pool, ThreadPoolJob job)
+{
+    pthread_mutex_unlock(&pool->mutex);
+    job.func(job.userData);
+    pthread_mutex_lock(&pool->mutex);
+
+    --job.group->numPendingJobs;
+    pthread_cond_broadcast(&pool->jobFinished);
+}
+
+static void* workerThreadProc(void* userData)
+{
+    ThreadPool* pool = (ThreadPool*)userData;
+
+    pthread_mutex_lock(&pool->mutex);
+    while(true)
+    {
+        while(pool->numQueuedJobs == 0 && !pool->isShuttingDown)
+            pthread_cond_wait(&pool->jobAvailable, &pool->mutex);
+
+        if(pool->numQueuedJobs == 0)
+            break; // Shutting down and nothing left to do
+
+        runJob(pool, popJob(pool));
+    }
+    pthread_mutex_unlock(&pool->mutex);
+
+    return NULL;
+}
+
+void initThreadPool(ThreadPool* pool, uint32_t numThreads)
+{
+    if(numThreads == 0) {
+        numThreads = getNumLogicalCores() - 1;
+    }
+
+    pool->numThreads = 0;
+    pool->firstJob = 0;
+    pool->numQueuedJobs = 0;
+    pool->isShuttingDown = false;
+    pthread_mutex_init(&pool->mutex, NULL);
+    pthread_cond_init(&pool->jobAvailable, NULL);
+    pthread_cond_init(&pool->jobFinished, NULL);
+
+    pool->threads = (pthread_t*)malloc(numThreads * sizeof(pthread_t));
+    for(uint32_t i=0; i<numThreads; ++i)
+    {
+        if(pthread_create(&pool->threads[pool->numThreads], NULL, workerThreadProc, pool) == 0)
+            ++pool->numThreads;
+    }
+}
+
+void shutdownThreadPool(ThreadPool* pool)
+{
+    pthread_mutex_lock(&pool->mutex);
+    pool->isShuttingDown = true;
+    pthread_cond_broadcast(&pool->jobAvailable);
+    pthread_mutex_unlock(&pool->mutex);
+
+    for(uint32_t i=0; i<pool->numThreads; ++i)
+        pthread_join(pool->threads[i], NULL);
+
+    free(pool->threads);
+    pool->threads = NULL;
+    pool->numThreads = 0;
+
+    pthread_cond_destroy(&pool->jobFinished);
+    pthread_cond_destroy(&pool->jobAvailable);
+    pthread_mutex_destroy(&pool->mutex);
+}
+
+void threadPoolPushJob(ThreadPool* pool, ThreadPoolJobGroup* group, ThreadPoolJobFunc* func, void* userData)
+{
+    pthread_mutex_lock(&pool->mutex);
+    if(pool->numQueuedJobs == THREAD_POOL_MAX_QUEUED_JOBS)
+    {
+        // Queue is full, just do the work ourselves
+        pthread_mutex_unlock(&pool->mutex);
+        func(userData);
+        return;
+    }
+
+    uint32_t jobIndex = (pool->firstJob + pool->numQueuedJobs) % THREAD_POOL_MAX_QUEUED_JOBS;
+    pool->jobs[jobIndex].func = func;
+    pool->jobs[jobIndex].userData = userData;
+    pool->jobs[jobIndex].group = group;
+    ++pool->numQueuedJobs;
+    ++group->numPendingJobs;
+
+    pthread_cond_signal(&pool->jobAvailable);
+    pthread_mutex_unlock(&pool->mutex);
+}
+
+void threadPoolWait(ThreadPool* pool, ThreadPoolJobGroup* group)
+{
+    pthread_mutex_lock(&pool->mutex);
+    while(group->numPendingJobs > 0)
+    {
+        // Help out rather than sitting idle. This also means a job
+        // can wait on jobs it pushed without deadlocking the pool.
+        if(pool->numQueuedJobs > 0)
+            runJob(pool, popJob(pool));
+        else
+            pthread_cond_wait(&pool->jobFinished, &pool->mutex);
+    }
+    pthread_mutex_unlock(&pool->mutex);
+}
+
+bool threadPoolRunQueuedJob(ThreadPool* pool)
+{
+    pthread_mutex_lock(&pool->mutex);
+    bool result = (pool->numQueuedJobs > 0);
+    if(result)
+        runJob(pool, popJob(pool));
+    pthread_mutex_unlock(&pool->mutex);
+    return result;
+}
@@ -0,0 +1,74 @@
+#pragma once
+
+#include <stdint.h>
+#include <pthread.h>
+
+// A minimal fixed-size pool of worker threads pulling jobs from
+// a shared queue. Jobs are plain function pointers plus a userData
+// pointer, and are tracked by ThreadPoolJobGroups so the caller can
+// wait for a batch of work to finish.
+//
+// Usage:
+// ThreadPool pool;
+// initThreadPool(&pool, 0); // 0 = one thread per core
+// ThreadPoolJobGroup group = {};
+// for(int i=0; i<numJobs; ++i)
+//     threadPoolPushJob(&pool, &group, myJobFunc, &myJobData[i]);
+// threadPoolWait(&pool, &group);
+// shutdownThreadPool(&pool);
+
+typedef void ThreadPoolJobFunc(void* userData);
+
+struct ThreadPoolJobGroup
+{
+    // Number of jobs pushed to this group that haven't finished.
+    // Only accessed while holding the pool's mutex.
+    uint32_t numPendingJobs;
+};
+
+struct ThreadPoolJob
+{
+    ThreadPoolJobFunc* func;
+    void* userData;
+    ThreadPoolJobGroup* group;
+};
+
+#define THREAD_POOL_MAX_QUEUED_JOBS 1024
+
+struct ThreadPool
+{
+    pthread_t* threads;
+    uint32_t numThreads;
+
+    pthread_mutex_t mutex;
+    pthread_cond_t jobAvailable;
+    pthread_cond_t jobFinished;
+
+    // Ring buffer of queued jobs
+    ThreadPoolJob jobs[THREAD_POOL_MAX_QUEUED_JOBS];
+    uint32_t firstJob;
+    uint32_t numQueuedJobs;
+
+    bool isShuttingDown;
+};
+
+// Returns the number of logical cores on this machine
+uint32_t getNumLogicalCores();
+
+// Starts 'numThreads' worker threads. Passing 0 starts one less than
+// the number of logical cores, since the thread calling threadPoolWait()
+// also runs jobs while it waits.
+void initThreadPool(ThreadPool* pool, uint32_t numThreads);
+// Waits for queued jobs to finish, then joins all worker threads
+void shutdownThreadPool(ThreadPool* pool);
+
+// Queues func(userData) to run on a worker thread. If the queue is full
+// the job is run immediately on the calling thread instead.
+void threadPoolPushJob(ThreadPool* pool, ThreadPoolJobGroup* group, ThreadPoolJobFunc* func, void* userData);
+// Blocks until every job in 'group' has finished. The calling thread
+// runs queued jobs while it waits, so it's safe to call from a job.
+void threadPoolWait(ThreadPool* pool, ThreadPoolJobGroup* group);
+// Runs the next queued job, from any group, on the calling thread.
+// Returns false without blocking if the queue is empty. For threads
+// that wait on something other than a job group to help out meanwhile.
+bool threadPoolRunQueuedJob(ThreadPool* pool);
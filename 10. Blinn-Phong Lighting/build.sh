@@ -4,9 +4,9 @@ clear
 
 EXE_NAME="BlinnPhong"
 
-SOURCE_FILES="../main.mm ../3DMaths.cpp ../ObjLoading.cpp"
+SOURCE_FILES="../main.mm ../3DMaths.cpp ../ObjLoading.cpp ../ThreadPool.cpp ../MeshOptimisation.cpp ../Meshlets.cpp ../MeshSimplification.cpp ../AssetLoading.cpp ../FrustumCulling.cpp"
 
-COMMON_COMPILER_FLAGS="-Wall -std=c++11 -fno-objc-arc -fno-exceptions -fno-rtti -Wno-missing-braces "
+COMMON_COMPILER_FLAGS="-Wall -std=c++14 -fno-objc-arc -fno-exceptions -fno-rtti -Wno-missing-braces "
 DEBUG_FLAGS="-g -fno-inline"
 RELEASE_FLAGS="-O3"
 
@@ -10,7 +10,14 @@
 #include "3DMaths.h"
 #include "ShaderInterface.h"
 #include "ObjLoading.h"
+#include "MeshSimplification.h"
+#include "ThreadPool.h"
+#include "AssetLoading.h"
+#include "FrustumCulling.h"
 #define STB_IMAGE_IMPLEMENTATION
+// NOTE: Failure strings are kept in a global, which
+// isn't safe when loading images on several threads
+#define STBI_NO_FAILURE_STRINGS
 #include "stb_image.h"
 
 ///////////////////////////////////////////////////////////////////////
@@ -62,6 +69,29 @@ id<MTLTexture> osxCreateDepthTexture(id<MTLDevice> mtlDevice, int width, int hei
     return mtlDepthTexture;
 }
 
+id<MTLTexture> osxCreateTexture(id<MTLDevice> mtlDevice, const LoadedImage& image, const char* label)
+{
+    int texBytesPerRow = 4 * image.width;
+
+    // Create Texture
+    MTLTextureDescriptor* mtlTextureDescriptor =
+        [MTLTextureDescriptor texture2DDescriptorWithPixelFormat:MTLPixelFormatRGBA8Unorm
+                                                                 width:image.width
+                                                                 height:image.height
+                                                                 mipmapped:NO];
+    id<MTLTexture> mtlTexture = [mtlDevice newTextureWithDescriptor:mtlTextureDescriptor];
+    mtlTexture.label = [NSString stringWithUTF8String:label];
+    [mtlTextureDescriptor release];
+
+    // Copy loaded image into MTLTextureObject
+    [mtlTexture replaceRegion:MTLRegionMake2D(0,0,image.width,image.height)
+                              mipmapLevel:0
+                              withBytes:image.pixels
+                              bytesPerRow:texBytesPerRow];
+
+    return mtlTexture;
+}
+
 int main(int argc, const char* argv[])
 {
     NSApplication* app = [NSApplication sharedApplication];
@@ -122,44 +152,102 @@ int main(int argc, const char* argv[])
     id<MTLFunction> uniformColorFunc = [mtlLibrary newFunctionWithName:@"uniformColorFrag"];
     [mtlLibrary release];
 
-    LoadedObj cubeObj = loadObj("cube.obj");
+    // Load assets in parallel, uploading textures as soon as they're ready.
+    // cube.obj is parsed on the first run, later runs map the cached buffers directly.
+    ThreadPool threadPool;
+    initThreadPool(&threadPool, 0);
 
-    id<MTLBuffer> cubeVertexBuffer = [mtlDevice newBufferWithBytes:cubeObj.vertexBuffer 
-                                                length:cubeObj.numVertices * sizeof(VertexData)
+    enum AssetIndex {
+        AssetIndex_CubeMesh,
+        AssetIndex_TestTexture,
+        AssetIndex_Count
+    };
+    AssetRequest assetRequests[AssetIndex_Count] = {};
+    assetRequests[AssetIndex_CubeMesh] = {AssetType_Mesh, "cube.obj", "cube.meshcache", 
+                                          ObjLoadFlag_OptimiseOverdraw | ObjLoadFlag_PackVertices | ObjLoadFlag_GenerateLods};
+    assetRequests[AssetIndex_TestTexture] = {AssetType_Image, "test.png"};
+
+    LoadedObj cubeObj = {};
+    id<MTLTexture> defaultTexture = nil;
+    AssetBatch assetBatch;
+    beginAssetBatch(&assetBatch, &threadPool, assetRequests, AssetIndex_Count);
+    LoadedAsset asset;
+    while(waitForNextAsset(&assetBatch, &asset))
+    {
+        if(asset.requestIndex == AssetIndex_CubeMesh) {
+            cubeObj = asset.mesh;
+        }
+        else if(asset.requestIndex == AssetIndex_TestTexture && asset.succeeded) {
+            defaultTexture = osxCreateTexture(mtlDevice, asset.image, "test.png");
+            freeLoadedImage(asset.image);
+        }
+    }
+    endAssetBatch(&assetBatch);
+    assert(cubeObj.vertexBuffer);
+    assert(defaultTexture);
+
+    // NOTE: We upload the packed vertices, see PackedVertexData.
+    // The vertex shader gets normalised positions within the mesh's
+    // bounds, so we fold the transform back into the model matrices.
+    id<MTLBuffer> cubeVertexBuffer = [mtlDevice newBufferWithBytes:cubeObj.packedVertexBuffer 
+                                                length:cubeObj.numVertices * sizeof(PackedVertexData)
                                                 options:MTLResourceOptionCPUCacheModeDefault];
     cubeVertexBuffer.label = @"CubeVertexBuffer";
-    id<MTLBuffer> cubeIndexBuffer = [mtlDevice newBufferWithBytes:cubeObj.indexBuffer 
-                                               length:cubeObj.numIndices * sizeof(uint16_t)
+    // NOTE: The LODs' indices follow on from the full detail ones, see LoadedObj::lods
+    size_t cubeIndexBufferNumBytes = cubeObj.numIndices * cubeObj.bytesPerIndex;
+    size_t cubeLodIndexBufferNumBytes = cubeObj.numLodIndices * cubeObj.bytesPerIndex;
+    id<MTLBuffer> cubeIndexBuffer = [mtlDevice newBufferWithLength:cubeIndexBufferNumBytes + cubeLodIndexBufferNumBytes
                                                options:MTLResourceOptionCPUCacheModeDefault];
+    memcpy(cubeIndexBuffer.contents, cubeObj.indexBuffer, cubeIndexBufferNumBytes);
+    if(cubeLodIndexBufferNumBytes > 0)
+        memcpy((uint8_t*)cubeIndexBuffer.contents + cubeIndexBufferNumBytes, cubeObj.lodIndexBuffer, cubeLodIndexBufferNumBytes);
     cubeIndexBuffer.label = @"CubeIndexBuffer";
 
-    freeLoadedObj(cubeObj);
-
-    // Load Image
-    int texWidth, texHeight, texNumChannels;
-    int texForceNumChannels = 4;
-    unsigned char* testTextureBytes = stbi_load("test.png", &texWidth, &texHeight,
-                                                &texNumChannels, texForceNumChannels);
-    assert(testTextureBytes);
-    int texBytesPerRow = 4 * texWidth;
-
-    // Create Texture
-    MTLTextureDescriptor* mtlTextureDescriptor =
-        [MTLTextureDescriptor texture2DDescriptorWithPixelFormat:MTLPixelFormatRGBA8Unorm
-                                                                 width:texWidth
-                                                                 height:texHeight
-                                                                 mipmapped:NO];
-    id<MTLTexture> mtlTexture = [mtlDevice newTextureWithDescriptor:mtlTextureDescriptor];
-    mtlTexture.label = @"CubeDiffuse";
-    [mtlTextureDescriptor release];
-
-    // Copy loaded image into MTLTextureObject
-    [mtlTexture replaceRegion:MTLRegionMake2D(0,0,texWidth,texHeight)
-                              mipmapLevel:0
-                              withBytes:testTextureBytes
-                              bytesPerRow:texBytesPerRow];
-
-    stbi_image_free(testTextureBytes);
+    MTLIndexType cubeIndexType = (cubeObj.bytesPerIndex == sizeof(uint16_t)) ? MTLIndexTypeUInt16 : MTLIndexTypeUInt32;
+    float4x4 cubeDequantiseMat = translationMat((float3){cubeObj.packedPosOffset[0], cubeObj.packedPosOffset[1], cubeObj.packedPosOffset[2]})
+                               * scaleMat((float3){cubeObj.packedPosScale[0], cubeObj.packedPosScale[1], cubeObj.packedPosScale[2]});
+    // Takes positions back to the packed range. Flat axes have a scale of 0,
+    // any scale will do for them since every vertex is at the offset, 
+    // so use 1 to keep the matrix invertible.
+    float3 cubeInvertibleScale;
+    cubeInvertibleScale.x = (cubeObj.packedPosScale[0] > 0.f) ? cubeObj.packedPosScale[0] : 1.f;
+    cubeInvertibleScale.y = (cubeObj.packedPosScale[1] > 0.f) ? cubeObj.packedPosScale[1] : 1.f;
+    cubeInvertibleScale.z = (cubeObj.packedPosScale[2] > 0.f) ? cubeObj.packedPosScale[2] : 1.f;
+    float4x4 cubeQuantiseMat = inverseAffine(translationMat((float3){cubeObj.packedPosOffset[0], cubeObj.packedPosOffset[1], cubeObj.packedPosOffset[2]})
+                                             * scaleMat(cubeInvertibleScale));
+
+    // NOTE: cubeObj isn't freed since we need its LOD info for selectLod() 
+    // and its submeshes and materials every frame
+
+    // Load the material textures the mesh asked for, in a second batch.
+    // NOTE: Materials without a diffuse texture, or whose texture
+    // can't be loaded, share defaultTexture
+    id<MTLTexture>* materialTextures = (id<MTLTexture>*)malloc(cubeObj.numMaterials * sizeof(id<MTLTexture>));
+    AssetRequest* textureRequests = (AssetRequest*)calloc(cubeObj.numMaterials, sizeof(AssetRequest));
+    uint32_t* textureMaterialIndices = (uint32_t*)malloc(cubeObj.numMaterials * sizeof(uint32_t));
+    uint32_t numTextureRequests = 0;
+    for(uint32_t i=0; i<cubeObj.numMaterials; ++i)
+    {
+        materialTextures[i] = defaultTexture;
+        if(cubeObj.materials[i].diffuseTexturePath[0] != '\0') {
+            textureRequests[numTextureRequests] = {AssetType_Image, cubeObj.materials[i].diffuseTexturePath};
+            textureMaterialIndices[numTextureRequests++] = i;
+        }
+    }
+    beginAssetBatch(&assetBatch, &threadPool, textureRequests, numTextureRequests);
+    while(waitForNextAsset(&assetBatch, &asset))
+    {
+        if(!asset.succeeded)
+            continue;
+        uint32_t materialIndex = textureMaterialIndices[asset.requestIndex];
+        materialTextures[materialIndex] = osxCreateTexture(mtlDevice, asset.image, 
+                                                           cubeObj.materials[materialIndex].diffuseTexturePath);
+        freeLoadedImage(asset.image);
+    }
+    endAssetBatch(&assetBatch);
+    free(textureMaterialIndices);
+    free(textureRequests);
+    shutdownThreadPool(&threadPool);
 
     // Create a Sampler State
     MTLSamplerDescriptor* mtlSamplerDesc = [MTLSamplerDescriptor new];
@@ -212,16 +300,16 @@ int main(int argc, const char* argv[])
 
     // Create vertex descriptor
     MTLVertexDescriptor* vertDesc = [MTLVertexDescriptor new];
-    vertDesc.attributes[VertexAttributeIndex_Position].format = MTLVertexFormatFloat3;
-    vertDesc.attributes[VertexAttributeIndex_Position].offset = 0;
+    vertDesc.attributes[VertexAttributeIndex_Position].format = MTLVertexFormatUShort3Normalized;
+    vertDesc.attributes[VertexAttributeIndex_Position].offset = offsetof(PackedVertexData, pos);
     vertDesc.attributes[VertexAttributeIndex_Position].bufferIndex = ShaderBufferIndex_Attributes;
-    vertDesc.attributes[VertexAttributeIndex_TexCoords].format = MTLVertexFormatFloat2;
-    vertDesc.attributes[VertexAttributeIndex_TexCoords].offset = 3 * sizeof(float);
+    vertDesc.attributes[VertexAttributeIndex_TexCoords].format = MTLVertexFormatHalf2;
+    vertDesc.attributes[VertexAttributeIndex_TexCoords].offset = offsetof(PackedVertexData, uv);
     vertDesc.attributes[VertexAttributeIndex_TexCoords].bufferIndex = ShaderBufferIndex_Attributes;
-    vertDesc.attributes[VertexAttributeIndex_Normal].format = MTLVertexFormatFloat3;
-    vertDesc.attributes[VertexAttributeIndex_Normal].offset = 5 * sizeof(float);
+    vertDesc.attributes[VertexAttributeIndex_Normal].format = MTLVertexFormatShort2Normalized;
+    vertDesc.attributes[VertexAttributeIndex_Normal].offset = offsetof(PackedVertexData, norm);
     vertDesc.attributes[VertexAttributeIndex_Normal].bufferIndex = ShaderBufferIndex_Attributes;
-    vertDesc.layouts[ShaderBufferIndex_Attributes].stride = 8 * sizeof(float);
+    vertDesc.layouts[ShaderBufferIndex_Attributes].stride = sizeof(PackedVertexData);
     vertDesc.layouts[ShaderBufferIndex_Attributes].stepRate = 1;
     vertDesc.layouts[ShaderBufferIndex_Attributes].stepFunction = MTLVertexStepFunctionPerVertex;
 
@@ -407,26 +495,31 @@ int main(int argc, const char* argv[])
 
         // Calculate view matrix from camera data
         float4x4 viewMat = rotateXMat(-cameraPitch) * rotateYMat(-cameraYaw) * translationMat(-cameraPos);
-        float4x4 inverseViewMat = translationMat(cameraPos) * rotateYMat(cameraYaw) * rotateXMat(cameraPitch);
         cameraFwd = (float3){viewMat.m[2][0], viewMat.m[2][1], -viewMat.m[2][2]};
 
-        // Calculate model matrices for cubes
+        // Calculate transforms for cubes, see computeTransforms()
         const int numCubes = 3;
-        float4x4 cubeModelViewMats[numCubes];
-        float4x4 cubeInverseModelViewMats[numCubes];
-        float3 cubePositions[numCubes] = {
-            {0,0,0},
-            {-3, 0, -1.5},
-            {4.5, 0.2, -3}
-        };
+        float cubePosX[numCubes] = {0, -3, 4.5};
+        float cubePosY[numCubes] = {0, 0, 0.2};
+        float cubePosZ[numCubes] = {0, -1.5, -3};
+        float cubeRotX[numCubes] = {};
+        float cubeRotY[numCubes];
+        float cubeRotZ[numCubes] = {};
+        float cubeRotW[numCubes];
+        float cubeScales[numCubes] = {1, 1, 1};
 
         float modelRotation = 0.2f * M_PI * currentTimeInSeconds;
+        float cubeHalfAngles[numCubes];
         for(int i=0; i<numCubes; ++i)
         {
             modelRotation += 0.6f*i; // Add an offset so cubes have different phases
-            cubeModelViewMats[i] = viewMat * translationMat(cubePositions[i]) * rotateYMat(modelRotation);
-            cubeInverseModelViewMats[i] = rotateYMat(-modelRotation) * translationMat(-cubePositions[i]) * inverseViewMat;
+            cubeHalfAngles[i] = 0.5f * modelRotation;
         }
+        // Quaternions rotating about the y-axis
+        fastSinCos(cubeRotY, cubeRotW, cubeHalfAngles, numCubes);
+        TransformBatch cubeTransforms = {numCubes, cubePosX, cubePosY, cubePosZ, 
+                                         cubeRotX, cubeRotY, cubeRotZ, cubeRotW,
+                                         cubeScales, cubeScales, cubeScales};
 
         // Calculate uniform data for point lights
         const int numLights = 2;
@@ -438,6 +531,7 @@ int main(int argc, const char* argv[])
             {0.1, 0.4, 0.9, 1},
             {0.9, 0.1, 0.6, 1}
         };
+        dualquat lightTransforms[numLights];
         float4x4 lightModelViewMats[numLights];
         float4 pointLightPosEye[numLights];
 
@@ -445,23 +539,65 @@ int main(int argc, const char* argv[])
         for(int i=0; i<numLights; ++i)
         {
             lightRotation += 0.5f*i; // Add an offset so lights have different phases
-            lightModelViewMats[i] = viewMat * rotateYMat(lightRotation) * translationMat(initialPointLightPositions[i]) * scaleMat(0.2f);
+            // Lights orbit the y-axis, so their translation is their rotated starting position
+            quat lightOrbit = quatFromAxisAngle((float3){0, 1, 0}, lightRotation);
+            lightTransforms[i] = makeDualQuat(lightOrbit, rotate(lightOrbit, initialPointLightPositions[i]));
+            lightModelViewMats[i] = viewMat * rigidTransformMat(lightTransforms[i]) * scaleMat(0.2f);
             pointLightPosEye[i] = {lightModelViewMats[i].m[3][0], lightModelViewMats[i].m[3][1], lightModelViewMats[i].m[3][2], 1};
         }
+
+        // Cull cubes and lights using their bounding spheres in world space.
+        // Objects are numbered by their uniform slot, so cubes come first.
+        const int numObjects = numCubes + numLights;
+        float objectCenterX[numObjects];
+        float objectCenterY[numObjects];
+        float objectCenterZ[numObjects];
+        float objectRadius[numObjects];
+        float3 cubeBoundsCenter = {cubeObj.boundsCenter[0], cubeObj.boundsCenter[1], cubeObj.boundsCenter[2]};
+        for(int i=0; i<numCubes; ++i)
+        {
+            quat rotation = {cubeRotX[i], cubeRotY[i], cubeRotZ[i], cubeRotW[i]};
+            float3 center = rotate(rotation, cubeBoundsCenter * cubeScales[i]);
+            objectCenterX[i] = cubePosX[i] + center.x;
+            objectCenterY[i] = cubePosY[i] + center.y;
+            objectCenterZ[i] = cubePosZ[i] + center.z;
+            objectRadius[i] = cubeObj.boundsRadius * cubeScales[i];
+        }
+        for(int i=0; i<numLights; ++i)
+        {
+            float3 center = transformPoint(lightTransforms[i], cubeBoundsCenter * 0.2f);
+            objectCenterX[numCubes+i] = center.x;
+            objectCenterY[numCubes+i] = center.y;
+            objectCenterZ[numCubes+i] = center.z;
+            objectRadius[numCubes+i] = cubeObj.boundsRadius * 0.2f;
+        }
+        BoundingSpheres objectSpheres = {numObjects, objectCenterX, objectCenterY, objectCenterZ, objectRadius};
+        uint32_t visibleObjects[numObjects];
+        uint32_t numVisibleObjects = cullSpheres(makeFrustum(perspectiveMat * viewMat), objectSpheres, visibleObjects);
+        uint32_t numVisibleCubes = 0;
+        while(numVisibleCubes < numVisibleObjects && visibleObjects[numVisibleCubes] < (uint32_t)numCubes)
+            ++numVisibleCubes;
         
         // Copy data to uniform buffers
         assert(numCubes + numLights <= NUM_VS_UNIFORM_SLOTS);
+        // NOTE: Normals aren't quantised relative to the bounds,
+        // so cubeDequantiseMat only applies to the position matrices
+        VSUniforms* cubeUniforms = (VSUniforms*)uniformDataBuffer;
+        TransformOutputs cubeOutputs = {&cubeUniforms->modelView, &cubeUniforms->modelViewProj, 
+                                        &cubeUniforms->normalMatrix, VS_UNIFORM_BUFFER_SLOT_SIZE};
+        computeTransforms(cubeTransforms, viewMat, perspectiveMat, cubeDequantiseMat, cubeOutputs);
+
+        uint32_t cubeLods[numCubes];
         for(int i=0; i<numCubes; ++i)
         {
-            VSUniforms* cubeUniforms = (VSUniforms*)(uniformDataBuffer + (VS_UNIFORM_BUFFER_SLOT_SIZE*i));
-            cubeUniforms->modelView = cubeModelViewMats[i];
-            cubeUniforms->modelViewProj = perspectiveMat * cubeModelViewMats[i];
-            cubeUniforms->normalMatrix = float4x4ToFloat3x3(transpose(cubeInverseModelViewMats[i]));
+            // selectLod() works in the mesh's own units
+            const VSUniforms* uniforms = (const VSUniforms*)(uniformDataBuffer + (VS_UNIFORM_BUFFER_SLOT_SIZE*i));
+            cubeLods[i] = selectLod(cubeObj, uniforms->modelView * cubeQuantiseMat, perspectiveMat, caMetalLayer.drawableSize.height);
         }
         for(int i=0; i<numLights; ++i)
         {
             VSUniforms* lightUniforms = (VSUniforms*)(uniformDataBuffer + (VS_UNIFORM_BUFFER_SLOT_SIZE*(numCubes+i)));
-            lightUniforms->modelViewProj = perspectiveMat * lightModelViewMats[i];
+            lightUniforms->modelViewProj = perspectiveMat * lightModelViewMats[i] * cubeDequantiseMat;
         }
 
         memcpy(vsUniformBuffers[currentUniformBufferIndex].contents, uniformDataBuffer, uniformDataBufferSize);
@@ -509,31 +645,57 @@ int main(int argc, const char* argv[])
 
         [mtlRenderCommandEncoder setRenderPipelineState:blinnPhongRenderPipelineState];
         [mtlRenderCommandEncoder setVertexBuffer:cubeVertexBuffer offset:0 atIndex:ShaderBufferIndex_Attributes];
-        [mtlRenderCommandEncoder setFragmentTexture:mtlTexture atIndex:0];
         [mtlRenderCommandEncoder setFragmentSamplerState:mtlSamplerState atIndex:0];
         [mtlRenderCommandEncoder setFragmentBuffer:fsUniformBuffers[currentUniformBufferIndex] offset:0 atIndex:ShaderBufferIndex_Uniforms];
         [mtlRenderCommandEncoder setVertexBuffer:vsUniformBuffers[currentUniformBufferIndex] offset:0 atIndex:ShaderBufferIndex_Uniforms];
 
-        for(int i=0; i<numCubes; ++i)
+        // NOTE: Submeshes are sorted by material, so drawing every cube's
+        // range of one submesh before moving on binds each material once
+        id<MTLTexture> boundTexture = nil;
+        for(uint32_t s=0; s<cubeObj.numSubmeshes; ++s)
         {
-            [mtlRenderCommandEncoder setVertexBufferOffset:i*VS_UNIFORM_BUFFER_SLOT_SIZE
-                                     atIndex:ShaderBufferIndex_Uniforms];
-            [mtlRenderCommandEncoder drawIndexedPrimitives:MTLPrimitiveTypeTriangle
-                                 indexCount:cubeIndexBuffer.length / sizeof(uint16_t)
-                                 indexType:MTLIndexTypeUInt16
-                                 indexBuffer:cubeIndexBuffer
-                                 indexBufferOffset:0];
+            const ObjSubmesh& submesh = cubeObj.submeshes[s];
+            MaterialUniforms materialUniforms = {{1, 1, 1, 1}};
+            id<MTLTexture> texture = defaultTexture;
+            if(submesh.materialIndex != OBJ_NO_MATERIAL)
+            {
+                const ObjMaterial& material = cubeObj.materials[submesh.materialIndex];
+                materialUniforms.diffuseColor = {material.diffuseColor[0], material.diffuseColor[1], 
+                                                 material.diffuseColor[2], material.opacity};
+                texture = materialTextures[submesh.materialIndex];
+            }
+            if(texture != boundTexture)
+            {
+                [mtlRenderCommandEncoder setFragmentTexture:texture atIndex:0];
+                boundTexture = texture;
+            }
+            [mtlRenderCommandEncoder setFragmentBytes:&materialUniforms length:sizeof(MaterialUniforms) atIndex:ShaderBufferIndex_Material];
+
+            for(uint32_t v=0; v<numVisibleCubes; ++v)
+            {
+                uint32_t i = visibleObjects[v];
+                if(submesh.numIndices[cubeLods[i]] == 0)
+                    continue; // Simplified away entirely
+                [mtlRenderCommandEncoder setVertexBufferOffset:i*VS_UNIFORM_BUFFER_SLOT_SIZE
+                                         atIndex:ShaderBufferIndex_Uniforms];
+                [mtlRenderCommandEncoder drawIndexedPrimitives:MTLPrimitiveTypeTriangle
+                                     indexCount:submesh.numIndices[cubeLods[i]]
+                                     indexType:cubeIndexType
+                                     indexBuffer:cubeIndexBuffer
+                                     indexBufferOffset:submesh.indexOffset[cubeLods[i]] * cubeObj.bytesPerIndex];
+            }
         }
 
         [mtlRenderCommandEncoder setRenderPipelineState:lightRenderPipelineState];
-        for(int i=0; i<numLights; ++i)
+        for(uint32_t v=numVisibleCubes; v<numVisibleObjects; ++v)
         {
+            uint32_t i = visibleObjects[v] - numCubes;
             [mtlRenderCommandEncoder setVertexBufferOffset:(numCubes+i) * VS_UNIFORM_BUFFER_SLOT_SIZE atIndex:ShaderBufferIndex_Uniforms];
             [mtlRenderCommandEncoder setFragmentBytes:&pointLightColors[i] length:sizeof(float4) atIndex:ShaderBufferIndex_Uniforms];
             
             [mtlRenderCommandEncoder drawIndexedPrimitives:MTLPrimitiveTypeTriangle
-                                    indexCount:cubeIndexBuffer.length / sizeof(uint16_t)
-                                    indexType:MTLIndexTypeUInt16
+                                    indexCount:cubeObj.numIndices
+                                    indexType:cubeIndexType
                                     indexBuffer:cubeIndexBuffer
                                     indexBufferOffset:0];
         }
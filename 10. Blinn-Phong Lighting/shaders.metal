@@ -8,7 +8,8 @@ using namespace metal;
 struct VertexInput {
     float3 position [[attribute(VertexAttributeIndex_Position)]];
     float2 uv [[attribute(VertexAttributeIndex_TexCoords)]];
-    float3 normal [[attribute(VertexAttributeIndex_Normal)]];
+    // Octahedral-encoded, see decodeOctahedralNormal()
+    float2 normal [[attribute(VertexAttributeIndex_Normal)]];
 };
 
 struct ShaderInOut {
@@ -18,23 +19,33 @@ struct ShaderInOut {
     float2 uv;
 };
 
+// Inverse of the encoding in MeshOptimisation.cpp's packOctahedralNormal()
+float3 decodeOctahedralNormal(float2 e)
+{
+    float3 n = float3(e, 1.0 - abs(e.x) - abs(e.y));
+    float t = saturate(-n.z);
+    n.xy += select(float2(t), float2(-t), n.xy >= 0.0);
+    return normalize(n);
+}
+
 vertex ShaderInOut blinnPhongVert(VertexInput in [[stage_in]],
                                   constant VSUniforms& uniforms [[buffer(ShaderBufferIndex_Uniforms)]]) 
 {
     ShaderInOut out;
     out.position = uniforms.modelViewProj * float4(in.position, 1.0);
     out.posEye = (uniforms.modelView * float4(in.position, 1.0)).xyz;
-    out.normalEye = uniforms.normalMatrix * in.normal;
+    out.normalEye = uniforms.normalMatrix * decodeOctahedralNormal(in.normal);
     out.uv = in.uv;
     return out;
 }
 
 fragment float4 blinnPhongFrag(ShaderInOut in [[stage_in]],
                                constant FSUniforms& uniforms [[buffer(ShaderBufferIndex_Uniforms)]],
+                               constant MaterialUniforms& material [[buffer(ShaderBufferIndex_Material)]],
                                texture2d<float> colorTexture [[texture(0)]],
                                sampler sam [[sampler(0)]]) 
 {
-    float3 diffuseColor = colorTexture.sample(sam, in.uv).xyz;
+    float3 diffuseColor = colorTexture.sample(sam, in.uv).xyz * material.diffuseColor.xyz;
 
     float3 fragToCamDir = normalize(-in.posEye);
     